@@ -25,6 +25,11 @@
  *  - profit
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE // for memfd_create
+#endif
+
+#include "cli/server_request.h"
 #include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
@@ -38,14 +43,31 @@
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
 #include "common/points.h"
+#include "common/scratch_pool.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#endif
+
 #ifdef __APPLE__
 #include "osx/osx.h"
 #endif
@@ -83,6 +105,9 @@ static void usage(const char *progname)
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
   fprintf(stderr, "   --icc-intent <intent> specify icc intent, default to LAST\n");
   fprintf(stderr, "                     use --help icc-intent for list of supported intents\n");
+  fprintf(stderr, "   --server <socket> keep running and export the images requested over\n");
+  fprintf(stderr, "                     this local socket, no input or output are given then\n");
+  fprintf(stderr, "   --server-workers <n> exports processed at the same time, default: 2\n");
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h [option]\n");
   fprintf(stderr, "   --version\n");
@@ -121,40 +146,6 @@ static void icc_types()
   fprintf(stderr, " HLG_P3\n");
 }
 
-#define ICC_FROM_STR(name) if(!strcmp(option, #name)) return DT_COLORSPACE_ ## name;
-static dt_colorspaces_color_profile_type_t get_icc_type(const char* option)
-{
-  ICC_FROM_STR(NONE);
-  ICC_FROM_STR(FILE);
-  ICC_FROM_STR(SRGB);
-  ICC_FROM_STR(ADOBERGB);
-  ICC_FROM_STR(LIN_REC709);
-  ICC_FROM_STR(LIN_REC2020);
-  ICC_FROM_STR(XYZ);
-  ICC_FROM_STR(LAB);
-  ICC_FROM_STR(INFRARED);
-  ICC_FROM_STR(DISPLAY);
-  ICC_FROM_STR(EMBEDDED_ICC);
-  ICC_FROM_STR(EMBEDDED_MATRIX);
-  ICC_FROM_STR(STANDARD_MATRIX);
-  ICC_FROM_STR(ENHANCED_MATRIX);
-  ICC_FROM_STR(VENDOR_MATRIX);
-  ICC_FROM_STR(ALTERNATE_MATRIX);
-  ICC_FROM_STR(BRG);
-  ICC_FROM_STR(EXPORT); // export and softproof are categories and will return NULL with dt_colorspaces_get_profile()
-  ICC_FROM_STR(SOFTPROOF);
-  ICC_FROM_STR(WORK);
-  ICC_FROM_STR(DISPLAY2);
-  ICC_FROM_STR(REC709);
-  ICC_FROM_STR(PROPHOTO_RGB);
-  ICC_FROM_STR(PQ_REC2020);
-  ICC_FROM_STR(HLG_REC2020);
-  ICC_FROM_STR(PQ_P3);
-  ICC_FROM_STR(HLG_P3);
-  return DT_COLORSPACE_LAST;
-}
-#undef ICC_FROM_STR
-
 static void icc_intents()
 {
   // TODO: Can this be automated to keep in sync with colorspaces.h?
@@ -164,16 +155,465 @@ static void icc_intents()
   fprintf(stderr, " SATURATION\n");
   fprintf(stderr, " ABSOLUTE_COLORIMETRIC\n");
 }
-#define ICC_INTENT_FROM_STR(name) if(!strcmp(option, #name)) return DT_INTENT_ ## name;
-static dt_iop_color_intent_t get_icc_intent(const char* option)
+#ifndef _WIN32
+
+/**
+ * server mode: keep darktable initialized and export images on request, coming in over a local socket.
+ *
+ * a request is a header of "key value" lines, terminated by an empty line:
+ *   input <file>          the image to export, required
+ *   xmp <file>            sidecar to apply, or
+ *   xmp-size <bytes>      the sidecar follows the header inline, with exactly that many bytes
+ *   format <ext>          output format, default: jpg
+ *   width, height <px>    maximum size, default: 0 = full resolution
+ *   hq, upscale <0|1|false|true>
+ *   style <style name>, style-overwrite <0|1|false|true>
+ *   icc-type, icc-file, icc-intent  as on the command line
+ * without an xmp the image is exported with its default processing.
+ *
+ * the answer is either "OK <bytes>\n" followed by the exported file, or "ERROR <message>\n". the connection
+ * stays open for further requests until the client closes it, except after a malformed request. connections
+ * idle for more than a minute, clients stalling in the middle of a request and clients not taking the reply
+ * are dropped.
+ *
+ * the workers only ever serve a single request. in between, the connections are watched by the main loop and
+ * only handed to a worker once the next header is complete, so clients keeping a connection open or sending
+ * slowly don't tie up a worker.
+ */
+
+// connections waiting for a worker before new ones get turned away, per worker
+#define DT_CLI_SERVER_QUEUE 4
+// open connections waiting for their next request, per worker
+#define DT_CLI_SERVER_IDLE 16
+// seconds a connection may stay idle between requests
+#define DT_CLI_SERVER_IDLE_TIMEOUT 60.0
+// seconds a client may refuse to take any part of the reply before its connection is dropped
+#define DT_CLI_SERVER_WRITE_TIMEOUT 10
+
+typedef struct dt_cli_server_t
+{
+  int workers;
+  gboolean verbose;
+  GThreadPool *pool;
+  dt_scratch_pool_t *scratch; // shared by all workers, so buffers survive from one request to the next
+  GMutex lock;                // protects imports and busy
+  GCond idle;
+  GHashTable *busy;           // ids of the images being exported right now
+  GAsyncQueue *done;          // connections handed back by the workers after a request
+  int wake[2];                // pipe to wake up the main loop when a connection is handed back
+} dt_cli_server_t;
+
+static void _server_signal(int sig)
+{
+  dt_cli_server_quit = 1;
+}
+
+static gboolean _write_all(const int fd, const char *buf, size_t size)
+{
+  while(size > 0)
+  {
+    const ssize_t n = write(fd, buf, size);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return FALSE;
+    buf += n;
+    size -= n;
+  }
+  return TRUE;
+}
+
+static gboolean _reply_error(const int fd, const char *message)
 {
-  ICC_INTENT_FROM_STR(PERCEPTUAL);
-  ICC_INTENT_FROM_STR(RELATIVE_COLORIMETRIC);
-  ICC_INTENT_FROM_STR(SATURATION);
-  ICC_INTENT_FROM_STR(ABSOLUTE_COLORIMETRIC);
-  return DT_INTENT_LAST;
+  gchar *reply = g_strdup_printf("ERROR %s\n", message);
+  const gboolean res = _write_all(fd, reply, strlen(reply));
+  g_free(reply);
+  return res;
 }
-#undef ICC_INTENT_FROM_STR
+
+// send the whole file behind in_fd after the header line
+static gboolean _reply_file(const int fd, const int in_fd)
+{
+  struct stat st;
+  if(fstat(in_fd, &st) != 0 || lseek(in_fd, 0, SEEK_SET) != 0) return _reply_error(fd, "can't read output");
+
+  gchar *reply = g_strdup_printf("OK %" G_GUINT64_FORMAT "\n", (guint64)st.st_size);
+  const gboolean res = _write_all(fd, reply, strlen(reply));
+  g_free(reply);
+  if(!res) return FALSE;
+
+  off_t left = st.st_size;
+#ifdef __linux__
+  // straight from the page cache into the socket
+  while(left > 0)
+  {
+    const ssize_t n = sendfile(fd, in_fd, NULL, left);
+    if(n < 0 && errno == EINTR) continue;
+    // the send timeout ran out
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return FALSE;
+    if(n <= 0) break;
+    left -= n;
+  }
+  // if sendfile() isn't possible, the file offset is still where it left off
+#endif
+  char buf[65536];
+  while(left > 0)
+  {
+    const ssize_t n = read(in_fd, buf, MIN((size_t)left, sizeof(buf)));
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0 || !_write_all(fd, buf, n)) return FALSE;
+    left -= n;
+  }
+  return TRUE;
+}
+
+// an anonymous in-memory file, if possible, that the export code can nevertheless open by its path
+static int _open_memfile(const char *name, gchar **path, gboolean *unlink_path)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+  const int fd = memfd_create(name, MFD_CLOEXEC);
+  if(fd >= 0)
+  {
+    *path = g_strdup_printf("/proc/self/fd/%d", fd);
+    *unlink_path = FALSE;
+    return fd;
+  }
+#endif
+  gchar *template = g_strdup_printf("darktable-cli-%s-XXXXXX", name);
+  const int tmp_fd = g_file_open_tmp(template, path, NULL);
+  g_free(template);
+  *unlink_path = TRUE;
+  return tmp_fd;
+}
+
+static void _close_memfile(const int fd, gchar *path, const gboolean unlink_path)
+{
+  if(fd < 0) return;
+  close(fd);
+  if(unlink_path) g_unlink(path);
+  g_free(path);
+}
+
+// import the image, or find it again if an earlier request already did
+static int32_t _server_import(dt_cli_server_t *server, const char *input)
+{
+  if(!g_file_test(input, G_FILE_TEST_IS_REGULAR)) return 0;
+
+  g_mutex_lock(&server->lock);
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(input);
+  const int filmid = dt_film_new(&film, directory);
+  const int32_t id = filmid ? dt_image_import(filmid, input, TRUE, TRUE) : 0;
+  g_free(directory);
+  g_mutex_unlock(&server->lock);
+  return id;
+}
+
+// the history of an image lives in the library, so concurrent requests for the same image take turns
+static void _server_acquire_image(dt_cli_server_t *server, const int32_t id)
+{
+  g_mutex_lock(&server->lock);
+  while(g_hash_table_contains(server->busy, GINT_TO_POINTER(id))) g_cond_wait(&server->idle, &server->lock);
+  g_hash_table_add(server->busy, GINT_TO_POINTER(id));
+  g_mutex_unlock(&server->lock);
+}
+
+static void _server_release_image(dt_cli_server_t *server, const int32_t id)
+{
+  g_mutex_lock(&server->lock);
+  g_hash_table_remove(server->busy, GINT_TO_POINTER(id));
+  g_cond_broadcast(&server->idle);
+  g_mutex_unlock(&server->lock);
+}
+
+// export one request into out_path. returns NULL on success, or a message for the client.
+static const char *_server_export(dt_cli_server_t *server, const dt_cli_request_t *req, const char *xmp_path,
+                                  const char *out_path)
+{
+  const char *ext = req->format ? req->format : "jpg";
+  if(!strcmp(ext, "jpg")) ext = "jpeg";
+  if(!strcmp(ext, "tif")) ext = "tiff";
+  dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(ext);
+  if(!format) return "unknown format";
+
+  const int32_t id = _server_import(server, req->input);
+  if(!id) return "can't open input";
+
+  _server_acquire_image(server, id);
+
+  const char *error = NULL;
+  if(xmp_path)
+  {
+    dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+    if(dt_exif_xmp_read(image, xmp_path, 1) != 0) error = "can't read xmp";
+    // don't write new xmp:
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+  }
+  else
+  {
+    // forget what an earlier request applied
+    dt_history_delete_on_image_ext(id, FALSE);
+  }
+
+  dt_imageio_module_data_t *fdata = error ? NULL : format->get_params(format);
+  if(!error && !fdata) error = "can't get format parameters";
+
+  if(!error)
+  {
+    fdata->max_width = req->width;
+    fdata->max_height = req->height;
+    fdata->style[0] = '\0';
+    fdata->style_append = 1;
+    if(req->style)
+    {
+      g_strlcpy((char *)fdata->style, req->style, DT_MAX_STYLE_NAME_LENGTH);
+      if(req->style_overwrite) fdata->style_append = 0;
+    }
+
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(dt_imageio_export(id, out_path, format, fdata, req->high_quality, req->upscale, TRUE, FALSE, req->icc_type,
+                         req->icc_filename, req->icc_intent, NULL, NULL, 1, 1, &metadata) != 0)
+      error = "export failed";
+    format->free_params(format, fdata);
+  }
+
+  _server_release_image(server, id);
+  return error;
+}
+
+static void _connection_close(dt_cli_reader_t *reader)
+{
+  close(reader->fd);
+  free(reader);
+}
+
+// worker: serve the next request of a connection, then hand it back to the main loop
+static void _server_connection(gpointer data, gpointer user_data)
+{
+  dt_cli_server_t *server = (dt_cli_server_t *)user_data;
+  dt_cli_reader_t *reader = (dt_cli_reader_t *)data;
+  const int fd = reader->fd;
+  dt_scratch_pool_t *prev_scratch = dt_scratch_pool_set_current(server->scratch);
+  gboolean ok = FALSE;
+
+  if(!dt_cli_server_quit)
+  {
+    dt_cli_request_t req;
+    const char *error = NULL;
+    const int status = dt_cli_read_request(reader, &req, &error);
+    // after a malformed header we can't tell where the next request starts
+    if(status < 0) _reply_error(fd, error ? error : "malformed request");
+    if(status != 0)
+    {
+      dt_cli_request_cleanup(&req);
+      goto done;
+    }
+
+    const double start = dt_get_wtime();
+    ok = TRUE;
+
+    gchar *xmp_path = NULL;
+    gboolean xmp_unlink = FALSE;
+    int xmp_fd = -1;
+    if(req.xmp_size)
+    {
+      char *xmp = g_malloc(req.xmp_size);
+      ok = dt_cli_read_bytes(reader, xmp, req.xmp_size);
+      if(ok)
+      {
+        xmp_fd = _open_memfile("xmp", &xmp_path, &xmp_unlink);
+        if(xmp_fd < 0 || !_write_all(xmp_fd, xmp, req.xmp_size)) error = "can't store xmp";
+      }
+      g_free(xmp);
+    }
+
+    gchar *out_path = NULL;
+    gboolean out_unlink = FALSE;
+    int out_fd = -1;
+    if(ok && !error)
+    {
+      out_fd = _open_memfile("export", &out_path, &out_unlink);
+      if(out_fd < 0) error = "can't create output";
+    }
+
+    if(ok && !error) error = _server_export(server, &req, xmp_path ? xmp_path : req.xmp, out_path);
+
+    if(ok) ok = error ? _reply_error(fd, error) : _reply_file(fd, out_fd);
+
+    if(server->verbose)
+      fprintf(stderr, "[darktable-cli] %s: %s in %.3f s\n", req.input, error ? error : "exported",
+              dt_get_wtime() - start);
+
+    _close_memfile(out_fd, out_path, out_unlink);
+    _close_memfile(xmp_fd, xmp_path, xmp_unlink);
+    dt_cli_request_cleanup(&req);
+  }
+
+done:
+  dt_scratch_pool_set_current(prev_scratch);
+  if(!ok || dt_cli_server_quit)
+  {
+    _connection_close(reader);
+    return;
+  }
+  reader->idle_since = dt_get_wtime();
+  g_async_queue_push(server->done, reader);
+  const char wake = 0;
+  if(write(server->wake[1], &wake, 1) < 0)
+  {
+    // the pipe is full, so the main loop will look at the queue anyway
+  }
+}
+
+static int _server_run(const char *socket_path, const int workers, const gboolean verbose)
+{
+  struct sockaddr_un addr = { 0 };
+  addr.sun_family = AF_UNIX;
+  if(strlen(socket_path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, _("error: socket path too long: %s\n"), socket_path);
+    return 1;
+  }
+  g_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+
+  // replace a stale socket of an earlier run, but nothing else
+  struct stat st;
+  if(lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+     || chmod(socket_path, S_IRUSR | S_IWUSR) != 0 || listen(listen_fd, 16) != 0)
+  {
+    fprintf(stderr, _("error: can't listen on %s: %s\n"), socket_path, g_strerror(errno));
+    if(listen_fd >= 0) close(listen_fd);
+    return 1;
+  }
+  fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+
+  int wake[2];
+  if(pipe(wake) != 0)
+  {
+    fprintf(stderr, _("error: can't listen on %s: %s\n"), socket_path, g_strerror(errno));
+    close(listen_fd);
+    return 1;
+  }
+  for(int k = 0; k < 2; k++)
+  {
+    fcntl(wake[k], F_SETFD, FD_CLOEXEC);
+    fcntl(wake[k], F_SETFL, O_NONBLOCK);
+  }
+
+  dt_cli_server_t server = { 0 };
+  server.workers = workers;
+  server.verbose = verbose;
+  server.scratch = dt_scratch_pool_new("server", (size_t)dt_conf_get_int("scratch_pool_size") << 20);
+  server.busy = g_hash_table_new(NULL, NULL);
+  g_mutex_init(&server.lock);
+  g_cond_init(&server.idle);
+  server.done = g_async_queue_new();
+  server.wake[0] = wake[0];
+  server.wake[1] = wake[1];
+  server.pool = g_thread_pool_new(_server_connection, &server, workers, TRUE, NULL);
+  // connections waiting for their next request
+  GPtrArray *idle = g_ptr_array_new();
+  const guint max_idle = DT_CLI_SERVER_IDLE * workers;
+
+  struct sigaction sa = { 0 };
+  sa.sa_handler = _server_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  // clients going away must not take the server with them
+  signal(SIGPIPE, SIG_IGN);
+
+  if(verbose) fprintf(stderr, "[darktable-cli] serving on %s with %d workers\n", socket_path, workers);
+
+  struct pollfd *pfd = NULL;
+  while(!dt_cli_server_quit)
+  {
+    // take back the connections the workers are done with. pipelined requests are already buffered
+    // and go straight back to the pool.
+    char drain[64];
+    while(read(wake[0], drain, sizeof(drain)) > 0);
+    dt_cli_reader_t *back;
+    while((back = g_async_queue_try_pop(server.done)))
+    {
+      if(dt_cli_reader_has_header(back)) g_thread_pool_push(server.pool, back, NULL);
+      else g_ptr_array_add(idle, back);
+    }
+
+    pfd = g_renew(struct pollfd, pfd, idle->len + 2);
+    pfd[0] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+    pfd[1] = (struct pollfd){ .fd = wake[0], .events = POLLIN };
+    for(guint k = 0; k < idle->len; k++)
+      pfd[k + 2] = (struct pollfd){ .fd = ((dt_cli_reader_t *)g_ptr_array_index(idle, k))->fd, .events = POLLIN };
+    if(poll(pfd, idle->len + 2, 250) < 0) continue;
+
+    // collect the requests here and only hand a connection to a worker once its header is complete, slow
+    // clients must not tie up a worker either. hangups and errors are noticed by the worker. go backwards,
+    // the array shrinks while we're at it.
+    const double now = dt_get_wtime();
+    for(guint k = idle->len; k > 0; k--)
+    {
+      dt_cli_reader_t *reader = (dt_cli_reader_t *)g_ptr_array_index(idle, k - 1);
+      const short revents = pfd[k + 1].revents;
+      if((revents & (POLLIN | POLLHUP | POLLERR))
+         && (!dt_cli_reader_append(reader) || dt_cli_reader_has_header(reader)))
+      {
+        g_ptr_array_remove_index_fast(idle, k - 1);
+        g_thread_pool_push(server.pool, reader, NULL);
+      }
+      else if(now - reader->idle_since > DT_CLI_SERVER_IDLE_TIMEOUT)
+      {
+        g_ptr_array_remove_index_fast(idle, k - 1);
+        _connection_close(reader);
+      }
+    }
+
+    if(!(pfd[0].revents & POLLIN)) continue;
+
+    const int fd = accept(listen_fd, NULL, NULL);
+    if(fd < 0) continue;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    // writes fail instead of blocking forever once a client stops reading, so it can neither hold a worker
+    // nor the shutdown waiting for the workers
+    const struct timeval send_timeout = { .tv_sec = DT_CLI_SERVER_WRITE_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    if(g_thread_pool_unprocessed(server.pool) >= (guint)(DT_CLI_SERVER_QUEUE * workers) || idle->len >= max_idle)
+    {
+      _reply_error(fd, "busy");
+      close(fd);
+      continue;
+    }
+    dt_cli_reader_t *reader = calloc(1, sizeof(dt_cli_reader_t));
+    reader->fd = fd;
+    reader->idle_since = now;
+    g_ptr_array_add(idle, reader);
+  }
+
+  if(verbose) fprintf(stderr, "[darktable-cli] shutting down\n");
+
+  close(listen_fd);
+  unlink(socket_path);
+  // finish the requests being processed, waiting ones see the quit flag and close their connections
+  g_thread_pool_free(server.pool, FALSE, TRUE);
+  dt_cli_reader_t *back;
+  while((back = g_async_queue_try_pop(server.done))) _connection_close(back);
+  for(guint k = 0; k < idle->len; k++) _connection_close((dt_cli_reader_t *)g_ptr_array_index(idle, k));
+  g_ptr_array_free(idle, TRUE);
+  g_free(pfd);
+  g_async_queue_unref(server.done);
+  close(wake[0]);
+  close(wake[1]);
+  g_hash_table_destroy(server.busy);
+  g_cond_clear(&server.idle);
+  g_mutex_clear(&server.lock);
+  dt_scratch_pool_unref(server.scratch);
+  return 0;
+}
+
+#endif // _WIN32
 
 int main(int argc, char *arg[])
 {
@@ -207,6 +647,9 @@ int main(int argc, char *arg[])
   gchar *icc_filename = NULL;
   dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
 
+  const char *server_socket = NULL;
+  int server_workers = 2;
+
   int k;
   for(k = 1; k < argc; k++)
   {
@@ -347,7 +790,7 @@ int main(int argc, char *arg[])
       {
         k++;
         gchar *str = g_ascii_strup(arg[k], -1);
-        icc_type = get_icc_type(str);
+        icc_type = dt_cli_get_icc_type(str);
         g_free(str);
         if(icc_type >= DT_COLORSPACE_LAST){
           fprintf(stderr, _("incorrect ICC type for --icc-type: '%s'\n"), arg[k]);
@@ -372,7 +815,7 @@ int main(int argc, char *arg[])
       {
         k++;
         gchar *str = g_ascii_strup(arg[k], -1);
-        icc_intent = get_icc_intent(str);
+        icc_intent = dt_cli_get_icc_intent(str);
         g_free(str);
         if(icc_intent >= DT_INTENT_LAST){
           fprintf(stderr, _("incorrect ICC intent for --icc-intent: '%s'\n"), arg[k]);
@@ -381,6 +824,16 @@ int main(int argc, char *arg[])
           exit(1);
         }
       }
+      else if(!strcmp(arg[k], "--server") && argc > k + 1)
+      {
+        k++;
+        server_socket = arg[k];
+      }
+      else if(!strcmp(arg[k], "--server-workers") && argc > k + 1)
+      {
+        k++;
+        server_workers = MAX(atoi(arg[k]), 1);
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -420,6 +873,31 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
+  if(server_socket)
+  {
+    if(inputs || file_counter > 0)
+      fprintf(stderr, "%s\n", _("warning: input and output are ignored in server mode"));
+    if(inputs) g_list_free_full(inputs, g_free);
+    g_free(output_filename);
+    g_free(output_ext);
+    g_free(icc_filename);
+#ifdef _WIN32
+    fprintf(stderr, "%s\n", _("error: server mode is not supported on this platform"));
+    free(m_arg);
+    exit(1);
+#else
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    const int res = _server_run(server_socket, server_workers, verbose);
+    dt_cleanup();
+    free(m_arg);
+    exit(res);
+#endif
+  }
+
   if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
@@ -743,6 +1221,10 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
+  // recycle the modules' scratch buffers across all exported images
+  dt_scratch_pool_t *scratch = dt_scratch_pool_new("export", (size_t)dt_conf_get_int("scratch_pool_size") << 20);
+  dt_scratch_pool_t *prev_scratch = dt_scratch_pool_set_current(scratch);
+
   int num = 1, res = 0;
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
@@ -756,6 +1238,9 @@ int main(int argc, char *arg[])
       res = 1;
   }
 
+  dt_scratch_pool_set_current(prev_scratch);
+  dt_scratch_pool_unref(scratch);
+
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
   storage->free_params(storage, sdata);
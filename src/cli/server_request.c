@@ -0,0 +1,281 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cli/server_request.h"
+#include "common/darktable.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define ICC_FROM_STR(name) if(!strcmp(option, #name)) return DT_COLORSPACE_ ## name;
+dt_colorspaces_color_profile_type_t dt_cli_get_icc_type(const char* option)
+{
+  ICC_FROM_STR(NONE);
+  ICC_FROM_STR(FILE);
+  ICC_FROM_STR(SRGB);
+  ICC_FROM_STR(ADOBERGB);
+  ICC_FROM_STR(LIN_REC709);
+  ICC_FROM_STR(LIN_REC2020);
+  ICC_FROM_STR(XYZ);
+  ICC_FROM_STR(LAB);
+  ICC_FROM_STR(INFRARED);
+  ICC_FROM_STR(DISPLAY);
+  ICC_FROM_STR(EMBEDDED_ICC);
+  ICC_FROM_STR(EMBEDDED_MATRIX);
+  ICC_FROM_STR(STANDARD_MATRIX);
+  ICC_FROM_STR(ENHANCED_MATRIX);
+  ICC_FROM_STR(VENDOR_MATRIX);
+  ICC_FROM_STR(ALTERNATE_MATRIX);
+  ICC_FROM_STR(BRG);
+  ICC_FROM_STR(EXPORT); // export and softproof are categories and will return NULL with dt_colorspaces_get_profile()
+  ICC_FROM_STR(SOFTPROOF);
+  ICC_FROM_STR(WORK);
+  ICC_FROM_STR(DISPLAY2);
+  ICC_FROM_STR(REC709);
+  ICC_FROM_STR(PROPHOTO_RGB);
+  ICC_FROM_STR(PQ_REC2020);
+  ICC_FROM_STR(HLG_REC2020);
+  ICC_FROM_STR(PQ_P3);
+  ICC_FROM_STR(HLG_P3);
+  return DT_COLORSPACE_LAST;
+}
+#undef ICC_FROM_STR
+
+#define ICC_INTENT_FROM_STR(name) if(!strcmp(option, #name)) return DT_INTENT_ ## name;
+dt_iop_color_intent_t dt_cli_get_icc_intent(const char* option)
+{
+  ICC_INTENT_FROM_STR(PERCEPTUAL);
+  ICC_INTENT_FROM_STR(RELATIVE_COLORIMETRIC);
+  ICC_INTENT_FROM_STR(SATURATION);
+  ICC_INTENT_FROM_STR(ABSOLUTE_COLORIMETRIC);
+  return DT_INTENT_LAST;
+}
+#undef ICC_INTENT_FROM_STR
+
+#ifndef _WIN32
+
+volatile sig_atomic_t dt_cli_server_quit = 0;
+
+static ssize_t _reader_fill(dt_cli_reader_t *r)
+{
+  r->pos = r->len = 0;
+  // wait in small steps, stalling clients must neither hold a worker forever nor keep the server from
+  // shutting down
+  struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+  const double timeout = dt_get_wtime() + DT_CLI_SERVER_READ_TIMEOUT;
+  int ready;
+  do
+    ready = poll(&pfd, 1, 250);
+  while(!dt_cli_server_quit && (ready == 0 || (ready < 0 && errno == EINTR)) && dt_get_wtime() < timeout);
+  if(ready <= 0) return -1;
+
+  ssize_t n;
+  do
+    n = read(r->fd, r->buf, sizeof(r->buf));
+  while(n < 0 && errno == EINTR);
+  if(n > 0) r->len = n;
+  return n;
+}
+
+gboolean dt_cli_reader_append(dt_cli_reader_t *r)
+{
+  if(r->pos > 0)
+  {
+    memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+  }
+  if(r->len == sizeof(r->buf)) return FALSE;
+  ssize_t n;
+  do
+    n = recv(r->fd, r->buf + r->len, sizeof(r->buf) - r->len, MSG_DONTWAIT);
+  while(n < 0 && errno == EINTR);
+  if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return TRUE;
+  if(n <= 0) return FALSE;
+  r->len += n;
+  return TRUE;
+}
+
+gboolean dt_cli_reader_has_header(const dt_cli_reader_t *r)
+{
+  size_t k = r->pos;
+  // empty lines between requests
+  while(k < r->len && (r->buf[k] == '\n' || r->buf[k] == '\r')) k++;
+  for(; k + 1 < r->len; k++)
+    if(r->buf[k] == '\n' && (r->buf[k + 1] == '\n' || (r->buf[k + 1] == '\r' && k + 2 < r->len && r->buf[k + 2] == '\n')))
+      return TRUE;
+  return FALSE;
+}
+
+// read one line without the line break. returns its length, -1 at the end of the stream and on errors, and
+// -2 for overlong lines.
+static int _read_line(dt_cli_reader_t *r, char *line, const size_t size)
+{
+  size_t n = 0;
+  for(;;)
+  {
+    if(r->pos == r->len && _reader_fill(r) <= 0) return -1;
+    const char c = r->buf[r->pos++];
+    if(c == '\n') break;
+    if(n + 1 >= size) return -2;
+    line[n++] = c;
+  }
+  if(n > 0 && line[n - 1] == '\r') n--;
+  line[n] = '\0';
+  return n;
+}
+
+gboolean dt_cli_read_bytes(dt_cli_reader_t *r, char *out, size_t size)
+{
+  while(size > 0)
+  {
+    if(r->pos == r->len && _reader_fill(r) <= 0) return FALSE;
+    const size_t n = MIN(size, r->len - r->pos);
+    memcpy(out, r->buf + r->pos, n);
+    r->pos += n;
+    out += n;
+    size -= n;
+  }
+  return TRUE;
+}
+
+static gboolean _parse_bool(const char *value, gboolean *out)
+{
+  if(!strcmp(value, "1") || !strcasecmp(value, "true"))
+    *out = TRUE;
+  else if(!strcmp(value, "0") || !strcasecmp(value, "false"))
+    *out = FALSE;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+static void _set_string(gchar **field, const char *value)
+{
+  g_free(*field);
+  *field = g_strdup(value);
+}
+
+void dt_cli_request_cleanup(dt_cli_request_t *req)
+{
+  g_free(req->input);
+  g_free(req->xmp);
+  g_free(req->format);
+  g_free(req->style);
+  g_free(req->icc_filename);
+  memset(req, 0, sizeof(dt_cli_request_t));
+}
+
+int dt_cli_read_request(dt_cli_reader_t *r, dt_cli_request_t *req, const char **error)
+{
+  memset(req, 0, sizeof(dt_cli_request_t));
+  req->high_quality = TRUE;
+  req->icc_type = DT_COLORSPACE_NONE;
+  req->icc_intent = DT_INTENT_LAST;
+
+  char line[DT_CLI_SERVER_MAX_LINE];
+  int lines = 0;
+  *error = NULL;
+  for(;;)
+  {
+    const int len = _read_line(r, line, sizeof(line));
+    if(len == -2)
+    {
+      *error = "line too long";
+      return -1;
+    }
+    if(len < 0) return lines ? -1 : 1;
+    if(len == 0)
+    {
+      // allow empty lines between requests
+      if(lines == 0) continue;
+      break;
+    }
+    lines++;
+
+    char *value = strchr(line, ' ');
+    if(value) *value++ = '\0';
+    else value = line + len;
+
+    if(!strcmp(line, "input"))
+      _set_string(&req->input, value);
+    else if(!strcmp(line, "xmp"))
+      _set_string(&req->xmp, value);
+    else if(!strcmp(line, "xmp-size"))
+    {
+      const long long size = atoll(value);
+      if(size <= 0 || size > DT_CLI_SERVER_MAX_XMP) *error = "invalid xmp-size";
+      else req->xmp_size = size;
+    }
+    else if(!strcmp(line, "format"))
+      _set_string(&req->format, value);
+    else if(!strcmp(line, "width"))
+      req->width = MAX(atoi(value), 0);
+    else if(!strcmp(line, "height"))
+      req->height = MAX(atoi(value), 0);
+    else if(!strcmp(line, "hq"))
+    {
+      if(!_parse_bool(value, &req->high_quality)) *error = "invalid value for hq";
+    }
+    else if(!strcmp(line, "upscale"))
+    {
+      if(!_parse_bool(value, &req->upscale)) *error = "invalid value for upscale";
+    }
+    else if(!strcmp(line, "style"))
+      _set_string(&req->style, value);
+    else if(!strcmp(line, "style-overwrite"))
+    {
+      if(!_parse_bool(value, &req->style_overwrite)) *error = "invalid value for style-overwrite";
+    }
+    else if(!strcmp(line, "icc-type"))
+    {
+      gchar *str = g_ascii_strup(value, -1);
+      req->icc_type = dt_cli_get_icc_type(str);
+      g_free(str);
+      if(req->icc_type >= DT_COLORSPACE_LAST) *error = "unknown icc-type";
+    }
+    else if(!strcmp(line, "icc-file"))
+      _set_string(&req->icc_filename, value);
+    else if(!strcmp(line, "icc-intent"))
+    {
+      gchar *str = g_ascii_strup(value, -1);
+      req->icc_intent = dt_cli_get_icc_intent(str);
+      g_free(str);
+      if(req->icc_intent >= DT_INTENT_LAST) *error = "unknown icc-intent";
+    }
+    else if(!*error)
+      *error = "unknown key";
+  }
+
+  if(!*error && (!req->input || !*req->input)) *error = "no input given";
+  if(!*error && req->xmp && req->xmp_size) *error = "xmp and xmp-size are exclusive";
+  return *error ? -1 : 0;
+}
+
+#endif // _WIN32
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,77 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+
+#include <glib.h>
+#include <signal.h>
+#include <stddef.h>
+
+/** the icc types and intents as given on the command line or in a server request, *_LAST if unknown */
+dt_colorspaces_color_profile_type_t dt_cli_get_icc_type(const char *option);
+dt_iop_color_intent_t dt_cli_get_icc_intent(const char *option);
+
+#ifndef _WIN32
+
+#define DT_CLI_SERVER_MAX_LINE 4096
+#define DT_CLI_SERVER_MAX_XMP (16 << 20)
+// seconds a client may stall within a request
+#define DT_CLI_SERVER_READ_TIMEOUT 10.0
+
+/** buffered reading from a client connection of the server mode */
+typedef struct dt_cli_reader_t
+{
+  int fd;
+  size_t pos, len;
+  double idle_since;          // when the last request was done, for connections waiting in the main loop
+  char buf[DT_CLI_SERVER_MAX_LINE];
+} dt_cli_reader_t;
+
+typedef struct dt_cli_request_t
+{
+  gchar *input, *xmp, *format, *style, *icc_filename;
+  size_t xmp_size;
+  int width, height;
+  gboolean high_quality, upscale, style_overwrite;
+  dt_colorspaces_color_profile_type_t icc_type;
+  dt_iop_color_intent_t icc_intent;
+} dt_cli_request_t;
+
+/** set by the signal handler, readers stop waiting for their clients then */
+extern volatile sig_atomic_t dt_cli_server_quit;
+
+/** take what arrived on the connection without blocking. returns FALSE at the end of the stream, on errors
+ * and when the buffer is full. */
+gboolean dt_cli_reader_append(dt_cli_reader_t *r);
+/** whether a whole request header is buffered, so it can be read without waiting for the client */
+gboolean dt_cli_reader_has_header(const dt_cli_reader_t *r);
+/** read exactly size bytes, FALSE if the client doesn't send them in time */
+gboolean dt_cli_read_bytes(dt_cli_reader_t *r, char *out, size_t size);
+
+/** read the next request header. returns 0 on success, 1 if the client is done and -1 on protocol errors,
+ * with *error describing the problem. req has to be freed with dt_cli_request_cleanup() in any case. */
+int dt_cli_read_request(dt_cli_reader_t *r, dt_cli_request_t *req, const char **error);
+void dt_cli_request_cleanup(dt_cli_request_t *req);
+
+#endif // _WIN32
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -18,6 +18,7 @@
 
 #include "common/bilateral.h"
 #include "common/darktable.h" // for CLAMPS, dt_alloc_align, dt_free_align
+#include "common/scratch_pool.h" // for dt_scratch_alloc_float, dt_scratch_free
 #include <glib.h>             // for MIN, MAX
 #include <math.h>             // for roundf
 #include <stdlib.h>           // for size_t, free, malloc, NULL
@@ -28,6 +29,8 @@
 // mode (only 1mpix there).
 #define DT_COMMON_BILATERAL_MAX_RES_S 3000
 #define DT_COMMON_BILATERAL_MAX_RES_R 50
+// number of grid cells of a row handled together when merging the splatted slices and blurring along y
+#define DT_COMMON_BILATERAL_BLOCK 128
 
 void dt_bilateral_grid_size(dt_bilateral_t *b, const int width, const int height, const float L_range,
                             float sigma_s, const float sigma_r)
@@ -148,7 +151,9 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->numslices = darktable.num_openmp_threads;
   b->sliceheight = (height + b->numslices - 1) / b->numslices;
   b->slicerows = (b->size_y + b->numslices - 1) / b->numslices + 2;
-  b->buf = dt_calloc_align_float(b->size_x * b->size_z * b->numslices * b->slicerows);
+  const size_t grid_size = b->size_x * b->size_z * b->numslices * b->slicerows;
+  b->buf = dt_scratch_alloc_float(grid_size);
+  if (b->buf) memset(b->buf, 0, sizeof(float) * grid_size);
   if (!b->buf)
   {
     fprintf(stderr,"[bilateral] unable to allocate buffer for %lux%lux%lu grid\n",b->size_x,b->size_y,b->size_z);
@@ -232,129 +237,162 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     }
   }
 
-  // merge the per-thread results into the final result
-  for (int slice = 1 ; slice < nthreads; slice++)
+  // merge the per-thread results into the final result.  Every grid cell of a row is merged independently, so
+  // the threads split the rows into blocks of cells and each merges all slices for its block, in slice order.
+  const int nblocks = (oy + DT_COMMON_BILATERAL_BLOCK - 1) / DT_COMMON_BILATERAL_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, oy, nthreads, nblocks) \
+  shared(b) schedule(static)
+#endif
+  for(int block = 0; block < nblocks; block++)
   {
-    // compute the first row of the final grid which this slice splats
-    const int destrow = (int)(slice * b->sliceheight / b->sigma_s);
-    float *dest = buf + destrow * oy;
-    // now iterate over the grid rows splatted for this slice
-    for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
+    const int start = block * DT_COMMON_BILATERAL_BLOCK;
+    const int n = MIN(DT_COMMON_BILATERAL_BLOCK, oy - start);
+    for (int slice = 1 ; slice < nthreads; slice++)
     {
-      float *src = buf + j * oy;
-      for(int i = 0; i < oy; i++)
+      // compute the first row of the final grid which this slice splats
+      const int destrow = (int)(slice * b->sliceheight / b->sigma_s);
+      float *dest = buf + (size_t)destrow * oy + start;
+      // now iterate over the grid rows splatted for this slice
+      for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
       {
-        dest[i] += src[i];
+        float *src = buf + (size_t)j * oy + start;
+        for(int i = 0; i < n; i++)
+        {
+          dest[i] += src[i];
+        }
+        dest += oy;
+        // clear elements in the part of the buffer which holds the final result now that we've read the partial
+        // result, since we'll be adding to those locations later
+        if (j < b->size_y)
+          memset(src, '\0', sizeof(float) * n);
       }
-      dest += oy;
-      // clear elements in the part of the buffer which holds the final result now that we've read the partial result,
-      // since we'll be adding to those locations later
-      if (j < b->size_y)
-        memset(buf + j*oy, '\0', sizeof(float) * oy);
     }
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                        const int size2, const int size3)
+// -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x), along one contiguous line of the grid
+static inline void blur_line_z(float *const line, const int size)
 {
   const float w1 = 4.f / 16.f;
   const float w2 = 2.f / 16.f;
+  float tmp1 = line[0];
+  line[0] = w1 * line[1] + w2 * line[2];
+  float tmp2 = line[1];
+  line[1] = w1 * (line[2] - tmp1) + w2 * line[3];
+  for(int i = 2; i < size - 2; i++)
+  {
+    const float tmp3 = line[i];
+    line[i] = +w1 * (line[i + 1] - tmp2) + w2 * (line[i + 2] - tmp1);
+    tmp1 = tmp2;
+    tmp2 = tmp3;
+  }
+  const float tmp3 = line[size - 2];
+  line[size - 2] = w1 * (line[size - 1] - tmp2) - w2 * tmp1;
+  line[size - 1] = -w1 * tmp3 - w2 * tmp2;
+}
+
+// gaussian up to 3 sigma along x, followed by the derivative along z, for one row of the grid, i.e. all cells
+// with the same y.  The row is contiguous and small enough to stay in cache, and the blur along x vectorizes
+// over z.  The original values of the two previous columns are kept in tmp, which holds 4 * size_z floats.
+static void blur_row_xz(float *const row, const int size_x, const int size_z, float *const tmp)
+{
+  const float w0 = 6.f / 16.f;
+  const float w1 = 4.f / 16.f;
+  const float w2 = 1.f / 16.f;
+  float *prev2 = tmp;
+  float *prev1 = tmp + size_z;
+  float *cur = tmp + 2 * size_z;
+  float *const zeros = tmp + 3 * size_z;
+  memset(tmp, 0, sizeof(float) * 4 * size_z);
+  for(int x = 0; x < size_x; x++)
+  {
+    float *const col = row + (size_t)x * size_z;
+    const float *const next1 = x + 1 < size_x ? col + size_z : zeros;
+    const float *const next2 = x + 2 < size_x ? col + 2 * size_z : zeros;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w1, w2) \
-    shared(buf)
+#pragma omp simd
 #endif
-  for(int k = 0; k < size1; k++)
-  {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    for(int z = 0; z < size_z; z++)
     {
-      float tmp1 = buf[index];
-      buf[index] = w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = w1 * (buf[index + offset3] - tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
-      {
-        const float tmp3 = buf[index];
-        buf[index] = +w1 * (buf[index + offset3] - tmp2) + w2 * (buf[index + 2 * offset3] - tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
-      }
-      const float tmp3 = buf[index];
-      buf[index] = w1 * (buf[index + offset3] - tmp2) - w2 * tmp1;
-      index += offset3;
-      buf[index] = -w1 * tmp3 - w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+      cur[z] = col[z];
+      col[z] = col[z] * w0 + w1 * (next1[z] + prev1[z]) + w2 * (next2[z] + prev2[z]);
     }
+    // the column is final along x now, so we can blur it along z while it is in cache
+    blur_line_z(col, size_z);
+    float *const t = prev2;
+    prev2 = prev1;
+    prev1 = cur;
+    cur = t;
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                      const int size2, const int size3)
+// gaussian up to 3 sigma along y.  Rows are contiguous, so each thread walks down a block of columns, keeping the
+// original values of the two rows above.
+static void blur_y(float *const buf, const int size_y, const size_t row_size)
 {
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
   const float w2 = 1.f / 16.f;
+  const size_t nblocks = (row_size + DT_COMMON_BILATERAL_BLOCK - 1) / DT_COMMON_BILATERAL_BLOCK;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w0, w1, w2) \
-    shared(buf)
+  dt_omp_firstprivate(buf, size_y, row_size, nblocks, w0, w1, w2) \
+  schedule(static)
 #endif
-  for(int k = 0; k < size1; k++)
+  for(size_t block = 0; block < nblocks; block++)
   {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    const size_t start = block * DT_COMMON_BILATERAL_BLOCK;
+    const int n = MIN(DT_COMMON_BILATERAL_BLOCK, row_size - start);
+    float tmp[4][DT_COMMON_BILATERAL_BLOCK] = { { 0.0f } };
+    float *prev2 = tmp[0];
+    float *prev1 = tmp[1];
+    float *cur = tmp[2];
+    const float *const zeros = tmp[3];
+    for(int y = 0; y < size_y; y++)
     {
-      float tmp1 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
+      float *const line = buf + (size_t)y * row_size + start;
+      const float *const next1 = y + 1 < size_y ? line + row_size : zeros;
+      const float *const next2 = y + 2 < size_y ? line + 2 * row_size : zeros;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < n; i++)
       {
-        const float tmp3 = buf[index];
-        buf[index]
-            = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
+        cur[i] = line[i];
+        line[i] = line[i] * w0 + w1 * (next1[i] + prev1[i]) + w2 * (next2[i] + prev2[i]);
       }
-      const float tmp3 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
-      index += offset3;
-      buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+      float *const t = prev2;
+      prev2 = prev1;
+      prev1 = cur;
+      cur = t;
     }
   }
 }
 
-
 void dt_bilateral_blur(const dt_bilateral_t *b)
 {
   if (!b || !b->buf)
     return;
-  const int ox = b->size_z;
-  const int oy = b->size_x * b->size_z;
-  const int oz = 1;
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, oy, ox, b->size_z, b->size_y, b->size_x);
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, ox, oy, b->size_z, b->size_x, b->size_y);
-  // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
-  blur_line_z(b->buf, ox, oy, oz, b->size_x, b->size_y, b->size_z);
+  const int size_x = b->size_x;
+  const int size_z = b->size_z;
+  const size_t row_size = b->size_x * b->size_z;
+  float *const buf = b->buf;
+  // the three separable passes are reordered into two: x and z within each row, then y across rows, so that
+  // every pass walks the grid contiguously
+  size_t padded_size;
+  float *const restrict tmpbuf = dt_alloc_perthread_float(4 * size_z, &padded_size);
+  if(!tmpbuf) return;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, size_x, size_z, row_size, tmpbuf, padded_size) \
+  shared(b) schedule(static)
+#endif
+  for(int y = 0; y < b->size_y; y++)
+    blur_row_xz(buf + y * row_size, size_x, size_z, dt_get_perthread(tmpbuf, padded_size));
+  dt_free_align(tmpbuf);
+  blur_y(buf, b->size_y, row_size);
 }
 
 
@@ -451,12 +489,13 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 void dt_bilateral_free(dt_bilateral_t *b)
 {
   if(!b) return;
-  dt_free_align(b->buf);
+  dt_scratch_free(b->buf);
   free(b);
 }
 
 #undef DT_COMMON_BILATERAL_MAX_RES_S
 #undef DT_COMMON_BILATERAL_MAX_RES_R
+#undef DT_COMMON_BILATERAL_BLOCK
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -81,6 +81,9 @@
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 #include <locale.h>
 #include <limits.h>
@@ -892,6 +895,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   dt_confgen_init();
 
+  darktable.huge_pages = dt_conf_get_bool("memory_huge_pages");
+
   // we need this REALLY early so that error messages can be shown, however after gtk_disable_setlocale
   if(init_gui)
   {
@@ -1368,6 +1373,11 @@ void dt_gettime(char *datetime, size_t datetime_len)
   dt_gettime_t(datetime, datetime_len, time(NULL));
 }
 
+// size of a transparent huge page on x86_64 and most aarch64 kernels
+#define DT_HUGE_PAGE_SIZE ((size_t)2 << 20)
+// below this the unused tail of the last huge page isn't worth it
+#define DT_HUGE_PAGE_MIN_ALLOC ((size_t)16 << 20)
+
 void *dt_alloc_align(size_t alignment, size_t size)
 {
   const size_t aligned_size = dt_round_size(size, alignment);
@@ -1385,6 +1395,18 @@ void *dt_alloc_align(size_t alignment, size_t size)
   return ((char*)ptr) + alignment ;
 #else
   void *ptr = NULL;
+#ifdef MADV_HUGEPAGE
+  // full resolution buffers span so many 4 kB pages that strided (column) passes mostly miss the TLB. align
+  // them to whole huge pages and ask the kernel to back them by those. if it can't, we still have plain
+  // pages and the memory is released with free() as usual.
+  if(darktable.huge_pages && aligned_size >= DT_HUGE_PAGE_MIN_ALLOC)
+  {
+    const size_t huge_size = dt_round_size(aligned_size, DT_HUGE_PAGE_SIZE);
+    if(posix_memalign(&ptr, MAX(alignment, DT_HUGE_PAGE_SIZE), huge_size)) return NULL;
+    madvise(ptr, huge_size, MADV_HUGEPAGE);
+    return ptr;
+  }
+#endif
   if(posix_memalign(&ptr, alignment, aligned_size)) return NULL;
   return ptr;
 #endif
@@ -1757,6 +1779,22 @@ void dt_print_mem_usage()
                   "[memory] cur used memory   (vmrss ): %15s",
           vmpeak, vmsize, vmhwm, vmrss);
 
+  /* the part of it backed by transparent huge pages, needs linux 4.14 */
+  f = g_fopen("/proc/self/smaps_rollup", "r");
+  if(!f) return;
+
+  line = NULL;
+  while(getline(&line, &len, f) != -1)
+  {
+    if(!strncmp(line, "AnonHugePages:", 14))
+    {
+      fprintf(stderr, "[memory] huge pages in use (anonhp): %15s", g_strchug(line + 14));
+      break;
+    }
+  }
+  free(line);
+  fclose(f);
+
 #elif defined(__APPLE__)
   struct task_basic_info t_info;
   mach_msg_type_number_t t_info_count = TASK_BASIC_INFO_COUNT;
@@ -282,6 +282,8 @@ typedef struct darktable_t
 {
   dt_codepath_t codepath;
   int32_t num_openmp_threads;
+  // back large dt_alloc_align() buffers by transparent huge pages
+  gboolean huge_pages;
 
   int32_t unmuted;
   GList *iop;
@@ -238,17 +238,26 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   buffer[0] = img;
   /* temporary storage */
   buffer[1] = dt_alloc_align_float(size);
-  // buffer to reconstruct the image
-  layers = dt_alloc_align_float((size_t)4 * p->width * p->height);
   // scratch buffer for decomposition
   temp = dt_alloc_align_float(dt_get_num_threads() * 4 * p->width);
 
-  if(buffer[1] == NULL || layers == NULL || temp == NULL)
+  if(buffer[1] == NULL || temp == NULL)
   {
     printf("not enough memory for wavelet decomposition");
     goto cleanup;
   }
-  dt_iop_image_fill(layers,0.0f,p->width,p->height,p->ch);
+
+  // buffer to reconstruct the image, only needed if the user doesn't want to see a single scale
+  if(p->return_layer == 0)
+  {
+    layers = dt_alloc_align_float((size_t)4 * p->width * p->height);
+    if(layers == NULL)
+    {
+      printf("not enough memory for wavelet decomposition");
+      goto cleanup;
+    }
+    dt_iop_image_fill(layers,0.0f,p->width,p->height,p->ch);
+  }
 
   if(p->merge_from_scale > 0)
   {
@@ -382,65 +391,51 @@ void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func)
   dwt_wavelet_decompose(p->image, p, layer_func);
 }
 
-// first, "vertical" pass of wavelet decomposition
-static void dwt_denoise_vert_1ch(float *const restrict out, const float *const restrict in,
-                                 const size_t height, const size_t width, const size_t lev)
+// one scale of the wavelet decomposition for denoising; generates 'coarse' into the output buffer and adds the
+//   portion of 'details' exceeding the threshold to the accumulator
+static void dwt_denoise_layer_1ch(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, float *const restrict temp,
+                                  const size_t padded_size, const size_t height, const size_t width,
+                                  const size_t lev, const float thold, const int last)
 {
   const int vscale = MIN(1 << lev, height);
+  const int hscale = MIN(1 << lev, width);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, vscale) \
-  dt_omp_sharedconst(in, out) \
+  dt_omp_firstprivate(height, width, vscale, hscale, thold, last, padded_size) \
+  dt_omp_sharedconst(in, out, accum, temp) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height ; rowid++)
   {
     const int row = dwt_interleave_rows(rowid,height,vscale);
-    // perform a weighted sum of the current pixel row with the rows 'scale' pixels above and below
-    // if either of those is beyond the edge of the image, we use reflection to get a value for averaging,
-    // i.e. we move as many rows in from the edge as we would have been beyond the edge
+    // first, the "vertical" pass: perform a weighted sum of the current pixel row with the rows 'scale' pixels
+    // above and below. if either of those is beyond the edge of the image, we use reflection to get a value
+    // for averaging, i.e. we move as many rows in from the edge as we would have been beyond the edge.
     // for the top edge, this means we can simply use the absolute value of row-vscale; for the bottom edge,
-    //   we need to reflect around height
+    //   we need to reflect around height.
+    // the result only goes into a per-thread row buffer, which the horizontal pass below reads from cache
     const size_t rowstart = (size_t)row * width;
     const size_t below_row = (row + vscale < height) ? (row + vscale) : 2*(height-1) - (row + vscale);
     const float *const restrict center = in + rowstart;
     const float *const restrict above =  in + abs(row - vscale) * width;
     const float *const restrict below = in + below_row * width;
-    float* const restrict outrow = out + rowstart;
+    float *const restrict vert = dt_get_perthread(temp, padded_size);
 #ifdef _OPENMP
 #pragma omp simd
 #endif
     for (int col= 0; col < width; col++)
     {
-      outrow[col] = 2.f * center[col] + above[col] + below[col];
+      vert[col] = 2.f * center[col] + above[col] + below[col];
     }
-  }
-}
 
-// second, horizontal pass of wavelet decomposition; generates 'coarse' into the output buffer and overwrites
-//   the input buffer with 'details'
-static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restrict in,
-                                  float *const restrict accum, const size_t height, const size_t width,
-                                  const size_t lev, const float thold, const int last)
-{
-  const int hscale = MIN(1 << lev, width);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(height, width, hscale, thold, last) \
-  dt_omp_sharedconst(in, out, accum) \
-  schedule(static)
-#endif
-  for(int row = 0; row < height ; row++)
-  {
-    // perform a weighted sum of the current pixel with the ones 'scale' pixels to the left and right, using
-    // reflection to get a value if either of those positions is out of bounds, i.e. we move as many columns
-    // in from the edge as we would have been beyond the edge to avoid an additional pass, we also rescale the
-    // final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum from
-    // the original input.
-    const size_t rowindex = (size_t)row * width;
-    float *const restrict details = in + rowindex;
-    float *const restrict coarse = out + rowindex;
-    float *const restrict accum_row = accum + rowindex;
+    // second, the horizontal pass: perform a weighted sum of the current pixel with the ones 'scale' pixels
+    // to the left and right, using reflection to get a value if either of those positions is out of bounds,
+    // i.e. we move as many columns in from the edge as we would have been beyond the edge.  we also rescale
+    // the final sum and split the original input into 'coarse' and 'details' by subtracting the scaled sum
+    // from the original input.
+    float *const restrict coarse = out + rowstart;
+    float *const restrict accum_row = accum + rowstart;
     // handle reflection at left edge
 #ifdef _OPENMP
 #pragma omp simd
@@ -448,11 +443,11 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
     for (int col = 0; col < hscale; col++)
     {
       // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[hscale-col] + coarse[col+hscale]) / 16.f;
+      const float hat = (2.f * vert[col] + vert[hscale-col] + vert[col+hscale]) / 16.f;
       // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
       // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
       // alternatives produces exactly the same result, and *that* does get vectorized
       //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
@@ -464,11 +459,11 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
     for (int col = hscale; col < width - hscale; col++)
     {
       // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + coarse[col+hscale]) / 16.f;
+      const float hat = (2.f * vert[col] + vert[col-hscale] + vert[col+hscale]) / 16.f;
       // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
       // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       // GCC8 won't vectorize if we use the following line, but it turns out that just adding the two conditional
       // alternatives produces exactly the same result, and *that* does get vectorized
       //const float excess = diff < 0.0 ? MIN(diff + thold, 0.0f) : MAX(diff - thold, 0.0f);
@@ -480,13 +475,13 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
 #endif
     for (int col = width - hscale; col < width; col++)
     {
-      const float right = coarse[2*width - 2 - (col+hscale)];
+      const float right = vert[2*width - 2 - (col+hscale)];
       // add up left/center/right, and renormalize by dividing by the total weight of all numbers added together
-      const float hat = (2.f * coarse[col] + coarse[col-hscale] + right) / 16.f;
+      const float hat = (2.f * vert[col] + vert[col-hscale] + right) / 16.f;
       // the normalized value is our 'coarse' result; 'diff' is the difference between original input and 'coarse'
       // (which would ordinarily be stored as the details scale, but we don't need it any further)
-      const float diff = details[col] - hat;
-      details[col] = hat;		// done with original input, so we can overwrite it with 'coarse'
+      const float diff = center[col] - hat;
+      coarse[col] = hat;
       accum_row[col] += MAX(diff - thold,0.0f) + MIN(diff + thold, 0.0f);
     }
     if (last)
@@ -494,7 +489,7 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
       // add the details to the residue to create the final denoised result
       for (int col = 0; col < width; col++)
       {
-        details[col] += accum_row[col];
+        coarse[col] += accum_row[col];
       }
     }
   }
@@ -506,23 +501,39 @@ static void dwt_denoise_horiz_1ch(float *const restrict out, float *const restri
  */
 void dwt_denoise(float *const img, const int width, const int height, const int bands, const float *const noise)
 {
+  size_t padded_size;
   float *const details = dt_alloc_align_float((size_t)2 * width * height);
-  float *const interm = details + width * height;	// temporary storage for use during each pass
+  float *const temp = dt_alloc_perthread_float(width, &padded_size);
+  if(!details || !temp)
+  {
+    fprintf(stderr, "[dwt_denoise] out of memory, leaving the image as it is\n");
+    dt_free_align(temp);
+    dt_free_align(details);
+    return;
+  }
+  float *const interm = details + (size_t)width * height;	// temporary storage for use during each pass
 
   // zero the accumulator
   dt_iop_image_fill(details, 0.0f, width, height, 1);
 
+  // each scale reads its input from one buffer and writes the coarse result to the other one
+  float *buf1 = img;
+  float *buf2 = interm;
   for(int lev = 0; lev < bands; lev++)
   {
     const int last = (lev+1) == bands;
 
-    // "vertical" pass, averages pixels with those 'scale' rows above and below and puts result in 'interm'
-    dwt_denoise_vert_1ch(interm, img, height, width, lev);
-    // horizontal filtering pass, averages pixels in 'interm' with those 'scale' rows to the left and right
-    // accumulates the portion of the detail scale that is above the noise threshold into 'details'; this
-    // will be added to the residue left in 'img' on the last iteration
-    dwt_denoise_horiz_1ch(interm, img, details, height, width, lev, noise[lev], last);
+    // averages pixels with those 'scale' rows above and below and then with those 'scale' columns to the
+    // left and right, putting the result into 'buf2'; accumulates the portion of the detail scale that is
+    // above the noise threshold into 'details', which is added to the residue on the last iteration
+    dwt_denoise_layer_1ch(buf2, buf1, details, temp, padded_size, height, width, lev, noise[lev], last);
+    float *const buf3 = buf1;
+    buf1 = buf2;
+    buf2 = buf3;
   }
+  if(buf1 != img)
+    dt_iop_image_copy_by_size(img, buf1, width, height, 1);
+  dt_free_align(temp);
   dt_free_align(details);
 }
 
@@ -74,6 +74,7 @@ void dwt_decompose(dwt_params_t *p, _dwt_layer_func layer_func);
  * width, height: image dimensions
  * bands: number of wavelet scales to generate
  * noise: array of thresholds, on per band
+ * if the temporary buffers can't be allocated, img is left untouched
  */
 void dwt_denoise(float *const img, const int width, const int height, const int bands, const float *const noise);
 
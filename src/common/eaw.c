@@ -105,13 +105,18 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
   __m128 wgt = _mm_setzero_ps();
 #endif
 
+// when synthesizing, pdetail points into the accumulator, to which the thresholded and boosted detail is
+// added exactly as eaw_synthesize() would do it, instead of storing the detail itself
 #define SUM_PIXEL_EPILOGUE                                                                                   \
   for_each_channel(c)      										     \
   {													     \
     sum[c] /= wgt[c];                                                   				     \
     pcoarse[c] = sum[c];                                                                                     \
     const float det = (px[c] - sum[c]);									     \
-    pdetail[c] = det;    		                                              			     \
+    if(threshold)                                                                                            \
+      pdetail[c] += boost[c] * (MAX(det - threshold[c], 0.0f) + MIN(det + threshold[c], 0.0f));             \
+    else                                                                                                     \
+      pdetail[c] = det;    		                                              			     \
   }                                                                       				     \
   px += 4;                                                                                                   \
   pdetail += 4;                                                                                              \
@@ -121,15 +126,26 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
 #define SUM_PIXEL_EPILOGUE_SSE                                                                               \
   sum = sum / wgt;                                                                                           \
                                                                                                              \
-  _mm_stream_ps(pdetail, *px - sum);                                                                         \
+  if(threshold)                                                                                              \
+  {                                                                                                          \
+    const __m128 det = *px - sum;                                                                            \
+    const __m128 absamt = _mm_max_ps(_mm_setzero_ps(), _mm_andnot_ps(signmask, det) - thrs);                 \
+    const __m128 amount = _mm_or_ps(_mm_and_ps(det, signmask), absamt);                                      \
+    _mm_store_ps(pdetail, _mm_load_ps(pdetail) + bst * amount);                                              \
+  }                                                                                                          \
+  else                                                                                                       \
+    _mm_stream_ps(pdetail, *px - sum);                                                                       \
   _mm_stream_ps(pcoarse, sum);                                                                               \
   px++;                                                                                                      \
   pdetail += 4;                                                                                              \
   pcoarse += 4;
 #endif
 
-void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
-                   const int scale, const float sharpen, const int32_t width, const int32_t height)
+// threshold and boost are NULL for a plain decomposition, otherwise the detail scale is synthesized right away
+static inline void _eaw_decompose(float *const restrict out, const float *const restrict in,
+                                  float *const restrict detail, const int scale, const float sharpen,
+                                  const float *const restrict threshold, const float *const restrict boost,
+                                  const int32_t width, const int32_t height)
 {
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
@@ -137,7 +153,7 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(detail, filter, height, in, sharpen, mult, boundary, out, width) \
+  dt_omp_firstprivate(detail, filter, height, in, sharpen, mult, boundary, out, width, threshold, boost) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height; rowid++)
@@ -211,17 +227,37 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
   }
 }
 
+void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
+                   const int scale, const float sharpen, const int32_t width, const int32_t height)
+{
+  _eaw_decompose(out, in, detail, scale, sharpen, NULL, NULL, width, height);
+}
+
+void eaw_decompose_and_synthesize(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, const int scale, const float sharpen,
+                                  const float *const restrict threshold, const float *const restrict boost,
+                                  const int32_t width, const int32_t height)
+{
+  _eaw_decompose(out, in, accum, scale, sharpen, threshold, boost, width, height);
+}
+
 #if defined(__SSE2__)
-void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
-                        const int scale, const float sharpen, const int32_t width, const int32_t height)
+static inline void _eaw_decompose_sse2(float *const restrict out, const float *const restrict in,
+                                       float *const restrict detail, const int scale, const float sharpen,
+                                       const float *const restrict threshold, const float *const restrict boost,
+                                       const int32_t width, const int32_t height)
 {
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
   const int boundary = 2 * mult;
+  const __m128 thrs = threshold ? _mm_load_ps(threshold) : _mm_setzero_ps();
+  const __m128 bst = boost ? _mm_load_ps(boost) : _mm_setzero_ps();
+  const __m128 signmask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000u));
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(detail, filter, height, in, sharpen, mult, boundary, out, width) \
+  dt_omp_firstprivate(detail, filter, height, in, sharpen, mult, boundary, out, width, threshold, thrs, bst, \
+                      signmask) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height; rowid++)
@@ -295,6 +331,20 @@ void eaw_decompose_sse2(float *const restrict out, const float *const restrict i
   }
   _mm_sfence();
 }
+
+void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
+                        const int scale, const float sharpen, const int32_t width, const int32_t height)
+{
+  _eaw_decompose_sse2(out, in, detail, scale, sharpen, NULL, NULL, width, height);
+}
+
+void eaw_decompose_and_synthesize_sse2(float *const restrict out, const float *const restrict in,
+                                       float *const restrict accum, const int scale, const float sharpen,
+                                       const float *const restrict threshold, const float *const restrict boost,
+                                       const int32_t width, const int32_t height)
+{
+  _eaw_decompose_sse2(out, in, accum, scale, sharpen, threshold, boost, width, height);
+}
 #endif
 
 void eaw_synthesize(float *const out, const float *const in, const float *const restrict detail,
@@ -29,17 +29,33 @@ typedef void((*eaw_synthesize_t)(float *const out, const float *const in, const
                                  const float *const restrict thrsf, const float *const restrict boostf,
                                  const int32_t width, const int32_t height));
 
+// decompose one scale and immediately add its thresholded and boosted detail to accum, as eaw_synthesize()
+// would, so that the detail scale never has to be stored
+typedef void((*eaw_decompose_and_synthesize_t)(float *const restrict out, const float *const restrict in,
+                                               float *const restrict accum, const int scale, const float sharpen,
+                                               const float *const restrict threshold,
+                                               const float *const restrict boost, const int32_t width,
+                                               const int32_t height));
+
 void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                    const int scale, const float sharpen, const int32_t width, const int32_t height) ;
 void eaw_synthesize(float *const restrict out, const float *const restrict in, const float *const restrict detail,
                     const float *const restrict thrsf, const float *const restrict boostf,
                     const int32_t width, const int32_t height);
+void eaw_decompose_and_synthesize(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, const int scale, const float sharpen,
+                                  const float *const restrict threshold, const float *const restrict boost,
+                                  const int32_t width, const int32_t height);
 
 void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
                         const int scale, const float sharpen, const int32_t width, const int32_t height);
 void eaw_synthesize_sse2(float *const restrict out, const float *const restrict in, const float *const restrict detail,
                          const float *const restrict thrsf, const float *const restrict boostf,
                          const int32_t width, const int32_t height);
+void eaw_decompose_and_synthesize_sse2(float *const restrict out, const float *const restrict in,
+                                       float *const restrict accum, const int scale, const float sharpen,
+                                       const float *const restrict threshold, const float *const restrict boost,
+                                       const int32_t width, const int32_t height);
 
 typedef void((*eaw_dn_decompose_t)(float *const restrict out, const float *const restrict in, float *const restrict detail,
                                    dt_aligned_pixel_t sum_squared, const int scale, const float inv_sigma2,
@@ -1440,11 +1440,11 @@ int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size)
 /**
  * Get the largest possible thumbnail from the image
  */
-int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type)
+static int _exif_get_thumbnail(std::unique_ptr<Exiv2::Image> &image, const char *path, uint8_t **buffer,
+                               size_t *size, char **mime_type)
 {
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
 
@@ -1488,10 +1488,41 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
+int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type)
+{
+  try
+  {
+    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    return _exif_get_thumbnail(image, path, buffer, size, mime_type);
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2 dt_exif_get_thumbnail] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
+
+int dt_exif_get_thumbnail_from_data(const char *path, const uint8_t *data, const size_t data_size,
+                                    uint8_t **buffer, size_t *size, char **mime_type)
+{
+  try
+  {
+    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(data, data_size));
+    return _exif_get_thumbnail(image, path, buffer, size, mime_type);
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2 dt_exif_get_thumbnail] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
+
 /** read the metadata of an image.
  * XMP data trumps IPTC data trumps EXIF data
  */
-int dt_exif_read(dt_image_t *img, const char *path)
+static int _exif_read(dt_image_t *img, const char *path, const uint8_t *data, const size_t size)
 {
   // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
   // ...)
@@ -1506,7 +1537,12 @@ int dt_exif_read(dt_image_t *img, const char *path)
 
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    std::unique_ptr<Exiv2::Image> image;
+    if(data)
+      // exiv2 reads from the memory in place, it only copies it if the image is modified
+      image.reset(Exiv2::ImageFactory::open(data, size).release());
+    else
+      image.reset(Exiv2::ImageFactory::open(WIDEN(path)).release());
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
     bool res = true;
@@ -1559,6 +1595,16 @@ int dt_exif_read(dt_image_t *img, const char *path)
   }
 }
 
+int dt_exif_read(dt_image_t *img, const char *path)
+{
+  return _exif_read(img, path, NULL, 0);
+}
+
+int dt_exif_read_from_data(dt_image_t *img, const char *path, const uint8_t *data, const size_t size)
+{
+  return _exif_read(img, path, data, size);
+}
+
 int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int compressed)
 {
   try
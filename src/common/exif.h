@@ -64,6 +64,9 @@ const GList* dt_exif_get_exiv2_taglist();
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** same as dt_exif_read(), but parse the file from memory, e.g. when it has been read already */
+int dt_exif_read_from_data(dt_image_t *img, const char *path, const uint8_t *data, const size_t size);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -95,6 +98,8 @@ void dt_exif_apply_default_metadata(dt_image_t *img);
 
 /** fetch largest exif thumbnail jpg bytestream into buffer*/
 int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type);
+int dt_exif_get_thumbnail_from_data(const char *path, const uint8_t *data, const size_t data_size,
+                                    uint8_t **buffer, size_t *size, char **mime_type);
 
 /** thread safe init and cleanup. */
 void dt_exif_init();
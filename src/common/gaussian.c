@@ -25,6 +25,7 @@
 #include "common/gaussian.h"
 #include "common/math.h"
 #include "common/opencl.h"
+#include "common/scratch_pool.h"
 
 #define BLOCKSIZE (1 << 6)
 
@@ -139,13 +140,13 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
     g->min[k] = min[k];
   }
 
-  g->buf = dt_alloc_align_float((size_t)channels * width * height);
+  g->buf = dt_scratch_alloc_float((size_t)channels * width * height);
   if(!g->buf) goto error;
 
   return g;
 
 error:
-  dt_free_align(g->buf);
+  dt_scratch_free(g->buf);
   free(g->max);
   free(g->min);
   free(g);
@@ -153,70 +154,82 @@ error:
 }
 
 
-void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+typedef struct gauss_coeffs_t
 {
-
-  const int width = g->width;
-  const int height = g->height;
-  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
-
   float a0, a1, a2, a3, b1, b2, coefp, coefn;
+} gauss_coeffs_t;
 
-  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
+// the vertical pass walks down the image row by row and filters a block of neighbouring values side by side,
+// instead of running down the image once per column. the block size is a multiple of every possible channel
+// count so that each block starts with channel 0.
+#define GAUSS_VBLOCK 192
 
-  float *temp = g->buf;
+static void _blur_vertical(const float *const in, float *const temp, const int width, const int height,
+                           const int ch, const float *const Labmin, const float *const Labmax,
+                           const gauss_coeffs_t *const c)
+{
+  float DT_ALIGNED_ARRAY lo[GAUSS_VBLOCK];
+  float DT_ALIGNED_ARRAY hi[GAUSS_VBLOCK];
+  for(int k = 0; k < GAUSS_VBLOCK; k++)
+  {
+    lo[k] = Labmin[k % ch];
+    hi[k] = Labmax[k % ch];
+  }
 
-  float *Labmax = g->max;
-  float *Labmin = g->min;
+  const size_t stride = (size_t)width * ch;
+  const int nblocks = (stride + GAUSS_VBLOCK - 1) / GAUSS_VBLOCK;
+  const float a0 = c->a0, a1 = c->a1, a2 = c->a2, a3 = c->a3;
+  const float b1 = c->b1, b2 = c->b2, coefp = c->coefp, coefn = c->coefn;
 
-// vertical blur column by column
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, width, height, ch) \
-  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(in, temp, height, stride, nblocks, lo, hi, a0, a1, a2, a3, b1, b2, coefp, coefn) \
   schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int b = 0; b < nblocks; b++)
   {
-    dt_aligned_pixel_t xp = {0.0f};
-    dt_aligned_pixel_t yb = {0.0f};
-    dt_aligned_pixel_t yp = {0.0f};
+    const size_t start = (size_t)b * GAUSS_VBLOCK;
+    const int n = MIN(GAUSS_VBLOCK, stride - start);
+    float DT_ALIGNED_ARRAY xp[GAUSS_VBLOCK];
+    float DT_ALIGNED_ARRAY yp[GAUSS_VBLOCK];
+    float DT_ALIGNED_ARRAY yb[GAUSS_VBLOCK];
 
     // forward filter
-    for(int k = 0; k < ch; k++)
+    for(int k = 0; k < n; k++)
     {
-      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
+      xp[k] = CLAMPF(in[start + k], lo[k], hi[k]);
       yb[k] = xp[k] * coefp;
       yp[k] = yb[k];
     }
 
-    dt_aligned_pixel_t xc = {0.0f};
-    dt_aligned_pixel_t yc = {0.0f};
-    dt_aligned_pixel_t xn = {0.0f};
-    dt_aligned_pixel_t xa = {0.0f};
-    dt_aligned_pixel_t yn = {0.0f};
-    dt_aligned_pixel_t ya = {0.0f};
     for(int j = 0; j < height; j++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
+      const float *const inrow = in + j * stride + start;
+      float *const trow = temp + j * stride + start;
+#ifdef _OPENMP
+#pragma omp simd aligned(xp, yp, yb, lo, hi : 64)
+#endif
+      for(int k = 0; k < n; k++)
       {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+        const float xc = CLAMPF(inrow[k], lo[k], hi[k]);
+        const float yc = (a0 * xc) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
 
-        temp[offset + k] = yc[k];
+        trow[k] = yc;
 
-        xp[k] = xc[k];
+        xp[k] = xc;
         yb[k] = yp[k];
-        yp[k] = yc[k];
+        yp[k] = yc;
       }
     }
 
     // backward filter
-    for(int k = 0; k < ch; k++)
+    float DT_ALIGNED_ARRAY xn[GAUSS_VBLOCK];
+    float DT_ALIGNED_ARRAY xa[GAUSS_VBLOCK];
+    float DT_ALIGNED_ARRAY yn[GAUSS_VBLOCK];
+    float DT_ALIGNED_ARRAY ya[GAUSS_VBLOCK];
+    for(int k = 0; k < n; k++)
     {
-      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
+      xn[k] = CLAMPF(in[(height - 1) * stride + start + k], lo[k], hi[k]);
       xa[k] = xn[k];
       yn[k] = xn[k] * coefn;
       ya[k] = yn[k];
@@ -224,32 +237,42 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
 
     for(int j = height - 1; j > -1; j--)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
+      const float *const inrow = in + j * stride + start;
+      float *const trow = temp + j * stride + start;
+#ifdef _OPENMP
+#pragma omp simd aligned(xn, xa, yn, ya, lo, hi : 64)
+#endif
+      for(int k = 0; k < n; k++)
       {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+        const float xc = CLAMPF(inrow[k], lo[k], hi[k]);
+        const float yc = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
 
         xa[k] = xn[k];
-        xn[k] = xc[k];
+        xn[k] = xc;
         ya[k] = yn[k];
-        yn[k] = yc[k];
+        yn[k] = yc;
 
-        temp[offset + k] += yc[k];
+        trow[k] += yc;
       }
     }
   }
+}
+
+// horizontal blur line by line, of the lines first_row to height - 1
+static void _blur_horizontal(const float *const temp, float *const out, const int width, const int height,
+                             const int first_row, const int ch, const float *const Labmin,
+                             const float *const Labmax, const gauss_coeffs_t *const c)
+{
+  const float a0 = c->a0, a1 = c->a1, a2 = c->a2, a3 = c->a3;
+  const float b1 = c->b1, b2 = c->b2, coefp = c->coefp, coefn = c->coefn;
 
-// horizontal blur line by line
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(out, ch, width, height) \
-  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(temp, out, ch, width, height, first_row, Labmin, Labmax) \
+  dt_omp_firstprivate(a0, a1, a2, a3, b1, b2, coefp, coefn) \
   schedule(static)
 #endif
-  for(int j = 0; j < height; j++)
+  for(int j = first_row; j < height; j++)
   {
     dt_aligned_pixel_t xp = {0.0f};
     dt_aligned_pixel_t yb = {0.0f};
@@ -317,169 +340,255 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
   }
 }
 
-
-
 #if defined(__SSE__)
-static void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, float *const out)
+// one step of the recursive filter, in the same order of operations as the plain code
+static inline __m128 _deriche_sse(const __m128 x0, const __m128 x1, const __m128 y1, const __m128 y2,
+                                  const __m128 c0, const __m128 c1, const __m128 b1, const __m128 b2)
 {
+  return _mm_sub_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(c0, x0), _mm_mul_ps(c1, x1)), _mm_mul_ps(b1, y1)),
+                    _mm_mul_ps(b2, y2));
+}
 
-  const int width = g->width;
-  const int height = g->height;
-  const int ch = 4;
-
-  assert(g->channels == 4);
-
-  float a0, a1, a2, a3, b1, b2, coefp, coefn;
-
-  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
-
-  const __m128 Labmax = _mm_set_ps(g->max[3], g->max[2], g->max[1], g->max[0]);
-  const __m128 Labmin = _mm_set_ps(g->min[3], g->min[2], g->min[1], g->min[0]);
-
-  float *temp = g->buf;
-
+// horizontal blur of a single channel image, four lines at a time with one line per lane. the lines are read
+// and written four pixels at a time and transposed in registers. returns the number of lines done.
+static int _blur_horizontal_1c_sse(const float *const temp, float *const out, const int width, const int height,
+                                   const float Labmin, const float Labmax, const gauss_coeffs_t *const c)
+{
+  const int quads = height / 4;
+  const int wquads = width & ~3;
+  const __m128 lo = _mm_set1_ps(Labmin);
+  const __m128 hi = _mm_set1_ps(Labmax);
+  const __m128 a0 = _mm_set1_ps(c->a0), a1 = _mm_set1_ps(c->a1), a2 = _mm_set1_ps(c->a2),
+               a3 = _mm_set1_ps(c->a3), b1 = _mm_set1_ps(c->b1), b2 = _mm_set1_ps(c->b2),
+               coefp = _mm_set1_ps(c->coefp), coefn = _mm_set1_ps(c->coefn);
 
-// vertical blur column by column
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, Labmin, Labmax, width, height, ch) \
-  shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(temp, out, width, quads, wquads, lo, hi, a0, a1, a2, a3, b1, b2, coefp, coefn) \
   schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int q = 0; q < quads; q++)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
+    const float *const r0 = temp + (size_t)4 * q * width;
+    const float *const r1 = r0 + width;
+    const float *const r2 = r1 + width;
+    const float *const r3 = r2 + width;
+    float *const o0 = out + (size_t)4 * q * width;
+    float *const o1 = o0 + width;
+    float *const o2 = o1 + width;
+    float *const o3 = o2 + width;
 
     // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(in + i * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
+    __m128 xp = MMCLAMPPS(_mm_set_ps(r3[0], r2[0], r1[0], r0[0]), lo, hi);
+    __m128 yb = _mm_mul_ps(coefp, xp);
+    __m128 yp = yb;
 
-    for(int j = 0; j < height; j++)
+    for(int i = 0; i < wquads; i += 4)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
-
-      _mm_store_ps(temp + offset, yc);
-
+      __m128 x0 = _mm_loadu_ps(r0 + i);
+      __m128 x1 = _mm_loadu_ps(r1 + i);
+      __m128 x2 = _mm_loadu_ps(r2 + i);
+      __m128 x3 = _mm_loadu_ps(r3 + i);
+      _MM_TRANSPOSE4_PS(x0, x1, x2, x3);
+      x0 = MMCLAMPPS(x0, lo, hi);
+      x1 = MMCLAMPPS(x1, lo, hi);
+      x2 = MMCLAMPPS(x2, lo, hi);
+      x3 = MMCLAMPPS(x3, lo, hi);
+
+      __m128 y0 = _deriche_sse(x0, xp, yp, yb, a0, a1, b1, b2);
+      __m128 y1 = _deriche_sse(x1, x0, y0, yp, a0, a1, b1, b2);
+      __m128 y2 = _deriche_sse(x2, x1, y1, y0, a0, a1, b1, b2);
+      __m128 y3 = _deriche_sse(x3, x2, y2, y1, a0, a1, b1, b2);
+      xp = x3;
+      yb = y2;
+      yp = y3;
+
+      _MM_TRANSPOSE4_PS(y0, y1, y2, y3);
+      _mm_storeu_ps(o0 + i, y0);
+      _mm_storeu_ps(o1 + i, y1);
+      _mm_storeu_ps(o2 + i, y2);
+      _mm_storeu_ps(o3 + i, y3);
+    }
+    for(int i = wquads; i < width; i++)
+    {
+      const __m128 xc = MMCLAMPPS(_mm_set_ps(r3[i], r2[i], r1[i], r0[i]), lo, hi);
+      const __m128 yc = _deriche_sse(xc, xp, yp, yb, a0, a1, b1, b2);
       xp = xc;
       yb = yp;
       yp = yc;
+
+      dt_aligned_pixel_t y;
+      _mm_store_ps(y, yc);
+      o0[i] = y[0];
+      o1[i] = y[1];
+      o2[i] = y[2];
+      o3[i] = y[3];
     }
 
     // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(in + ((size_t)(height - 1) * width + i) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
+    __m128 xn = MMCLAMPPS(_mm_set_ps(r3[width - 1], r2[width - 1], r1[width - 1], r0[width - 1]), lo, hi);
+    __m128 xa = xn;
+    __m128 yn = _mm_mul_ps(coefn, xn);
+    __m128 ya = yn;
 
-    for(int j = height - 1; j > -1; j--)
+    for(int i = width - 1; i >= wquads; i--)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
-
-
+      const __m128 xc = MMCLAMPPS(_mm_set_ps(r3[i], r2[i], r1[i], r0[i]), lo, hi);
+      const __m128 yc = _deriche_sse(xn, xa, yn, ya, a2, a3, b1, b2);
       xa = xn;
       xn = xc;
       ya = yn;
       yn = yc;
 
-      _mm_store_ps(temp + offset, _mm_add_ps(_mm_load_ps(temp + offset), yc));
+      dt_aligned_pixel_t y;
+      _mm_store_ps(y, yc);
+      o0[i] += y[0];
+      o1[i] += y[1];
+      o2[i] += y[2];
+      o3[i] += y[3];
+    }
+    for(int i = wquads - 4; i >= 0; i -= 4)
+    {
+      __m128 x0 = _mm_loadu_ps(r0 + i);
+      __m128 x1 = _mm_loadu_ps(r1 + i);
+      __m128 x2 = _mm_loadu_ps(r2 + i);
+      __m128 x3 = _mm_loadu_ps(r3 + i);
+      _MM_TRANSPOSE4_PS(x0, x1, x2, x3);
+      x0 = MMCLAMPPS(x0, lo, hi);
+      x1 = MMCLAMPPS(x1, lo, hi);
+      x2 = MMCLAMPPS(x2, lo, hi);
+      x3 = MMCLAMPPS(x3, lo, hi);
+
+      __m128 y3 = _deriche_sse(xn, xa, yn, ya, a2, a3, b1, b2);
+      __m128 y2 = _deriche_sse(x3, xn, y3, yn, a2, a3, b1, b2);
+      __m128 y1 = _deriche_sse(x2, x3, y2, y3, a2, a3, b1, b2);
+      __m128 y0 = _deriche_sse(x1, x2, y1, y2, a2, a3, b1, b2);
+      xa = x1;
+      xn = x0;
+      ya = y1;
+      yn = y0;
+
+      _MM_TRANSPOSE4_PS(y0, y1, y2, y3);
+      _mm_storeu_ps(o0 + i, _mm_add_ps(_mm_loadu_ps(o0 + i), y0));
+      _mm_storeu_ps(o1 + i, _mm_add_ps(_mm_loadu_ps(o1 + i), y1));
+      _mm_storeu_ps(o2 + i, _mm_add_ps(_mm_loadu_ps(o2 + i), y2));
+      _mm_storeu_ps(o3 + i, _mm_add_ps(_mm_loadu_ps(o3 + i), y3));
     }
   }
 
-// horizontal blur line by line
+  return 4 * quads;
+}
+
+// horizontal blur of a four channel image, four lines at a time to keep four independent recursions in
+// flight. returns the number of lines done.
+static int _blur_horizontal_4c_sse(const float *const temp, float *const out, const int width, const int height,
+                                   const __m128 lo, const __m128 hi, const gauss_coeffs_t *const c)
+{
+  const int quads = height / 4;
+  const size_t stride = (size_t)4 * width;
+  const __m128 a0 = _mm_set1_ps(c->a0), a1 = _mm_set1_ps(c->a1), a2 = _mm_set1_ps(c->a2),
+               a3 = _mm_set1_ps(c->a3), b1 = _mm_set1_ps(c->b1), b2 = _mm_set1_ps(c->b2),
+               coefp = _mm_set1_ps(c->coefp), coefn = _mm_set1_ps(c->coefn);
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(out, Labmin, Labmax, width, height, ch) \
-  shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(temp, out, width, stride, quads, lo, hi, a0, a1, a2, a3, b1, b2, coefp, coefn) \
   schedule(static)
 #endif
-  for(size_t j = 0; j < height; j++)
+  for(int q = 0; q < quads; q++)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
+    const float *const rows = temp + 4 * q * stride;
+    float *const orows = out + 4 * q * stride;
 
     // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(temp + j * width * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
+    __m128 xp[4], yp[4], yb[4];
+    for(int r = 0; r < 4; r++)
+    {
+      xp[r] = MMCLAMPPS(_mm_load_ps(rows + r * stride), lo, hi);
+      yb[r] = _mm_mul_ps(coefp, xp[r]);
+      yp[r] = yb[r];
+    }
 
     for(int i = 0; i < width; i++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
+      for(int r = 0; r < 4; r++)
+      {
+        const size_t offset = r * stride + 4 * i;
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(rows + offset), lo, hi);
+        const __m128 yc = _deriche_sse(xc, xp[r], yp[r], yb[r], a0, a1, b1, b2);
+        _mm_store_ps(orows + offset, yc);
+        xp[r] = xc;
+        yb[r] = yp[r];
+        yp[r] = yc;
+      }
+    }
 
-      xc = MMCLAMPPS(_mm_load_ps(temp + offset), Labmin, Labmax);
+    // backward filter
+    __m128 xn[4], xa[4], yn[4], ya[4];
+    for(int r = 0; r < 4; r++)
+    {
+      xn[r] = MMCLAMPPS(_mm_load_ps(rows + r * stride + 4 * (width - 1)), lo, hi);
+      xa[r] = xn[r];
+      yn[r] = _mm_mul_ps(coefn, xn[r]);
+      ya[r] = yn[r];
+    }
 
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
+    for(int i = width - 1; i > -1; i--)
+    {
+      for(int r = 0; r < 4; r++)
+      {
+        const size_t offset = r * stride + 4 * i;
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(rows + offset), lo, hi);
+        const __m128 yc = _deriche_sse(xn[r], xa[r], yn[r], ya[r], a2, a3, b1, b2);
+        xa[r] = xn[r];
+        xn[r] = xc;
+        ya[r] = yn[r];
+        yn[r] = yc;
+        _mm_store_ps(orows + offset, _mm_add_ps(_mm_load_ps(orows + offset), yc));
+      }
+    }
+  }
 
-      _mm_store_ps(out + offset, yc);
+  return 4 * quads;
+}
+#endif
 
-      xp = xc;
-      yb = yp;
-      yp = yc;
-    }
+void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+{
+  const int width = g->width;
+  const int height = g->height;
+  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
 
-    // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(temp + ((size_t)(j + 1) * width - 1) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
+  gauss_coeffs_t c;
+  compute_gauss_params(g->sigma, g->order, &c.a0, &c.a1, &c.a2, &c.a3, &c.b1, &c.b2, &c.coefp, &c.coefn);
 
+  _blur_vertical(in, g->buf, width, height, ch, g->min, g->max, &c);
 
-    for(int i = width - 1; i > -1; i--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
+  int done = 0;
+#if defined(__SSE__)
+  if(ch == 1 && darktable.codepath.SSE2 && !darktable.codepath.OPENMP_SIMD)
+    done = _blur_horizontal_1c_sse(g->buf, out, width, height, g->min[0], g->max[0], &c);
+#endif
+  _blur_horizontal(g->buf, out, width, height, done, ch, g->min, g->max, &c);
+}
 
-      xc = MMCLAMPPS(_mm_load_ps(temp + offset), Labmin, Labmax);
+#if defined(__SSE__)
+static void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, float *const out)
+{
+  const int width = g->width;
+  const int height = g->height;
 
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
+  assert(g->channels == 4);
 
+  gauss_coeffs_t c;
+  compute_gauss_params(g->sigma, g->order, &c.a0, &c.a1, &c.a2, &c.a3, &c.b1, &c.b2, &c.coefp, &c.coefn);
 
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
+  const __m128 Labmax = _mm_set_ps(g->max[3], g->max[2], g->max[1], g->max[0]);
+  const __m128 Labmin = _mm_set_ps(g->min[3], g->min[2], g->min[1], g->min[0]);
 
-      _mm_store_ps(out + offset, _mm_add_ps(_mm_load_ps(out + offset), yc));
-    }
-  }
+  _blur_vertical(in, g->buf, width, height, 4, g->min, g->max, &c);
+  const int done = _blur_horizontal_4c_sse(g->buf, out, width, height, Labmin, Labmax, &c);
+  _blur_horizontal(g->buf, out, width, height, done, 4, g->min, g->max, &c);
 }
 #endif
 
@@ -497,7 +606,7 @@ void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const o
 void dt_gaussian_free(dt_gaussian_t *g)
 {
   if(!g) return;
-  dt_free_align(g->buf);
+  dt_scratch_free(g->buf);
   free(g->min);
   free(g->max);
   free(g);
@@ -753,6 +862,9 @@ void dt_gaussian_free_cl_global(dt_gaussian_cl_global_t *g)
 }
 
 #endif
+
+#undef GAUSS_VBLOCK
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -90,22 +90,6 @@ static inline float *get_color_pixel(color_image img, size_t i)
 }
 
 
-// apply guided filter to single-component image img using the 3-components image imgg as a guide
-// the filtering applies a monochrome box filter to a total of 13 image channels:
-//    1 monochrome input image
-//    3 color guide image
-//    3 covariance (R, G, B)
-//    6 variance (R-R, R-G, R-B, G-G, G-B, B-B)
-// for computational efficiency, we'll pack them into a four-channel image and a 9-channel image
-// image instead of running 13 separate box filters: guide+input, R/G/B/R-R/R-G/R-B/G-G/G-B/B-B.
-static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
-                                 const float eps, const float guide_weight, const float min, const float max)
-{
-  const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
-                        max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
-  const int width = source.right - source.left;
-  const int height = source.upper - source.lower;
-  size_t size = (size_t)width * (size_t)height;
 // since we're packing multiple monochrome planes into a color image, define symbolic constants so that
 // we can keep track of which values we're actually using
 #define INP_MEAN 0
@@ -121,55 +105,16 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
 #define VAR_GG 6
 #define VAR_BB 8
 #define VAR_GB 7
-  color_image mean = new_color_image(width, height, 4);
-  color_image variance = new_color_image(width, height, 9);
-  const size_t img_dimen = mean.width;
-  size_t img_bak_sz;
-  float *img_bak = dt_alloc_perthread_float(9*img_dimen, &img_bak_sz);
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(img, imgg, mean, variance, img_bak) \
-  dt_omp_firstprivate(img_bak_sz, img_dimen, w, guide_weight) dt_omp_sharedconst(source)
-#endif
-  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
-  {
-    int j = j_imgg - source.lower;
-    float *const restrict meanpx = mean.data + 4 * j * mean.width;
-    float *const restrict varpx = variance.data + 9 * j * variance.width;
-    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++)
-    {
-      size_t i = i_imgg - source.left;
-      const float *pixel_ = get_color_pixel(imgg, i_imgg + (size_t)j_imgg * imgg.width);
-      dt_aligned_pixel_t pixel =
-        { pixel_[0] * guide_weight, pixel_[1] * guide_weight, pixel_[2] * guide_weight, pixel_[3] * guide_weight };
-      const float input = img.data[i_imgg + (size_t)j_imgg * img.width];
-      meanpx[4*i+INP_MEAN] = input;
-      meanpx[4*i+GUIDE_MEAN_R] = pixel[0];
-      meanpx[4*i+GUIDE_MEAN_G] = pixel[1];
-      meanpx[4*i+GUIDE_MEAN_B] = pixel[2];
-      varpx[9*i+COV_R] = pixel[0] * input;
-      varpx[9*i+COV_G] = pixel[1] * input;
-      varpx[9*i+COV_B] = pixel[2] * input;
-      varpx[9*i+VAR_RR] = pixel[0] * pixel[0];
-      varpx[9*i+VAR_RG] = pixel[0] * pixel[1];
-      varpx[9*i+VAR_RB] = pixel[0] * pixel[2];
-      varpx[9*i+VAR_GG] = pixel[1] * pixel[1];
-      varpx[9*i+VAR_GB] = pixel[1] * pixel[2];
-      varpx[9*i+VAR_BB] = pixel[2] * pixel[2];
-    }
-    // apply horizontal pass of box mean filter while the cache is still hot
-    float *const restrict scratch = dt_get_perthread(img_bak, img_bak_sz);
-    dt_box_mean_horizontal(meanpx, mean.width, 4|BOXFILTER_KAHAN_SUM, w, scratch);
-    dt_box_mean_horizontal(varpx, variance.width, 9|BOXFILTER_KAHAN_SUM, w, scratch);
-  }
-  dt_free_align(img_bak);
-  dt_box_mean_vertical(mean.data, mean.height, mean.width, 4|BOXFILTER_KAHAN_SUM, w);
-  dt_box_mean_vertical(variance.data, variance.height, variance.width, 9|BOXFILTER_KAHAN_SUM, w);
-  // we will recycle memory of 'mean' for the new coefficient arrays a_? and b to reduce memory foot print
+#define A_RED 0
+#define A_GREEN 1
+#define A_BLUE 2
+#define B 3
+
+// solve the linear model of the guided filter for every pixel, given the box means of input and guide in
+// 'mean' and of their products in 'variance'. the coefficients a_r, a_g, a_b and b overwrite 'mean'.
+static void guided_filter_coefficients(color_image mean, color_image variance, const size_t size, const float eps)
+{
   color_image a_b = mean;
-  #define A_RED 0
-  #define A_GREEN 1
-  #define A_BLUE 2
-  #define B 3
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
   dt_omp_firstprivate(size, eps) shared(mean, variance, a_b)
@@ -227,6 +172,70 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
     a_b.data[4*i+A_BLUE] = a_b_;
     a_b.data[4*i+B] = b_;
   }
+}
+
+// apply guided filter to single-component image img using the 3-components image imgg as a guide
+// the filtering applies a monochrome box filter to a total of 13 image channels:
+//    1 monochrome input image
+//    3 color guide image
+//    3 covariance (R, G, B)
+//    6 variance (R-R, R-G, R-B, G-G, G-B, B-B)
+// for computational efficiency, we'll pack them into a four-channel image and a 9-channel image
+// image instead of running 13 separate box filters: guide+input, R/G/B/R-R/R-G/R-B/G-G/G-B/B-B.
+static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
+                                 const float eps, const float guide_weight, const float min, const float max)
+{
+  const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
+                        max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
+  const int width = source.right - source.left;
+  const int height = source.upper - source.lower;
+  size_t size = (size_t)width * (size_t)height;
+  color_image mean = new_color_image(width, height, 4);
+  color_image variance = new_color_image(width, height, 9);
+  const size_t img_dimen = mean.width;
+  size_t img_bak_sz;
+  float *img_bak = dt_alloc_perthread_float(9*img_dimen, &img_bak_sz);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(img, imgg, mean, variance, img_bak) \
+  dt_omp_firstprivate(img_bak_sz, img_dimen, w, guide_weight) dt_omp_sharedconst(source)
+#endif
+  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
+  {
+    int j = j_imgg - source.lower;
+    float *const restrict meanpx = mean.data + 4 * j * mean.width;
+    float *const restrict varpx = variance.data + 9 * j * variance.width;
+    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++)
+    {
+      size_t i = i_imgg - source.left;
+      const float *pixel_ = get_color_pixel(imgg, i_imgg + (size_t)j_imgg * imgg.width);
+      dt_aligned_pixel_t pixel =
+        { pixel_[0] * guide_weight, pixel_[1] * guide_weight, pixel_[2] * guide_weight, pixel_[3] * guide_weight };
+      const float input = img.data[i_imgg + (size_t)j_imgg * img.width];
+      meanpx[4*i+INP_MEAN] = input;
+      meanpx[4*i+GUIDE_MEAN_R] = pixel[0];
+      meanpx[4*i+GUIDE_MEAN_G] = pixel[1];
+      meanpx[4*i+GUIDE_MEAN_B] = pixel[2];
+      varpx[9*i+COV_R] = pixel[0] * input;
+      varpx[9*i+COV_G] = pixel[1] * input;
+      varpx[9*i+COV_B] = pixel[2] * input;
+      varpx[9*i+VAR_RR] = pixel[0] * pixel[0];
+      varpx[9*i+VAR_RG] = pixel[0] * pixel[1];
+      varpx[9*i+VAR_RB] = pixel[0] * pixel[2];
+      varpx[9*i+VAR_GG] = pixel[1] * pixel[1];
+      varpx[9*i+VAR_GB] = pixel[1] * pixel[2];
+      varpx[9*i+VAR_BB] = pixel[2] * pixel[2];
+    }
+    // apply horizontal pass of box mean filter while the cache is still hot
+    float *const restrict scratch = dt_get_perthread(img_bak, img_bak_sz);
+    dt_box_mean_horizontal(meanpx, mean.width, 4|BOXFILTER_KAHAN_SUM, w, scratch);
+    dt_box_mean_horizontal(varpx, variance.width, 9|BOXFILTER_KAHAN_SUM, w, scratch);
+  }
+  dt_free_align(img_bak);
+  dt_box_mean_vertical(mean.data, mean.height, mean.width, 4|BOXFILTER_KAHAN_SUM, w);
+  dt_box_mean_vertical(variance.data, variance.height, variance.width, 9|BOXFILTER_KAHAN_SUM, w);
+  // we will recycle memory of 'mean' for the new coefficient arrays a_? and b to reduce memory foot print
+  color_image a_b = mean;
+  guided_filter_coefficients(mean, variance, size, eps);
   free_color_image(&variance);
 
   dt_box_mean(a_b.data, a_b.height, a_b.width, a_b.stride|BOXFILTER_KAHAN_SUM, w, 1);
@@ -332,6 +341,149 @@ void guided_filter(const float *const guide, const float *const in, float *const
   }
 }
 
+// fast guided filter after He and Sun, "Fast Guided Filter", https://arxiv.org/abs/1505.00996
+// the box means of guide, input and their products are taken on images subsampled by 'subsample' in
+// both directions, with the window shrunk accordingly. only the coefficients of the linear model are
+// interpolated back to full resolution, where they are applied to the full resolution guide, so edges of
+// the guide are preserved. as all work except the final pass is done on subsample^2 times fewer pixels,
+// there is no need to split the image into overlapping tiles.
+void fast_guided_filter(const float *const guide, const float *const in, float *const out, const int width,
+                        const int height, const int ch, const int w, const float sqrt_eps,
+                        const float guide_weight, const float min, const float max, const int subsample)
+{
+  // the window must keep a radius of at least one pixel after subsampling
+  if(subsample <= 1 || w < subsample)
+  {
+    guided_filter(guide, in, out, width, height, ch, w, sqrt_eps, guide_weight, min, max);
+    return;
+  }
+
+  assert(ch >= 3);
+
+  const int s = subsample;
+  const int ds_width = (width + s - 1) / s;
+  const int ds_height = (height + s - 1) / s;
+  // match the width 2w+1 of the window as closely as possible with the subsampled window
+  const int ds_w = max_i(1, (2 * w + 1) / (2 * s));
+  const size_t ds_size = (size_t)ds_width * ds_height;
+  const float eps = sqrt_eps * sqrt_eps;
+
+  color_image mean = new_color_image(ds_width, ds_height, 4);
+  color_image variance = new_color_image(ds_width, ds_height, 9);
+  size_t img_bak_sz;
+  float *img_bak = dt_alloc_perthread_float(9 * ds_width, &img_bak_sz);
+  if(!mean.data || !variance.data || !img_bak)
+  {
+    free_color_image(&mean);
+    free_color_image(&variance);
+    dt_free_align(img_bak);
+    guided_filter(guide, in, out, width, height, ch, w, sqrt_eps, guide_weight, min, max);
+    return;
+  }
+
+  // subsample input and guide by averaging blocks of s x s pixels (fewer at the right and bottom edges), form
+  // the products at the reduced resolution and apply the horizontal box mean while the row is in cache
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(mean, variance, img_bak) \
+  dt_omp_firstprivate(guide, in, width, height, ch, s, ds_width, ds_height, ds_w, img_bak_sz, guide_weight)
+#endif
+  for(int j = 0; j < ds_height; j++)
+  {
+    float *const restrict meanpx = mean.data + (size_t)4 * j * ds_width;
+    float *const restrict varpx = variance.data + (size_t)9 * j * ds_width;
+    const int y0 = j * s;
+    const int y1 = min_i(y0 + s, height);
+    for(int i = 0; i < ds_width; i++)
+    {
+      const int x0 = i * s;
+      const int x1 = min_i(x0 + s, width);
+      float input = 0.f, r = 0.f, g = 0.f, b = 0.f;
+      for(int y = y0; y < y1; y++)
+        for(int x = x0; x < x1; x++)
+        {
+          const size_t k = (size_t)y * width + x;
+          const float *const pixel_ = guide + k * ch;
+          input += in[k];
+          r += pixel_[0];
+          g += pixel_[1];
+          b += pixel_[2];
+        }
+      const float norm = 1.f / ((y1 - y0) * (x1 - x0));
+      const float pixel[3] = { r * norm * guide_weight, g * norm * guide_weight, b * norm * guide_weight };
+      input *= norm;
+      meanpx[4*i+INP_MEAN] = input;
+      meanpx[4*i+GUIDE_MEAN_R] = pixel[0];
+      meanpx[4*i+GUIDE_MEAN_G] = pixel[1];
+      meanpx[4*i+GUIDE_MEAN_B] = pixel[2];
+      varpx[9*i+COV_R] = pixel[0] * input;
+      varpx[9*i+COV_G] = pixel[1] * input;
+      varpx[9*i+COV_B] = pixel[2] * input;
+      varpx[9*i+VAR_RR] = pixel[0] * pixel[0];
+      varpx[9*i+VAR_RG] = pixel[0] * pixel[1];
+      varpx[9*i+VAR_RB] = pixel[0] * pixel[2];
+      varpx[9*i+VAR_GG] = pixel[1] * pixel[1];
+      varpx[9*i+VAR_GB] = pixel[1] * pixel[2];
+      varpx[9*i+VAR_BB] = pixel[2] * pixel[2];
+    }
+    float *const restrict scratch = dt_get_perthread(img_bak, img_bak_sz);
+    dt_box_mean_horizontal(meanpx, ds_width, 4|BOXFILTER_KAHAN_SUM, ds_w, scratch);
+    dt_box_mean_horizontal(varpx, ds_width, 9|BOXFILTER_KAHAN_SUM, ds_w, scratch);
+  }
+  dt_free_align(img_bak);
+  dt_box_mean_vertical(mean.data, ds_height, ds_width, 4|BOXFILTER_KAHAN_SUM, ds_w);
+  dt_box_mean_vertical(variance.data, ds_height, ds_width, 9|BOXFILTER_KAHAN_SUM, ds_w);
+
+  color_image a_b = mean;
+  guided_filter_coefficients(mean, variance, ds_size, eps);
+  free_color_image(&variance);
+
+  dt_box_mean(a_b.data, ds_height, ds_width, 4|BOXFILTER_KAHAN_SUM, ds_w, 1);
+
+  // interpolate the coefficients bilinearly between the centers of the subsampled blocks and apply them to
+  // the full resolution guide in the same pass
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(a_b) \
+  dt_omp_firstprivate(guide, out, width, height, ch, s, ds_width, ds_height, guide_weight, min, max)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const float fy = CLAMPS((j + 0.5f) / s - 0.5f, 0.f, ds_height - 1);
+    const int y0 = (int)fy;
+    const int y1 = min_i(y0 + 1, ds_height - 1);
+    const float wy = fy - y0;
+    const float *const row0 = a_b.data + (size_t)4 * y0 * ds_width;
+    const float *const row1 = a_b.data + (size_t)4 * y1 * ds_width;
+    for(int i = 0; i < width; i++)
+    {
+      const float fx = CLAMPS((i + 0.5f) / s - 0.5f, 0.f, ds_width - 1);
+      const int x0 = (int)fx;
+      const int x1 = min_i(x0 + 1, ds_width - 1);
+      const float wx = fx - x0;
+      dt_aligned_pixel_t px_ab;
+      for_four_channels(c)
+      {
+        const float top = row0[4*x0+c] + wx * (row0[4*x1+c] - row0[4*x0+c]);
+        const float bottom = row1[4*x0+c] + wx * (row1[4*x1+c] - row1[4*x0+c]);
+        px_ab[c] = top + wy * (bottom - top);
+      }
+      const size_t k = (size_t)j * width + i;
+      const float *const pixel = guide + k * ch;
+      float res = guide_weight * (px_ab[A_RED] * pixel[0] + px_ab[A_GREEN] * pixel[1] + px_ab[A_BLUE] * pixel[2]);
+      res += px_ab[B];
+      out[k] = CLAMP(res, min, max);
+    }
+  }
+  free_color_image(&mean);
+}
+
+int guided_filter_subsampling(const int w)
+{
+  // He and Sun suggest subsampling by about a quarter of the window radius, which keeps a radius of about
+  // four pixels at the reduced resolution. below that, the box means get too coarse to keep the results
+  // close to the full resolution filter.
+  return w < 16 ? 1 : min_i(w / 4, 8);
+}
+
 #ifdef HAVE_OPENCL
 
 dt_guided_filter_cl_global_t *dt_guided_filter_init_cl_global()
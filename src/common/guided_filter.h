@@ -83,6 +83,15 @@ static inline int max_i(int a, int b)
 void guided_filter(const float *guide, const float *in, float *out, int width, int height, int ch, int w,
                    float sqrt_eps, float guide_weight, float min, float max);
 
+// same as guided_filter(), but computing the filter coefficients on guide and input subsampled by the given
+// factor. this is much faster for large windows at a small loss of accuracy. falls back to guided_filter()
+// if subsample is 1 or larger than the window size w.
+void fast_guided_filter(const float *guide, const float *in, float *out, int width, int height, int ch, int w,
+                        float sqrt_eps, float guide_weight, float min, float max, int subsample);
+
+// a subsampling factor for fast_guided_filter() which is safe for the window size w, 1 for small windows
+int guided_filter_subsampling(int w);
+
 #ifdef HAVE_OPENCL
 
 typedef struct dt_guided_filter_cl_global_t
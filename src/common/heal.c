@@ -34,9 +34,8 @@
  * but subtract them I2 = I0 - I1, where I0 is the sample image to be
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
- * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation,
+ * preceded by multigrid V-cycles for larger areas (see below).
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -125,38 +124,28 @@ static float dt_heal_laplace_iteration(float *const restrict pixels, const float
   return err.v[0] + err.v[1] + err.v[2];
 }
 
-// Solve the laplace equation for pixels and store the result in-place.
-static void dt_heal_laplace_loop(float *pixels, const int width, const int height,
-                                 const float *const mask)
+/* Construct the system of equations for the cells of a width x height grid where mask is non-zero.
+ * Returns the number of unknowns, the red cells come first, the black ones start at *nmask2.
+ *
+ * All off-diagonal elements of A are either -1 or 0. We could store it as a
+ * general-purpose sparse matrix, but that adds some unnecessary overhead to
+ * the inner loop. Instead, assume exactly 4 off-diagonal elements in each
+ * row, all of which have value -1. Any row that in fact wants less than 4
+ * coefs can put them in a dummy column to be multiplied by an empty pixel,
+ * which is the one following the width x height cells.
+ */
+static int dt_heal_build_system(const float *const mask, const int width, const int height,
+                                float *const restrict Adiag, int *const restrict Aidx, int *nmask2)
 {
-  int nmask = 0;
-  int nmask2 = 0;
-
-  float *Adiag = dt_alloc_align_float((size_t)width * height);
-  int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * width * height);
-
-  if((Adiag == NULL) || (Aidx == NULL))
-  {
-    fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
-    goto cleanup;
-  }
-
-  /* All off-diagonal elements of A are either -1 or 0. We could store it as a
-   * general-purpose sparse matrix, but that adds some unnecessary overhead to
-   * the inner loop. Instead, assume exactly 4 off-diagonal elements in each
-   * row, all of which have value -1. Any row that in fact wants less than 4
-   * coefs can put them in a dummy column to be multiplied by an empty pixel.
-   */
   const int zero = 4 * width * height;
-  memset(pixels + zero, 0, sizeof(float) * 4);
+  int nmask = 0;
 
-  /* Construct the system of equations.
-   * Arrange Aidx in checkerboard order, so that a single linear pass over that
+  /* Arrange Aidx in checkerboard order, so that a single linear pass over that
    * array results updating all of the red cells and then all of the black cells.
    */
   for(int parity = 0; parity < 2; parity++)
   {
-    if(parity == 1) nmask2 = nmask;
+    if(parity == 1) *nmask2 = nmask;
 
     for(int i = 0; i < height; i++)
     {
@@ -183,6 +172,295 @@ static void dt_heal_laplace_loop(float *pixels, const int width, const int heigh
 
 #undef A_POS
 
+  return nmask;
+}
+
+/* Multigrid
+ *
+ * Gauss-Seidel removes the high frequencies of the error quickly, but needs
+ * O(n) iterations over the n pixels of a large heal shape to get the low
+ * frequencies right. We therefore run V-cycles first: after a few smoothing
+ * sweeps the residual is summed over 2x2 blocks into the right hand side of
+ * the same equations on a grid of half the resolution, whose solution is
+ * interpolated back onto the fine cells and smoothed again. The coarse cells
+ * are the blocks whose cells are all healed, everything else is a Dirichlet
+ * condition of zero correction. (Blocks straddling the border of the shape
+ * are left to the smoother: extending the coarse domain beyond the fine one
+ * makes the cycles diverge.) The finest level is the system above with its
+ * boundary handling, and the cycles stop on the same convergence criterion
+ * as the SOR loop, which takes over if they don't get there.
+ */
+
+// heal shapes smaller than this are solved by SOR alone
+#define DT_HEAL_MG_MIN_PIXELS 4096
+// don't coarsen below this size
+#define DT_HEAL_MG_MIN_SIZE 8
+#define DT_HEAL_MG_MAX_LEVELS 12
+#define DT_HEAL_MG_MAX_CYCLES 20
+// Gauss-Seidel sweeps before and after the coarse grid correction, and on the coarsest grid
+#define DT_HEAL_MG_SMOOTH 2
+#define DT_HEAL_MG_COARSE_SWEEPS 50
+
+typedef struct dt_heal_level_t
+{
+  int width, height;
+  int nmask, nmask2;
+  float *x;     // solution on the finest level, correction on the coarser ones, plus the empty pixel
+  float *rhs;   // restricted residual, NULL on the finest level
+  float *res;   // residual of the current cycle
+  float *mask;  // cells to solve for
+  float *Adiag;
+  int *Aidx;
+} dt_heal_level_t;
+
+// One red or black Gauss-Seidel sweep over cells nmask_from..nmask_to of a level, returns the sum squared update.
+static float dt_heal_mg_smooth(float *const restrict x, const float *const restrict rhs,
+                               const float *const restrict Adiag, const int *const restrict Aidx,
+                               const int nmask_from, const int nmask_to)
+{
+  _aligned_pixel err = { { 0.f } };
+
+#if !(defined(__apple_build_version__) && __apple_build_version__ < 11030000) //makes Xcode 11.3.1 compiler crash
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(rhs, Adiag, Aidx, nmask_from, nmask_to) \
+  dt_omp_sharedconst(x) \
+  schedule(static) \
+  reduction(vsum : err)
+#endif
+#endif
+  for(int i = nmask_from; i < nmask_to; i++)
+  {
+    const size_t j0 = Aidx[i * 5 + 0];
+    const size_t j1 = Aidx[i * 5 + 1];
+    const size_t j2 = Aidx[i * 5 + 2];
+    const size_t j3 = Aidx[i * 5 + 3];
+    const size_t j4 = Aidx[i * 5 + 4];
+    const float inv_a = 1.0f / Adiag[i];
+
+    dt_aligned_pixel_t diff;
+    for_each_channel(k,aligned(x))
+    {
+      const float b = rhs ? rhs[j0 + k] : 0.0f;
+      diff[k] = inv_a * (b + x[j1 + k] + x[j2 + k] + x[j3 + k] + x[j4 + k]) - x[j0 + k];
+      x[j0 + k] += diff[k];
+      err.v[k] += diff[k] * diff[k];
+    }
+  }
+
+  return err.v[0] + err.v[1] + err.v[2];
+}
+
+static float dt_heal_mg_sweeps(dt_heal_level_t *const l, const int sweeps)
+{
+  float err = 0.0f;
+  for(int s = 0; s < sweeps; s++)
+  {
+    err = dt_heal_mg_smooth(l->x, l->rhs, l->Adiag, l->Aidx, 0, l->nmask2);
+    err += dt_heal_mg_smooth(l->x, l->rhs, l->Adiag, l->Aidx, l->nmask2, l->nmask);
+  }
+  return err;
+}
+
+// Sum the residual of the fine level over 2x2 blocks into the right hand side of the coarse one.
+static void dt_heal_mg_restrict(dt_heal_level_t *const fine, dt_heal_level_t *const coarse)
+{
+  float *const restrict res = fine->res;
+  const float *const restrict x = fine->x;
+  const float *const restrict rhs = fine->rhs;
+  const float *const restrict Adiag = fine->Adiag;
+  const int *const restrict Aidx = fine->Aidx;
+  const int nmask = fine->nmask;
+
+  memset(res, 0, sizeof(float) * 4 * fine->width * fine->height);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(res, x, rhs, Adiag, Aidx, nmask) \
+  schedule(static)
+#endif
+  for(int i = 0; i < nmask; i++)
+  {
+    const size_t j0 = Aidx[i * 5 + 0];
+    const float a = Adiag[i];
+    for_each_channel(k,aligned(x,res))
+      res[j0 + k] = (rhs ? rhs[j0 + k] : 0.0f) + x[Aidx[i * 5 + 1] + k] + x[Aidx[i * 5 + 2] + k]
+                    + x[Aidx[i * 5 + 3] + k] + x[Aidx[i * 5 + 4] + k] - a * x[j0 + k];
+  }
+
+  const int fw = fine->width, fh = fine->height;
+  const int cw = coarse->width, ch = coarse->height;
+  float *const restrict crhs = coarse->rhs;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(res, crhs, fw, fh, cw, ch) \
+  schedule(static)
+#endif
+  for(int ci = 0; ci < ch; ci++)
+    for(int cj = 0; cj < cw; cj++)
+    {
+      dt_aligned_pixel_t sum = { 0.0f };
+      for(int di = 0; di < 2 && 2 * ci + di < fh; di++)
+        for(int dj = 0; dj < 2 && 2 * cj + dj < fw; dj++)
+        {
+          const float *const r = res + 4 * ((size_t)(2 * ci + di) * fw + 2 * cj + dj);
+          for_each_channel(k) sum[k] += r[k];
+        }
+      for_each_channel(k) crhs[4 * ((size_t)ci * cw + cj) + k] = sum[k];
+    }
+
+  memset(coarse->x, 0, sizeof(float) * 4 * (cw * ch + 1));
+}
+
+// Add the bilinearly interpolated coarse correction to the fine cells. Cells off the canvas take the value
+// of their neighbor, cells not solved for hold a correction of zero.
+static void dt_heal_mg_prolongate(dt_heal_level_t *const fine, const dt_heal_level_t *const coarse)
+{
+  float *const restrict x = fine->x;
+  const float *const restrict cx = coarse->x;
+  const int *const restrict Aidx = fine->Aidx;
+  const int nmask = fine->nmask;
+  const int fw = fine->width, cw = coarse->width, ch = coarse->height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(x, cx, Aidx, nmask, fw, cw, ch) \
+  schedule(static)
+#endif
+  for(int i = 0; i < nmask; i++)
+  {
+    const size_t j0 = Aidx[i * 5 + 0];
+    const int fi = j0 / 4 / fw, fj = j0 / 4 % fw;
+    const int ci = fi / 2, cj = fj / 2;
+    // the coarse neighbors on the side of the fine cell within its block
+    const int ni = CLAMP(ci + ((fi & 1) ? 1 : -1), 0, ch - 1);
+    const int nj = CLAMP(cj + ((fj & 1) ? 1 : -1), 0, cw - 1);
+    const float *const c00 = cx + 4 * ((size_t)ci * cw + cj);
+    const float *const c01 = cx + 4 * ((size_t)ci * cw + nj);
+    const float *const c10 = cx + 4 * ((size_t)ni * cw + cj);
+    const float *const c11 = cx + 4 * ((size_t)ni * cw + nj);
+    for_each_channel(k,aligned(x))
+      x[j0 + k] += (9.0f * c00[k] + 3.0f * (c01[k] + c10[k]) + c11[k]) / 16.0f;
+  }
+}
+
+// Returns the sum squared update of the last smoothing sweep on level l.
+static float dt_heal_mg_vcycle(dt_heal_level_t *const levels, const int l, const int nlevels)
+{
+  dt_heal_level_t *const level = levels + l;
+  if(l == nlevels - 1) return dt_heal_mg_sweeps(level, DT_HEAL_MG_COARSE_SWEEPS);
+
+  dt_heal_mg_sweeps(level, DT_HEAL_MG_SMOOTH);
+  dt_heal_mg_restrict(level, level + 1);
+  dt_heal_mg_vcycle(levels, l + 1, nlevels);
+  dt_heal_mg_prolongate(level, level + 1);
+  return dt_heal_mg_sweeps(level, DT_HEAL_MG_SMOOTH);
+}
+
+static void dt_heal_mg_free_levels(dt_heal_level_t *const levels, const int nlevels)
+{
+  // level 0 borrows everything from the caller but its residual
+  dt_free_align(levels[0].res);
+  for(int l = 1; l < nlevels; l++)
+  {
+    dt_free_align(levels[l].x);
+    dt_free_align(levels[l].rhs);
+    dt_free_align(levels[l].res);
+    dt_free_align(levels[l].mask);
+    dt_free_align(levels[l].Adiag);
+    dt_free_align(levels[l].Aidx);
+  }
+}
+
+// Run V-cycles on the system of the finest level until its updates drop below err_exit, returns TRUE if they did.
+static gboolean dt_heal_multigrid(float *pixels, const int width, const int height, const float *const mask,
+                              float *const Adiag, int *const Aidx, const int nmask, const int nmask2,
+                              const float err_exit)
+{
+  dt_heal_level_t levels[DT_HEAL_MG_MAX_LEVELS] = { { 0 } };
+  levels[0] = (dt_heal_level_t){ .width = width, .height = height, .nmask = nmask, .nmask2 = nmask2,
+                                 .x = pixels, .rhs = NULL, .mask = (float *)mask, .Adiag = Adiag, .Aidx = Aidx };
+  levels[0].res = dt_alloc_align_float((size_t)4 * width * height);
+  if(!levels[0].res) return FALSE;
+
+  int nlevels = 1;
+  while(nlevels < DT_HEAL_MG_MAX_LEVELS)
+  {
+    const dt_heal_level_t *const fine = levels + nlevels - 1;
+    const int cw = (fine->width + 1) / 2, ch = (fine->height + 1) / 2;
+    if(cw < DT_HEAL_MG_MIN_SIZE || ch < DT_HEAL_MG_MIN_SIZE) break;
+
+    dt_heal_level_t *const coarse = levels + nlevels;
+    const size_t cells = (size_t)cw * ch;
+    coarse->width = cw;
+    coarse->height = ch;
+    coarse->x = dt_alloc_align_float(4 * (cells + 1));
+    coarse->rhs = dt_alloc_align_float(4 * cells);
+    coarse->res = dt_alloc_align_float(4 * cells);
+    coarse->mask = dt_alloc_align_float(cells);
+    coarse->Adiag = dt_alloc_align_float(cells);
+    coarse->Aidx = dt_alloc_align(64, sizeof(int) * 5 * cells);
+    nlevels++;
+    if(!coarse->x || !coarse->rhs || !coarse->res || !coarse->mask || !coarse->Adiag || !coarse->Aidx)
+    {
+      fprintf(stderr, "dt_heal_multigrid: error allocating memory for healing\n");
+      dt_heal_mg_free_levels(levels, nlevels);
+      return FALSE;
+    }
+
+    // a coarse cell is solved for if all of its fine cells are
+    for(int ci = 0; ci < ch; ci++)
+      for(int cj = 0; cj < cw; cj++)
+      {
+        float m = 1.0f;
+        for(int di = 0; di < 2 && 2 * ci + di < fine->height; di++)
+          for(int dj = 0; dj < 2 && 2 * cj + dj < fine->width; dj++)
+            if(!fine->mask[(size_t)(2 * ci + di) * fine->width + 2 * cj + dj]) m = 0.0f;
+        coarse->mask[(size_t)ci * cw + cj] = m;
+      }
+    coarse->nmask = dt_heal_build_system(coarse->mask, cw, ch, coarse->Adiag, coarse->Aidx, &coarse->nmask2);
+  }
+
+  gboolean converged = FALSE;
+  if(nlevels > 1)
+  {
+    // the sweeps are plain Gauss-Seidel, scale their updates to the ones of the over-relaxed loop
+    const float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
+    const float err_scale = 16.0f * w * w;
+    int cycle = 0;
+    for(; cycle < DT_HEAL_MG_MAX_CYCLES && !converged; cycle++)
+      converged = dt_heal_mg_vcycle(levels, 0, nlevels) * err_scale < err_exit;
+
+    dt_print(DT_DEBUG_PERF, "[dt_heal] %d pixels, %d levels, %d V-cycles%s\n", nmask, nlevels, cycle,
+             converged ? "" : ", not converged");
+  }
+
+  dt_heal_mg_free_levels(levels, nlevels);
+  return converged;
+}
+
+// Solve the laplace equation for pixels and store the result in-place.
+static void dt_heal_laplace_loop(float *pixels, const int width, const int height,
+                                 const float *const mask, const gboolean use_multigrid)
+{
+  int nmask = 0;
+  int nmask2 = 0;
+
+  float *Adiag = dt_alloc_align_float((size_t)width * height);
+  int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * width * height);
+
+  if((Adiag == NULL) || (Aidx == NULL))
+  {
+    fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
+    goto cleanup;
+  }
+
+  const int zero = 4 * width * height;
+  memset(pixels + zero, 0, sizeof(float) * 4);
+
+  nmask = dt_heal_build_system(mask, width, height, Adiag, Aidx, &nmask2);
+
   /* Empirically optimal over-relaxation factor. (Benchmarked on
    * round brushes, at least. I don't know whether aspect ratio
    * affects it.)
@@ -193,6 +471,10 @@ static void dt_heal_laplace_loop(float *pixels, const int width, const int heigh
   const float epsilon = (0.1 / 255);
   const float err_exit = epsilon * epsilon * w * w;
 
+  if(use_multigrid && nmask >= DT_HEAL_MG_MIN_PIXELS
+     && dt_heal_multigrid(pixels, width, height, mask, Adiag, Aidx, nmask, nmask2, err_exit))
+    goto cleanup;
+
   /* Gauss-Seidel with successive over-relaxation */
   for(int iter = 0; iter < max_iter; iter++)
   {
@@ -233,7 +515,7 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
   /* subtract pattern from image and store the result in diff */
   dt_heal_sub(dest_buffer, src_buffer, diff_buffer, width, height);
 
-  dt_heal_laplace_loop(diff_buffer, width, height, mask_buffer);
+  dt_heal_laplace_loop(diff_buffer, width, height, mask_buffer, TRUE);
 
   /* add solution to original image and store in dest */
   dt_heal_add(diff_buffer, src_buffer, dest_buffer, width, height);
@@ -87,13 +87,20 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
     }
     if (size & DT_IMGSZ_PERTHREAD)
     {
-      *bufptr = dt_alloc_perthread_float(nfloats,paddedsize);
+      if (size & DT_IMGSZ_SCRATCH)
+      {
+        // same layout as dt_alloc_perthread_float(): one cache-line padded slice per thread
+        *paddedsize = dt_round_size(nfloats * sizeof(float), 64) / sizeof(float);
+        *bufptr = dt_scratch_alloc_float(*paddedsize * dt_get_num_threads());
+      }
+      else
+        *bufptr = dt_alloc_perthread_float(nfloats,paddedsize);
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, *paddedsize * dt_get_num_threads() * sizeof(float));
     }
     else
     {
-      *bufptr = dt_alloc_align_float(nfloats);
+      *bufptr = (size & DT_IMGSZ_SCRATCH) ? dt_scratch_alloc_float(nfloats) : dt_alloc_align_float(nfloats);
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, nfloats * sizeof(float));
     }
@@ -122,7 +129,10 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
         (void)va_arg(args,size_t*);  // skip the extra pointer for per-thread allocations
       if (size == 0 || !bufptr || !*bufptr)
         break;  // end of arg list or this attempted allocation failed
-      dt_free_align(*bufptr);
+      if (size & DT_IMGSZ_SCRATCH)
+        dt_scratch_free(*bufptr);
+      else
+        dt_free_align(*bufptr);
       *bufptr = NULL;
     }
     va_end(args);
@@ -21,6 +21,7 @@
 #include "config.h"
 #endif
 
+#include "common/scratch_pool.h"
 #include "develop/imageop.h" // for dt_iop_roi_t
 
 // Allocate a 64-byte aligned buffer for an image of the given dimensions and channels.
@@ -35,6 +36,7 @@ static inline float *__restrict__ dt_iop_image_alloc(const size_t width, const s
 //  The variable arguments take the form  SIZE, PTR-to-floatPTR, SIZE, PTR-to-floatPTR, etc. except that if the SIZE
 //  indicates a per-thread allocation, a second pointer is passed: SIZE, PTR-to-floatPTR, PTR-to-size_t, SIZE, etc.
 //  SIZE is the number of floats per pixel, ORed with appropriate flags from the list following below
+//  The buffers must be freed with dt_free_align(), or with dt_scratch_free() if DT_IMGSZ_SCRATCH was given.
 gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
                                     const struct dt_iop_roi_t *const roi_in,
                                     const struct dt_iop_roi_t *const roi_out, ...);
@@ -48,6 +50,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
 
 #define DT_IMGSZ_PERTHREAD  0x0200000  // allocate a separate buffer for each thread
 #define DT_IMGSZ_CLEARBUF   0x0400000  // zero the allocated buffer
+#define DT_IMGSZ_SCRATCH    0x0800000  // recycle memory through the pipe's scratch pool, see common/scratch_pool.h
 
 #define DT_IMGSZ_DIM_MASK   0x00F0000  // isolate the requested image dimension(s)
 #define DT_IMGSZ_FULL       0x0000000  // full height times width
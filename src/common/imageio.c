@@ -78,6 +78,179 @@
 #include "lua/image.h"
 #endif
 
+GMappedFile *dt_imageio_map_file(const char *filename)
+{
+  return g_mapped_file_new(filename, FALSE, NULL);
+}
+
+// a minimal tiff reader, just enough to find the jpeg previews in the ifds of tiff based raws
+typedef struct _tiff_reader_t
+{
+  const uint8_t *data;
+  size_t size;
+  gboolean big_endian;
+} _tiff_reader_t;
+
+static inline uint32_t _tiff_get16(const _tiff_reader_t *t, const size_t offset)
+{
+  if(offset > t->size || t->size - offset < 2) return 0;
+  const uint8_t *p = t->data + offset;
+  return t->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static inline uint32_t _tiff_get32(const _tiff_reader_t *t, const size_t offset)
+{
+  if(offset > t->size || t->size - offset < 4) return 0;
+  const uint8_t *p = t->data + offset;
+  return t->big_endian ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                       : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+// the value of a SHORT or LONG entry, or its offset if it doesn't fit into the entry
+static inline uint32_t _tiff_entry_value(const _tiff_reader_t *t, const size_t entry)
+{
+  return _tiff_get16(t, entry + 2) == 3 ? _tiff_get16(t, entry + 8) : _tiff_get32(t, entry + 8);
+}
+
+// only accept what libjpeg can decode: baseline, extended and progressive huffman coded dct
+static gboolean _jpeg_is_dct(const uint8_t *data, const size_t size)
+{
+  if(size < 4 || data[0] != 0xff || data[1] != 0xd8) return FALSE;
+  size_t pos = 2;
+  while(pos + 4 <= size)
+  {
+    if(data[pos] != 0xff) return FALSE;
+    const uint8_t marker = data[pos + 1];
+    if(marker == 0xff)
+    {
+      // fill byte
+      pos++;
+      continue;
+    }
+    if(marker == 0xc0 || marker == 0xc1 || marker == 0xc2) return TRUE;
+    // any other start of frame (lossless, arithmetic coded), or image data without a frame
+    if((marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+       || marker == 0xda || marker == 0xd9)
+      return FALSE;
+    pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+  }
+  return FALSE;
+}
+
+static void _tiff_preview_candidate(const _tiff_reader_t *t, const uint32_t jpeg_offset, const uint32_t jpeg_length,
+                                    size_t *offset, size_t *length)
+{
+  if(jpeg_length > *length && jpeg_offset <= t->size && jpeg_length <= t->size - jpeg_offset
+     && _jpeg_is_dct(t->data + jpeg_offset, jpeg_length))
+  {
+    *offset = jpeg_offset;
+    *length = jpeg_length;
+  }
+}
+
+// find the largest jpeg preview in the ifd chains, including sub ifds. returns FALSE if there is none.
+static gboolean _find_tiff_preview(const uint8_t *data, const size_t size, size_t *offset, size_t *length)
+{
+  if(size < 8) return FALSE;
+  _tiff_reader_t t = { data, size, FALSE };
+  if(data[0] == 'M' && data[1] == 'M')
+    t.big_endian = TRUE;
+  else if(data[0] != 'I' || data[1] != 'I')
+    return FALSE;
+  // plain tiff, and the variants of olympus and panasonic
+  const uint32_t magic = _tiff_get16(&t, 2);
+  if(magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) return FALSE;
+
+  // the ifds still to be visited. the limit also protects against loops in broken files.
+  uint32_t ifds[32];
+  int num_ifds = 0, visited = 0;
+  ifds[num_ifds++] = _tiff_get32(&t, 4);
+  *length = 0;
+
+  while(num_ifds > 0 && visited++ < 32)
+  {
+    const uint32_t ifd = ifds[--num_ifds];
+    if(ifd < 8 || (size_t)ifd + 2 > size) continue;
+    const uint32_t entries = _tiff_get16(&t, ifd);
+    if((size_t)ifd + 2 + 12 * entries + 4 > size) continue;
+
+    uint32_t jpeg_offset = 0, jpeg_length = 0, strip_offset = 0, strip_length = 0, compression = 0,
+             photometric = 0;
+    gboolean single_strip = FALSE;
+    for(uint32_t k = 0; k < entries; k++)
+    {
+      const size_t entry = ifd + 2 + 12 * k;
+      const uint32_t tag = _tiff_get16(&t, entry);
+      const uint32_t count = _tiff_get32(&t, entry + 4);
+      switch(tag)
+      {
+        case 0x103: compression = _tiff_entry_value(&t, entry); break;
+        case 0x106: photometric = _tiff_entry_value(&t, entry); break;
+        case 0x111:
+          strip_offset = _tiff_entry_value(&t, entry);
+          single_strip = count == 1;
+          break;
+        case 0x117: strip_length = _tiff_entry_value(&t, entry); break;
+        case 0x201: jpeg_offset = _tiff_entry_value(&t, entry); break;
+        case 0x202: jpeg_length = _tiff_entry_value(&t, entry); break;
+        case 0x14a: // sub ifds
+        {
+          const size_t list = count == 1 ? entry + 8 : _tiff_get32(&t, entry + 8);
+          for(uint32_t i = 0; i < count && num_ifds < 32; i++) ifds[num_ifds++] = _tiff_get32(&t, list + 4 * i);
+          break;
+        }
+        default: break;
+      }
+    }
+    const uint32_t next = _tiff_get32(&t, ifd + 2 + 12 * entries);
+    if(next && num_ifds < 32) ifds[num_ifds++] = next;
+
+    _tiff_preview_candidate(&t, jpeg_offset, jpeg_length, offset, length);
+    // cfa and linear raw data can be jpeg compressed as well, but lossless
+    if(single_strip && (compression == 6 || compression == 7) && photometric != 32803 && photometric != 34892)
+      _tiff_preview_candidate(&t, strip_offset, strip_length, offset, length);
+  }
+  return *length > 0;
+}
+
+int dt_imageio_embedded_thumbnail(const char *filename, const int max_width, const int max_height,
+                                  uint8_t **buffer, int32_t *width, int32_t *height, int32_t *full_width,
+                                  int32_t *full_height)
+{
+  GMappedFile *mapped = dt_imageio_map_file(filename);
+  if(!mapped) return 1;
+
+  int res = 1;
+  const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(mapped);
+  const size_t size = g_mapped_file_get_length(mapped);
+  size_t offset = 0, length = 0;
+  dt_imageio_jpeg_t jpg;
+  if(data && _find_tiff_preview(data, size, &offset, &length)
+     && !dt_imageio_jpeg_decompress_header(data + offset, length, &jpg))
+  {
+    *full_width = jpg.width;
+    *full_height = jpg.height;
+    dt_imageio_jpeg_set_scale(&jpg, max_width, max_height);
+    *buffer = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * jpg.width * jpg.height);
+    if(!*buffer)
+      jpeg_destroy_decompress(&(jpg.dinfo));
+    else if(dt_imageio_jpeg_decompress(&jpg, *buffer))
+    {
+      dt_free_align(*buffer);
+      *buffer = NULL;
+    }
+    else
+    {
+      *width = jpg.width;
+      *height = jpg.height;
+      res = 0;
+    }
+  }
+
+  g_mapped_file_unref(mapped);
+  return res;
+}
+
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
@@ -88,8 +261,16 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
   char *mime_type = NULL;
   size_t bufsize;
 
-  // get the biggest thumb from exif
-  if(dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type)) goto error;
+  // get the biggest thumb from exif. with the file mapped, only the pages holding the metadata and the
+  // thumbnail are read in.
+  GMappedFile *mapped = dt_imageio_map_file(filename);
+  const int failed = mapped ? dt_exif_get_thumbnail_from_data(filename,
+                                                               (uint8_t *)g_mapped_file_get_contents(mapped),
+                                                               g_mapped_file_get_length(mapped), &buf, &bufsize,
+                                                               &mime_type)
+                            : dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type);
+  if(mapped) g_mapped_file_unref(mapped);
+  if(failed) goto error;
 
   if(strcmp(mime_type, "image/jpeg") == 0)
   {
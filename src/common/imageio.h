@@ -102,9 +102,21 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
                                           const int fht, const int stride,
                                           const dt_image_orientation_t orientation);
 
+// map a whole file read-only, sharing the pages with the page cache instead of copying them. meant for
+// picking small parts out of a file, e.g. the embedded previews: only the pages touched are read in.
+// beware that if the file is truncated while it is mapped, touching a page past its new end raises SIGBUS
+// and takes the whole process down. files which are read completely should be read into memory instead.
+// returns NULL on failure, release with g_mapped_file_unref().
+GMappedFile *dt_imageio_map_file(const char *filename);
+
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space);
+// the same for tiff based raws, without going through exiv2. the jpg is decoded at a reduced size, as far as it
+// still covers max_width x max_height. full_width/full_height return the size of the jpg itself.
+int dt_imageio_embedded_thumbnail(const char *filename, const int max_width, const int max_height,
+                                  uint8_t **buffer, int32_t *width, int32_t *height, int32_t *full_width,
+                                  int32_t *full_height);
 
 // lookup maker and model, dispatch lookup to rawspeed or libraw
 gboolean dt_imageio_lookup_makermodel(const char *maker, const char *model,
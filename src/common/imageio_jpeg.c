@@ -154,11 +154,25 @@ int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_
   return 0;
 }
 
+void dt_imageio_jpeg_set_scale(dt_imageio_jpeg_t *jpg, const int max_width, const int max_height)
+{
+  // the scale the image will be displayed at, when fitted into the box
+  const float scale = fminf((float)max_width / jpg->dinfo.image_width, (float)max_height / jpg->dinfo.image_height);
+  unsigned int denom = 1;
+  while(denom < 8 && 2 * denom * scale <= 1.0f) denom *= 2;
+
+  jpg->dinfo.scale_num = 1;
+  jpg->dinfo.scale_denom = denom;
+  jpeg_calc_output_dimensions(&(jpg->dinfo));
+  jpg->width = jpg->dinfo.output_width;
+  jpg->height = jpg->dinfo.output_height;
+}
+
 #ifdef JCS_EXTENSIONS
 static int decompress_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -175,14 +189,14 @@ static int decompress_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)dt_alloc_align(64, (size_t)jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
       dt_free_align(row_pointer[0]);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
     {
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     }
@@ -136,7 +136,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
 {
   if(_ignore_image(filename)) return DT_IMAGEIO_FILE_CORRUPTED;
 
-  if(!img->exif_inited) (void)dt_exif_read(img, filename);
+  const double start = dt_get_wtime();
 
   char filen[PATH_MAX] = { 0 };
   snprintf(filen, sizeof(filen), "%s", filename);
@@ -149,9 +149,24 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
+    // the file is read once, by one thread at a time, and exiv2 parses the metadata from the same buffer
+    // instead of reading the file again. unlike a mapping, the buffer can't go away under the decoder when
+    // the file is truncated meanwhile.
     dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    m = f.readFile();
+    try
+    {
+      m = f.readFile();
+    }
+    catch(...)
+    {
+      dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+      throw;
+    }
     dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    const double read_time = dt_get_wtime();
+
+    if(!img->exif_inited) (void)dt_exif_read_from_data(img, filename, m->begin(), m->getSize());
+    const double exif_time = dt_get_wtime();
 
     RawParser t(*m.get());
     d = t.getDecoder(meta);
@@ -164,6 +179,9 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     d->decodeMetaData(meta);
     RawImage r = d->mRaw;
 
+    dt_print(DT_DEBUG_PERF, "[rawspeed] %s: reading %.3f s, exif %.3f s, decoding %.3f s\n", filename,
+             read_time - start, exif_time - read_time, dt_get_wtime() - exif_time);
+
     const auto errors = r->getErrors();
     for(const auto &error : errors) fprintf(stderr, "[rawspeed] (%s) %s\n", img->filename, error.c_str());
 
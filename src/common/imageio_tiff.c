@@ -34,6 +34,7 @@
 typedef struct tiff_t
 {
   TIFF *tiff;
+  const char *filename;
   uint32_t width;
   uint32_t height;
   uint16_t bpp;
@@ -42,7 +43,7 @@ typedef struct tiff_t
   uint32_t scanlinesize;
   dt_image_t *image;
   float *mipbuf;
-  tdata_t buf;
+  uint8_t *buf; // all decoded scanlines
 } tiff_t;
 
 typedef union fp32_t
@@ -80,16 +81,116 @@ static inline float _half_to_float(uint16_t h)
   return o.f;
 }
 
+static TIFF *_open(const char *filename)
+{
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  TIFF *tiff = TIFFOpenW(wfilename, "rb");
+  g_free(wfilename);
+  return tiff;
+#else
+  return TIFFOpen(filename, "rb");
+#endif
+}
+
+// decode all strips or tiles into t->buf. they are decoded in parallel, every thread but the first one
+// reading the file through a handle of its own.
+static int _read_raw(tiff_t *t)
+{
+  const gboolean tiled = TIFFIsTiled(t->tiff);
+  uint32_t tile_width = 0, tile_height = 0, rows_per_strip = 0;
+  size_t chunks, chunk_size;
+  if(tiled)
+  {
+    TIFFGetField(t->tiff, TIFFTAG_TILEWIDTH, &tile_width);
+    TIFFGetField(t->tiff, TIFFTAG_TILELENGTH, &tile_height);
+    chunks = TIFFNumberOfTiles(t->tiff);
+    chunk_size = TIFFTileSize(t->tiff);
+  }
+  else
+  {
+    TIFFGetFieldDefaulted(t->tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    rows_per_strip = MIN(rows_per_strip, t->height);
+    chunks = TIFFNumberOfStrips(t->tiff);
+    chunk_size = 0;
+  }
+  if(tiled && (tile_width == 0 || tile_height == 0)) return -1;
+  if(!tiled && rows_per_strip == 0) return -1;
+
+  // tiles are decoded into a buffer of their own and copied over, strips go right into place
+  const size_t pixel_size = (size_t)t->spp * t->bpp / 8;
+  const int nthreads = MIN(dt_get_num_threads(), chunks);
+  size_t padded_size = 0;
+  uint8_t *const tiles = tiled ? dt_alloc_perthread(chunk_size, sizeof(uint8_t), &padded_size) : NULL;
+  if(tiled && !tiles) return -1;
+
+  gboolean failed = FALSE;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(MAX(nthreads, 1)) default(none) \
+  dt_omp_firstprivate(t, tiled, tile_width, tile_height, rows_per_strip, chunks, chunk_size, pixel_size, tiles) \
+  dt_omp_firstprivate(padded_size) \
+  reduction(|| : failed)
+#endif
+  {
+    TIFF *tiff = dt_get_thread_num() == 0 ? t->tiff : _open(t->filename);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for(size_t k = 0; k < chunks; k++)
+    {
+      if(!tiff)
+      {
+        failed = TRUE;
+        continue;
+      }
+      if(tiled)
+      {
+        uint8_t *const tile = dt_get_perthread(tiles, padded_size);
+        if(TIFFReadEncodedTile(tiff, k, tile, chunk_size) == -1)
+        {
+          failed = TRUE;
+          continue;
+        }
+        const size_t tiles_across = (t->width + tile_width - 1) / tile_width;
+        const size_t x0 = (k % tiles_across) * tile_width;
+        const size_t y0 = (k / tiles_across) * tile_height;
+        if(x0 >= t->width || y0 >= t->height) continue;
+        const size_t cols = MIN(tile_width, t->width - x0);
+        const size_t rows = MIN(tile_height, t->height - y0);
+        for(size_t r = 0; r < rows; r++)
+          memcpy(t->buf + (y0 + r) * t->scanlinesize + x0 * pixel_size, tile + r * tile_width * pixel_size,
+                 cols * pixel_size);
+      }
+      else
+      {
+        const size_t y0 = k * rows_per_strip;
+        if(y0 >= t->height) continue;
+        const size_t rows = MIN(rows_per_strip, t->height - y0);
+        if(TIFFReadEncodedStrip(tiff, k, t->buf + y0 * t->scanlinesize, rows * t->scanlinesize) == -1)
+          failed = TRUE;
+      }
+    }
+
+    if(tiff && tiff != t->tiff) TIFFClose(tiff);
+  }
+
+  dt_free_align(tiles);
+  return failed ? -1 : 1;
+}
+
 static inline int _read_chunky_8(tiff_t *t)
 {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(t) \
+  schedule(static)
+#endif
   for(uint32_t row = 0; row < t->height; row++)
   {
-    uint8_t *in = ((uint8_t *)t->buf);
+    const uint8_t *in = t->buf + (size_t)t->scanlinesize * row;
     float *out = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) return -1;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       /* set rgb to first sample from scanline */
@@ -114,14 +215,16 @@ static inline int _read_chunky_8(tiff_t *t)
 
 static inline int _read_chunky_16(tiff_t *t)
 {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(t) \
+  schedule(static)
+#endif
   for(uint32_t row = 0; row < t->height; row++)
   {
-    uint16_t *in = ((uint16_t *)t->buf);
+    const uint16_t *in = (uint16_t *)(t->buf + (size_t)t->scanlinesize * row);
     float *out = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) return -1;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       out[0] = ((float)in[0]) * (1.0f / 65535.0f);
@@ -145,14 +248,16 @@ static inline int _read_chunky_16(tiff_t *t)
 
 static inline int _read_chunky_h(tiff_t *t)
 {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(t) \
+  schedule(static)
+#endif
   for(uint32_t row = 0; row < t->height; row++)
   {
-    uint16_t *in = ((uint16_t *)t->buf);
+    const uint16_t *in = (uint16_t *)(t->buf + (size_t)t->scanlinesize * row);
     float *out = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) return -1;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       out[0] = _half_to_float(in[0]);
@@ -176,14 +281,16 @@ static inline int _read_chunky_h(tiff_t *t)
 
 static inline int _read_chunky_f(tiff_t *t)
 {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(t) \
+  schedule(static)
+#endif
   for(uint32_t row = 0; row < t->height; row++)
   {
-    float *in = ((float *)t->buf);
+    const float *in = (float *)(t->buf + (size_t)t->scanlinesize * row);
     float *out = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) return -1;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       out[0] = in[0];
@@ -213,13 +320,10 @@ static inline int _read_chunky_8_Lab(tiff_t *t, uint16_t photometric)
 
   for(uint32_t row = 0; row < t->height; row++)
   {
-    uint8_t *in = ((uint8_t *)t->buf);
+    const uint8_t *in = t->buf + (size_t)t->scanlinesize * row;
     float *output = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
     float *out = output;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) goto failed;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       out[0] = ((float)in[0]) * (100.0f/255.0f);
@@ -251,10 +355,6 @@ static inline int _read_chunky_8_Lab(tiff_t *t, uint16_t photometric)
   cmsDeleteTransform(xform);
 
   return 1;
-
-failed:
-  cmsDeleteTransform(xform);
-  return -1;
 }
 
 
@@ -267,13 +367,10 @@ static inline int _read_chunky_16_Lab(tiff_t *t, uint16_t photometric)
 
   for(uint32_t row = 0; row < t->height; row++)
   {
-    uint16_t *in = ((uint16_t *)t->buf);
+    const uint16_t *in = (uint16_t *)(t->buf + (size_t)t->scanlinesize * row);
     float *output = ((float *)t->mipbuf) + (size_t)4 * row * t->width;
     float *out = output;
 
-    /* read scanline */
-    if(TIFFReadScanline(t->tiff, in, row, 0) == -1) goto failed;
-
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
       out[0] = ((float)in[0]) * (100.0f/range);
@@ -305,10 +402,6 @@ static inline int _read_chunky_16_Lab(tiff_t *t, uint16_t photometric)
   cmsDeleteTransform(xform);
 
   return 1;
-
-failed:
-  cmsDeleteTransform(xform);
-  return -1;
 }
 
 
@@ -353,13 +446,8 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
 
   t.image = img;
 
-#ifdef _WIN32
-  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
-  t.tiff = TIFFOpenW(wfilename, "rb");
-  g_free(wfilename);
-#else
-  t.tiff = TIFFOpen(filename, "rb");
-#endif
+  t.filename = filename;
+  t.tiff = _open(filename);
 
   if(t.tiff == NULL) return DT_IMAGEIO_FILE_CORRUPTED;
 
@@ -423,7 +511,7 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
     return DT_IMAGEIO_CACHE_FULL;
   }
 
-  if((t.buf = _TIFFmalloc(t.scanlinesize)) == NULL)
+  if((t.buf = dt_alloc_align(64, (size_t)t.scanlinesize * t.height)) == NULL)
   {
     TIFFClose(t.tiff);
     return DT_IMAGEIO_CACHE_FULL;
@@ -443,9 +531,11 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
     t.image->flags &= ~DT_IMAGE_HDR;
   }
 
-  int ok = 1;
+  int ok = _read_raw(&t);
 
-  if((photometric == PHOTOMETRIC_CIELAB || photometric == PHOTOMETRIC_ICCLAB) && t.bpp == 8 && t.sampleformat == SAMPLEFORMAT_UINT)
+  if(ok != 1)
+    fprintf(stderr, "[tiff_open] error: could not decode image `%s'\n", filename);
+  else if((photometric == PHOTOMETRIC_CIELAB || photometric == PHOTOMETRIC_ICCLAB) && t.bpp == 8 && t.sampleformat == SAMPLEFORMAT_UINT)
   {
     ok = _read_chunky_8_Lab(&t, photometric);
     t.image->buf_dsc.cst = iop_cs_Lab;
@@ -469,7 +559,7 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
     ok = 0;
   }
 
-  _TIFFfree(t.buf);
+  dt_free_align(t.buf);
   TIFFClose(t.tiff);
 
   if(ok == 1)
@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <glib.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -1378,184 +1379,301 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
-static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
-                                            const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                            const float *const in, const dt_iop_roi_t *const roi_in,
-                                            const int32_t in_stride)
-{
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
+/* --------------------------------------------------------------------------
+ * Resampling plan cache
+ * ------------------------------------------------------------------------*/
 
-  const int32_t in_stride_floats = in_stride / sizeof(float);
-  const int32_t out_stride_floats = out_stride / sizeof(float);
-  int r;
+/** A 1D resampling plan as returned by prepare_resampling_plan(), along with the parameters it has been
+ * computed for. The arrays are never modified once the plan has been built, so a plan can be used by any
+ * number of threads and resampling calls at the same time. */
+typedef struct dt_resampling_plan_t
+{
+  const struct dt_interpolation *itor;
+  int in;
+  int in_x0;
+  int out;
+  int out_x0;
+  float scale;
+  int *length;
+  float *kernel;
+  int *index;
+  int *meta;
+  gint refcount;
+} dt_resampling_plan_t;
+
+/* Preview pipes, finalscale, thumbnails and exports keep resampling at the same handful of sizes, so the
+ * most recently used plans are kept around. Horizontal and vertical plans are cached independently. */
+#define RESAMPLING_PLAN_CACHE_SIZE 8
+
+// number of floats of an output line summed up at once by the vertical pass
+#define RESAMPLING_CHUNK 64
+
+static GMutex _plan_cache_lock;
+static dt_resampling_plan_t *_plan_cache[RESAMPLING_PLAN_CACHE_SIZE]; // most recently used first
+
+static void _plan_unref(dt_resampling_plan_t *plan)
+{
+  if(plan && g_atomic_int_dec_and_test(&plan->refcount))
+  {
+    // the length array is the start of the single block holding the plan
+    dt_free_align(plan->length);
+    free(plan);
+  }
+}
 
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
+static inline gboolean _plan_matches(const dt_resampling_plan_t *plan, const struct dt_interpolation *itor,
+                                     const int in, const int in_x0, const int out, const int out_x0,
+                                     const float scale)
+{
+  return plan && plan->itor == itor && plan->in == in && plan->in_x0 == in_x0 && plan->out == out
+         && plan->out_x0 == out_x0 && plan->scale == scale;
+}
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
+// look up a cached plan, moving it to the front. must be called with the lock held.
+static dt_resampling_plan_t *_plan_lookup_locked(const struct dt_interpolation *itor, const int in,
+                                                 const int in_x0, const int out, const int out_x0,
+                                                 const float scale)
+{
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(in, in_stride, out_stride, roi_out, x0) \
-    shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
+    dt_resampling_plan_t *plan = _plan_cache[k];
+    if(_plan_matches(plan, itor, in, in_x0, out, out_x0, scale))
     {
-      memcpy((char *)out + (size_t)out_stride * y,
-             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
-             out_stride);
+      memmove(_plan_cache + 1, _plan_cache, k * sizeof(dt_resampling_plan_t *));
+      _plan_cache[0] = plan;
+      g_atomic_int_inc(&plan->refcount);
+      return plan;
     }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
   }
+  return NULL;
+}
 
-// Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
-
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
+/** Returns the resampling plan for the given parameters, from the cache if possible. The plan has to be
+ * released with _plan_unref(). Returns NULL if it could not be computed. */
+static dt_resampling_plan_t *_get_resampling_plan(const struct dt_interpolation *itor, const int in,
+                                                  const int in_x0, const int out, const int out_x0,
+                                                  const float scale)
+{
+  g_mutex_lock(&_plan_cache_lock);
+  dt_resampling_plan_t *plan = _plan_lookup_locked(itor, in, in_x0, out, out_x0, scale);
+  g_mutex_unlock(&_plan_cache_lock);
+  if(plan) return plan;
+
+  // computing the plan doesn't need the lock
+  plan = (dt_resampling_plan_t *)calloc(1, sizeof(dt_resampling_plan_t));
+  if(!plan) return NULL;
+  if(prepare_resampling_plan(itor, in, in_x0, out, out_x0, scale, &plan->length, &plan->kernel, &plan->index,
+                             &plan->meta))
+  {
+    free(plan);
+    return NULL;
   }
+  plan->itor = itor;
+  plan->in = in;
+  plan->in_x0 = in_x0;
+  plan->out = out;
+  plan->out_x0 = out_x0;
+  plan->scale = scale;
+  plan->refcount = 1;
+
+  g_mutex_lock(&_plan_cache_lock);
+  // another thread might have been quicker
+  dt_resampling_plan_t *cached = _plan_lookup_locked(itor, in, in_x0, out, out_x0, scale);
+  if(!cached)
+  {
+    _plan_unref(_plan_cache[RESAMPLING_PLAN_CACHE_SIZE - 1]);
+    memmove(_plan_cache + 1, _plan_cache, (RESAMPLING_PLAN_CACHE_SIZE - 1) * sizeof(dt_resampling_plan_t *));
+    _plan_cache[0] = plan;
+    // one reference for the cache, one for the caller
+    g_atomic_int_inc(&plan->refcount);
+  }
+  g_mutex_unlock(&_plan_cache_lock);
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
+  if(cached)
   {
-    goto exit;
+    _plan_unref(plan);
+    return cached;
   }
+  return plan;
+}
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
+/* --------------------------------------------------------------------------
+ * Separable resampling
+ * ------------------------------------------------------------------------*/
 
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
+/** Resamples a single input line horizontally, writing plan->out pixels */
+typedef void (*_resample_line_func)(const dt_resampling_plan_t *const plan, const float *const in,
+                                    float *const out);
 
-// Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride_floats, out_stride_floats, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+static void _resample_line_4c_plain(const dt_resampling_plan_t *const plan, const float *const in,
+                                    float *const out)
+{
+  // the kernel and index arrays are walked in step
+  int hkidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
-
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+    const int hl = plan->length[ox];
+    dt_aligned_pixel_t vhs = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for(int ix = 0; ix < hl; ix++)
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      dt_aligned_pixel_t vs = { 0.0f, 0.0f, 0.0f, 0.0f };
+      // Apply the precomputed filter kernel
+      const size_t baseidx = (size_t)plan->index[hkidx] * 4;
+      const float htap = plan->kernel[hkidx++];
+      // Convince gcc 10 to vectorize
+      dt_aligned_pixel_t tmp = { in[baseidx], in[baseidx+1], in[baseidx+2], in[baseidx+3] };
+      for_four_channels(c, aligned(tmp,vhs:16)) vhs[c] += tmp[c] * htap;
+    }
+    copy_pixel(out + (size_t)4 * ox, vhs);
+  }
+}
 
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
+#if defined(__SSE2__)
+static void _resample_line_4c_sse(const dt_resampling_plan_t *const plan, const float *const in,
+                                  float *const out)
+{
+  int hkidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
+  {
+    const int hl = plan->length[ox];
+    __m128 vhs = _mm_setzero_ps();
+    for(int ix = 0; ix < hl; ix++)
+    {
+      const size_t baseidx = (size_t)plan->index[hkidx] * 4;
+      const __m128 vhtap = _mm_set_ps1(plan->kernel[hkidx++]);
+      vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128 *)&in[baseidx], vhtap));
+    }
+    _mm_store_ps(out + (size_t)4 * ox, vhs);
+  }
+}
+#endif
 
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        size_t baseidx_vindex = (size_t)vindex[viidx++] * in_stride_floats;
-
-        dt_aligned_pixel_t vhs = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          const size_t baseidx = baseidx_vindex + (size_t)hindex[hiidx++] * 4;
-          const float htap = hkernel[hkidx++];
-          // Convince gcc 10 to vectorize
-          dt_aligned_pixel_t tmp = { in[baseidx], in[baseidx+1], in[baseidx+2], in[baseidx+3] };
-          for_each_channel(c, aligned(tmp,vhs:16)) vhs[c] += tmp[c] * htap;
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        for_each_channel(c, aligned(vhs,vs:16)) vs[c] += vhs[c] * vtap;
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
+static void _resample_line_1c(const dt_resampling_plan_t *const plan, const float *const in, float *const out)
+{
+  int hkidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
+  {
+    const int hl = plan->length[ox];
+    float vhs = 0.0f;
+    for(int ix = 0; ix < hl; ix++)
+    {
+      vhs += in[plan->index[hkidx]] * plan->kernel[hkidx];
+      hkidx++;
+    }
+    out[ox] = vhs;
+  }
+}
 
-      // Output pixel is ready
-      const size_t baseidx = (size_t)oy * out_stride_floats + (size_t)ox * 4;
+/** Sums up vl horizontally resampled lines of n floats, weighted by the vertical filter taps, into a line of
+ * output. lines holds the consecutive lines starting at line number first. Negative results are clipped if
+ * clip is set. */
+typedef void (*_sum_lines_func)(float *const out, const float *const lines, const size_t n, const int first,
+                                const int *const index, const float *const taps, const int vl, const int clip);
 
+static void _sum_lines_plain(float *const out, const float *const lines, const size_t n, const int first,
+                             const int *const index, const float *const taps, const int vl, const int clip)
+{
+  // summed up in chunks small enough to stay in the L1 cache
+  for(size_t k0 = 0; k0 < n; k0 += RESAMPLING_CHUNK)
+  {
+    const size_t m = MIN(RESAMPLING_CHUNK, n - k0);
+    float DT_ALIGNED_ARRAY vs[RESAMPLING_CHUNK] = { 0.0f };
+    for(int iy = 0; iy < vl; iy++)
+    {
+      const float *const h = lines + (index[iy] - first) * n + k0;
+      const float vtap = taps[iy];
+#ifdef _OPENMP
+#pragma omp simd aligned(vs : 64)
+#endif
+      for(size_t k = 0; k < m; k++)
+        vs[k] += h[k] * vtap;
+    }
+    if(clip)
+    {
       // Clip negative RGB that may be produced by Lanczos undershooting
       // Negative RGB are invalid values no matter the RGB space (light is positive)
-      for_each_channel(c, aligned(vs:16)) out[baseidx + c] = fmaxf(vs[c], 0.f);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+#ifdef _OPENMP
+#pragma omp simd aligned(vs : 64)
+#endif
+      for(size_t k = 0; k < m; k++)
+        out[k0 + k] = MAX(vs[k], 0.f);
     }
+    else
+      memcpy(out + k0, vs, m * sizeof(float));
   }
+}
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_resampling = getts() - ts_resampling;
-  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
+#if defined(__SSE2__)
+static void _sum_lines_sse(float *const out, const float *const lines, const size_t n, const int first,
+                           const int *const index, const float *const taps, const int vl, const int clip)
+{
+  // all vertical taps of 16 output values are summed up in registers, keeping four independent sums in flight
+  const __m128 zero = _mm_setzero_ps();
+  size_t k = 0;
+  for(; k + 16 <= n; k += 16)
+  {
+    __m128 vs0 = zero, vs1 = zero, vs2 = zero, vs3 = zero;
+    for(int iy = 0; iy < vl; iy++)
+    {
+      const float *const h = lines + (index[iy] - first) * n + k;
+      const __m128 vtap = _mm_set_ps1(taps[iy]);
+      vs0 = _mm_add_ps(vs0, _mm_mul_ps(_mm_loadu_ps(h), vtap));
+      vs1 = _mm_add_ps(vs1, _mm_mul_ps(_mm_loadu_ps(h + 4), vtap));
+      vs2 = _mm_add_ps(vs2, _mm_mul_ps(_mm_loadu_ps(h + 8), vtap));
+      vs3 = _mm_add_ps(vs3, _mm_mul_ps(_mm_loadu_ps(h + 12), vtap));
+    }
+    if(clip)
+    {
+      vs0 = _mm_max_ps(vs0, zero);
+      vs1 = _mm_max_ps(vs1, zero);
+      vs2 = _mm_max_ps(vs2, zero);
+      vs3 = _mm_max_ps(vs3, zero);
+    }
+    _mm_storeu_ps(out + k, vs0);
+    _mm_storeu_ps(out + k + 4, vs1);
+    _mm_storeu_ps(out + k + 8, vs2);
+    _mm_storeu_ps(out + k + 12, vs3);
+  }
+  for(; k < n; k++)
+  {
+    float vs = 0.0f;
+    for(int iy = 0; iy < vl; iy++) vs += lines[(index[iy] - first) * n + k] * taps[iy];
+    out[k] = clip ? MAX(vs, 0.f) : vs;
+  }
+}
 #endif
 
-exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+// range of input lines needed for the output lines [oy0, oy1)
+static void _band_lines(const dt_resampling_plan_t *const vplan, const int oy0, const int oy1, int *first,
+                        int *last)
+{
+  int lo = INT_MAX;
+  int hi = -1;
+  for(int oy = oy0; oy < oy1; oy++)
+  {
+    const int viidx = vplan->meta[3 * oy + 2];
+    for(int iy = 0; iy < vplan->length[oy]; iy++)
+    {
+      lo = MIN(lo, vplan->index[viidx + iy]);
+      hi = MAX(hi, vplan->index[viidx + iy]);
+    }
+  }
+  *first = lo;
+  *last = hi;
 }
 
-#if defined(__SSE2__)
-static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, float *out,
-                                          const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                          const float *const in, const dt_iop_roi_t *const roi_in,
-                                          const int32_t in_stride)
+/** Resamples the image in two separable passes. Output lines are processed in bands: for each band, the input
+ * lines it needs are resampled horizontally into a per-thread buffer first, then every output line is the sum
+ * of a few of these lines, weighted by the vertical filter taps. This needs hl + vl instead of hl * vl
+ * multiply-adds per output pixel and the vertical pass runs along whole lines. The sums are accumulated in the
+ * same order as when filtering each output pixel on its own. */
+static void _resample_separable(const struct dt_interpolation *itor, float *out,
+                                const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                const float *const in, const dt_iop_roi_t *const roi_in,
+                                const int32_t in_stride, const int ch, _resample_line_func resample_line,
+                                _sum_lines_func sum_lines)
 {
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
-
-  int r;
+  const int32_t in_stride_floats = in_stride / sizeof(float);
+  const int32_t out_stride_floats = out_stride / sizeof(float);
 
   debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
              roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
@@ -1564,7 +1682,7 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   // Fast code path for 1:1 copy, only cropping area can change
   if(roi_out->scale == 1.f)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
+    const int x0 = roi_out->x * ch * sizeof(float);
 #if DEBUG_RESAMPLING_TIMING
     int64_t ts_resampling = getts();
 #endif
@@ -1575,9 +1693,9 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
     for(int y = 0; y < roi_out->height; y++)
     {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, out_stride);
+      memcpy((char *)out + (size_t)out_stride * y,
+             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
+             out_stride);
     }
 #if DEBUG_RESAMPLING_TIMING
     ts_resampling = getts() - ts_resampling;
@@ -1592,20 +1710,32 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   int64_t ts_plan = getts();
 #endif
 
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
+  float *lines = NULL;
+  dt_resampling_plan_t *hplan = _get_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width,
+                                                     roi_out->x, roi_out->scale);
+  dt_resampling_plan_t *vplan = _get_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height,
+                                                     roi_out->y, roi_out->scale);
+  if(!hplan || !vplan) goto exit;
+
+  /* Neighbouring bands need some of the same input lines, which get resampled twice. Make the bands a few
+   * filter lengths high to keep that cheap, but have at least one band per thread. */
+  const int nthreads = dt_get_num_threads();
+  const int band = MAX(1, MIN(8 * itor->width * (int)ceilf(MAX(1.f, roi_out->scale)),
+                              (roi_out->height + nthreads - 1) / nthreads));
+  const int nbands = (roi_out->height + band - 1) / band;
+
+  int maxlines = 0;
+  for(int b = 0; b < nbands; b++)
+  {
+    int first, last;
+    _band_lines(vplan, b * band, MIN(roi_out->height, (b + 1) * band), &first, &last);
+    maxlines = MAX(maxlines, last - first + 1);
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
-  {
-    goto exit;
-  }
+  const size_t line_floats = (size_t)roi_out->width * ch;
+  size_t padded_size;
+  lines = dt_alloc_perthread_float(maxlines * line_floats, &padded_size);
+  if(!lines) goto exit;
 
 #if DEBUG_RESAMPLING_TIMING
   ts_plan = getts() - ts_plan;
@@ -1615,95 +1745,65 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   int64_t ts_resampling = getts();
 #endif
 
-// Process each output line
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
+  dt_omp_firstprivate(in, out, in_stride_floats, out_stride_floats, ch, band, nbands, line_floats, roi_out) \
+  dt_omp_firstprivate(hplan, vplan, lines, padded_size, resample_line, sum_lines) \
+  schedule(static)
 #endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+  for(int b = 0; b < nbands; b++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    const int oy0 = b * band;
+    const int oy1 = MIN(roi_out->height, oy0 + band);
+    float *const hlines = dt_get_perthread(lines, padded_size);
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
+    // horizontal pass over the input lines this band needs
+    int first, last;
+    _band_lines(vplan, oy0, oy1, &first, &last);
+    for(int iy = first; iy <= last; iy++)
+      resample_line(hplan, in + (size_t)iy * in_stride_floats, hlines + (iy - first) * line_floats);
 
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+    // vertical pass, one output line at a time
+    for(int oy = oy0; oy < oy1; oy++)
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      __m128 vs = _mm_setzero_ps();
-
-      // Number of horizontal samples contributing to the output
-      const int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        __m128 vhs = _mm_setzero_ps();
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          const size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          const float htap = hkernel[hkidx++];
-          const __m128 vhtap = _mm_set_ps1(htap);
-          vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128 *)&i[baseidx], vhtap));
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        const __m128 vvtap = _mm_set_ps1(vtap);
-        vs = _mm_add_ps(vs, _mm_mul_ps(vhs, vvtap));
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
-
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-
-      // Clip negative RGB that may be produced by Lanczos undershooting
-      // Negative RGB are invalid values no matter the RGB space (light is positive)
-      vs = _mm_max_ps(vs, _mm_setzero_ps());
-      _mm_stream_ps(o, vs);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
+      debug_extra("output %p line %d\n", out, oy);
 
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+      const int vl = vplan->length[oy];
+      const int vkidx = vplan->meta[3 * oy + 1];
+      const int viidx = vplan->meta[3 * oy + 2];
+      sum_lines(out + (size_t)oy * out_stride_floats, hlines, line_floats, first, vplan->index + viidx,
+                vplan->kernel + vkidx, vl, ch == 4);
     }
   }
 
-  _mm_sfence();
-
 #if DEBUG_RESAMPLING_TIMING
   ts_resampling = getts() - ts_resampling;
   fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
 #endif
 
 exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  dt_free_align(lines);
+  _plan_unref(hplan);
+  _plan_unref(vplan);
+}
+
+static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
+                                            const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                            const float *const in, const dt_iop_roi_t *const roi_in,
+                                            const int32_t in_stride)
+{
+  _resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride, 4, _resample_line_4c_plain,
+                      _sum_lines_plain);
+}
+
+#if defined(__SSE2__)
+static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, float *out,
+                                          const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                          const float *const in, const dt_iop_roi_t *const roi_in,
+                                          const int32_t in_stride)
+{
+  _resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride, 4, _resample_line_4c_sse,
+                      _sum_lines_sse);
 }
 #endif
 
@@ -2001,156 +2101,20 @@ static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *it
                                                const float *const in, const dt_iop_roi_t *const roi_in,
                                                const int32_t in_stride)
 {
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
-
-  int r;
-
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
-
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
-  {
-    const int x0 = roi_out->x * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(in, in_stride, out_stride, roi_out, x0) \
-    shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
-    {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, out_stride);
-    }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
-  }
-
-  // Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
-
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
-  }
-
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
-  {
-    goto exit;
-  }
-
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
-
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
-
-  // Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
-  {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
-
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
-    {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      float vs = 0.0f;
-
-      // Number of horizontal samples contributing to the output
-      const int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        float vhs = 0.0f;
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          const size_t baseidx = (size_t)hindex[hiidx++];
-          const float htap = hkernel[hkidx++];
-          vhs += i[baseidx] * htap;
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        vs += vhs * vtap;
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
-
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * sizeof(float));
-      *o = vs;
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
-    }
-  }
-
-#if DEBUG_RESAMPLING_TIMING
-  ts_resampling = getts() - ts_resampling;
-  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
-#endif
+  _resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride, 1, _resample_line_1c,
+                      _sum_lines_plain);
+}
 
-  exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+#if defined(__SSE2__)
+static void dt_interpolation_resample_1c_sse(const struct dt_interpolation *itor, float *out,
+                                             const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                             const float *const in, const dt_iop_roi_t *const roi_in,
+                                             const int32_t in_stride)
+{
+  _resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride, 1, _resample_line_1c,
+                      _sum_lines_sse);
 }
+#endif
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
@@ -2160,7 +2124,14 @@ void dt_interpolation_resample_1c(const struct dt_interpolation *itor, float *ou
                                   const float *const in, const dt_iop_roi_t *const roi_in,
                                   const int32_t in_stride)
 {
-  return dt_interpolation_resample_1c_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+  if(darktable.codepath.OPENMP_SIMD)
+    return dt_interpolation_resample_1c_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+#if defined(__SSE2__)
+  else if(darktable.codepath.SSE2)
+    return dt_interpolation_resample_1c_sse(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+#endif
+  else
+    dt_unreachable_codepath();
 }
 
 /** Applies resampling (re-scaling) on a specific region-of-interest of an image. The input
@@ -570,7 +570,8 @@ void local_laplacian_internal(
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
     const int use_sse2,         // flag whether to use SSE version
-    local_laplacian_boundary_t *b)
+    local_laplacian_boundary_t *b,
+    local_laplacian_cache_t *c)
 {
   if(wd <= 1 || ht <= 1) return;
 
@@ -580,37 +581,61 @@ void local_laplacian_internal(
   if(b && b->mode == 2) // higher number here makes it less prone to aliasing and slower.
     last_level = num_levels > 4 ? 4 : num_levels-1;
   const int max_supp = 1<<last_level;
-  int w, h;
+  int w = 2*max_supp + wd, h = 2*max_supp + ht;
   float *padded[max_levels] = {0};
-  if(b && b->mode == 2)
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b);
+
+  // the input pyramid only depends on the input, so it can be kept around for the next call.
+  // the preview passes hand their padded buffer over to the boundary struct, don't cache them.
+  if(b && b->mode != 0) c = NULL;
+  if(c && c->num_levels && (!c->hash || c->hash != c->cached_hash || c->wd != wd || c->ht != ht))
+    local_laplacian_cache_free(c);
+  const gboolean cached = c && c->num_levels;
+
+  if(cached)
+  {
+    for(int l=0;l<=last_level;l++) padded[l] = c->padded[l];
+  }
   else
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0);
+  {
+    if(b && b->mode == 2)
+      padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b);
+    else
+      padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0);
 
-  // allocate pyramid pointers for padded input
-  for(int l=1;l<=last_level;l++)
-    padded[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
+    // allocate pyramid pointers for padded input
+    for(int l=1;l<=last_level;l++)
+      padded[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
+  }
 
   // allocate pyramid pointers for output
   float *output[max_levels] = {0};
   for(int l=0;l<=last_level;l++)
     output[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
 
-  // create gauss pyramid of padded input, write coarse directly to output
-#if defined(__SSE2__)
-  if(use_sse2)
+  // create gauss pyramid of padded input, unless we still have it
+  if(!cached)
   {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce_sse2(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce_sse2(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
-  }
-  else
+#if defined(__SSE2__)
+    if(use_sse2)
+      for(int l=1;l<=last_level;l++)
+        gauss_reduce_sse2(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
+    else
 #endif
-  {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
+      for(int l=1;l<=last_level;l++)
+        gauss_reduce(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
+  }
+  // the coarsest level is the start of the output pyramid
+  memcpy(output[last_level], padded[last_level], sizeof(float) * dl(w,last_level) * dl(h,last_level));
+
+  if(c && !cached && c->hash)
+  { // keep the input pyramid for the next call on the same input
+    for(int l=0;l<=last_level;l++) c->padded[l] = padded[l];
+    c->cached_hash = c->hash;
+    c->wd = wd;
+    c->ht = ht;
+    c->num_levels = last_level+1;
   }
+  const gboolean owns_padded = !c || !c->num_levels;
 
   // evenly sample brightness [0,1]:
   float gamma[num_gamma] = {0.0f};
@@ -759,7 +784,7 @@ void local_laplacian_internal(
   // free all buffers except the ones passed out for preview rendering
   for(int l=0;l<max_levels;l++)
   {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
+    if(owns_padded && (!b || b->mode != 1 || l)) dt_free_align(padded[l]);
     if(!b || b->mode != 1)        dt_free_align(output[l]);
     for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
   }
@@ -45,6 +45,28 @@ void local_laplacian_boundary_free(
   memset(b, 0, sizeof(*b));
 }
 
+// state kept between calls to skip work that only depends on the input,
+// i.e. when just the curve parameters changed
+typedef struct local_laplacian_cache_t
+{
+  uint64_t hash;           // set by caller: hash of the current input, 0 means unknown (don't reuse)
+  uint64_t cached_hash;    // hash of the input the pyramid below was built from
+  int wd;                  // input width
+  int ht;                  // input height
+  int num_levels;          // number of levels in the cached pyramid
+  float *padded[30];       // gaussian pyramid of the padded input (allocated via dt_alloc_align)
+}
+local_laplacian_cache_t;
+
+void local_laplacian_cache_free(
+    local_laplacian_cache_t *c)
+{
+  for(int l=0;l<c->num_levels;l++) dt_free_align(c->padded[l]);
+  memset(c->padded, 0, sizeof(c->padded));
+  c->cached_hash = 0;
+  c->num_levels = 0;
+}
+
 void local_laplacian_internal(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
@@ -56,7 +78,8 @@ void local_laplacian_internal(
     const float clarity,        // user param: increase clarity/local contrast
     const int use_sse2,         // switch on sse optimised version, if available
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
-    local_laplacian_boundary_t *b);
+    local_laplacian_boundary_t *b,
+    local_laplacian_cache_t *c); // can be 0
 
 void local_laplacian(
     const float *const input,   // input buffer in some Labx or yuvx format
@@ -67,9 +90,10 @@ void local_laplacian(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    local_laplacian_boundary_t *b) // can be 0
+    local_laplacian_boundary_t *b, // can be 0
+    local_laplacian_cache_t *c)    // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b, c);
 }
 
 size_t local_laplacian_memory_use(const int width,      // width of input image
@@ -90,8 +114,9 @@ void local_laplacian_sse2(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    local_laplacian_boundary_t *b) // can be 0
+    local_laplacian_boundary_t *b, // can be 0
+    local_laplacian_cache_t *c)    // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b, c);
 }
 #endif
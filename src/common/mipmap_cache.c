@@ -307,6 +307,60 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+static inline gboolean _use_disk_backend(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
+
+// decompress the thumbnail of the given size from the disk cache into buf, which has to be large enough
+// for that size. returns TRUE on success, a broken file is removed.
+static gboolean _read_disk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                     const dt_mipmap_size_t mip, uint8_t *buf, uint32_t *width,
+                                     uint32_t *height, dt_colorspaces_color_profile_type_t *color_space)
+{
+  gboolean loaded = FALSE;
+  char filename[PATH_MAX] = {0};
+  snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip, imgid);
+  FILE *f = g_fopen(filename, "rb");
+  if(f)
+  {
+    uint8_t *blob = 0;
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    if(len <= 0) goto read_error; // coverity madness
+    blob = (uint8_t *)dt_alloc_align(64, len);
+    if(!blob) goto read_error;
+    fseek(f, 0, SEEK_SET);
+    const int rd = fread(blob, sizeof(uint8_t), len, f);
+    if(rd != len) goto read_error;
+    dt_colorspaces_color_profile_type_t jpg_color_space;
+    dt_imageio_jpeg_t jpg;
+    if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
+       || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
+       || ((jpg_color_space = dt_imageio_jpeg_read_color_space(&jpg)) == DT_COLORSPACE_NONE) // pointless test to keep it in the if clause
+       || dt_imageio_jpeg_decompress(&jpg, buf))
+    {
+      fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from `%s'!\n",
+              imgid, filename);
+      goto read_error;
+    }
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip, imgid);
+    *width = jpg.width;
+    *height = jpg.height;
+    *color_space = jpg_color_space;
+    loaded = TRUE;
+    if(0)
+    {
+read_error:
+      g_unlink(filename);
+    }
+    dt_free_align(blob);
+    fclose(f);
+  }
+  return loaded;
+}
+
 // callback for the cache backend to initialize payload pointers
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -367,53 +421,19 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   assert(dsc->size >= sizeof(*dsc));
 
   int loaded_from_disk = 0;
-  if(mip < DT_MIPMAP_F)
+  if(mip < DT_MIPMAP_F && _use_disk_backend(cache, mip))
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    // try and load from disk, if successful set flag
+    uint32_t width = 0, height = 0;
+    dt_colorspaces_color_profile_type_t color_space;
+    if(_read_disk_thumbnail(cache, get_imgid(entry->key), mip, entry->data + sizeof(*dsc), &width, &height,
+                            &color_space))
     {
-      // try and load from disk, if successful set flag
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-               get_imgid(entry->key));
-      FILE *f = g_fopen(filename, "rb");
-      if(f)
-      {
-        uint8_t *blob = 0;
-        fseek(f, 0, SEEK_END);
-        const long len = ftell(f);
-        if(len <= 0) goto read_error; // coverity madness
-        blob = (uint8_t *)dt_alloc_align(64, len);
-        if(!blob) goto read_error;
-        fseek(f, 0, SEEK_SET);
-        const int rd = fread(blob, sizeof(uint8_t), len, f);
-        if(rd != len) goto read_error;
-        dt_colorspaces_color_profile_type_t color_space;
-        dt_imageio_jpeg_t jpg;
-        if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
-           || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
-           || ((color_space = dt_imageio_jpeg_read_color_space(&jpg)) == DT_COLORSPACE_NONE) // pointless test to keep it in the if clause
-           || dt_imageio_jpeg_decompress(&jpg, entry->data + sizeof(*dsc)))
-        {
-          fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from `%s'!\n",
-                  get_imgid(entry->key), filename);
-          goto read_error;
-        }
-        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip,
-                 get_imgid(entry->key));
-        dsc->width = jpg.width;
-        dsc->height = jpg.height;
-        dsc->iscale = 1.0f;
-        dsc->color_space = color_space;
-        loaded_from_disk = 1;
-        if(0)
-        {
-read_error:
-          g_unlink(filename);
-        }
-        dt_free_align(blob);
-        fclose(f);
-      }
+      dsc->width = width;
+      dsc->height = height;
+      dsc->iscale = 1.0f;
+      dsc->color_space = color_space;
+      loaded_from_disk = 1;
     }
   }
 
@@ -1030,6 +1050,67 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
   }
 }
 
+// load the full image into a buffer owned by the caller instead of the full cache. on success, buf->buf
+// points into entry->data, which has to be freed with dt_free_align(). on failure buf->buf is NULL.
+static void _open_full_uncached(const uint32_t imgid, const char *filename, dt_cache_entry_t *entry,
+                                dt_mipmap_buffer_t *buf)
+{
+  dt_image_t buffered_image;
+  const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  buffered_image = *cimg;
+  dt_image_cache_read_release(darktable.image_cache, cimg);
+
+  // dt_mipmap_cache_alloc() only needs the payload of the entry
+  memset(entry, 0, sizeof(dt_cache_entry_t));
+  entry->data = (void *)dt_mipmap_cache_static_dead_image;
+  buf->cache_entry = entry;
+  buf->imgid = imgid;
+  buf->size = DT_MIPMAP_FULL;
+  buf->buf = NULL;
+  buf->width = buf->height = 0;
+  buf->iscale = 0.0f;
+  buf->color_space = DT_COLORSPACE_NONE;
+
+  const dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf);
+  if((void *)entry->data == (void *)dt_mipmap_cache_static_dead_image)
+  {
+    buf->buf = NULL;
+    return;
+  }
+  if(ret != DT_IMAGEIO_OK)
+  {
+    dt_free_align(entry->data);
+    entry->data = (void *)dt_mipmap_cache_static_dead_image;
+    buf->buf = NULL;
+    return;
+  }
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] load image %d for mip %d without caching the full buffer\n", imgid,
+           DT_MIPMAP_F);
+
+  // swap back new image data, like for the cached full buffer
+  dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
+  *img = buffered_image;
+  dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  buf->width = dsc->width;
+  buf->height = dsc->height;
+  buf->iscale = dsc->iscale;
+  buf->buf = (uint8_t *)(dsc + 1);
+}
+
+// a full buffer left behind by a failed load has no size or is the dead image, it can't be downscaled as the
+// image. a buffer which is usable has the dimensions of the image.
+static gboolean _full_buffer_usable(const dt_mipmap_buffer_t *buf, const uint32_t imgid)
+{
+  if(!buf->buf || buf->width <= 0 || buf->height <= 0) return FALSE;
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  const gboolean usable = buf->width == image->width && buf->height == image->height;
+  dt_image_cache_read_release(darktable.image_cache, image);
+  return usable;
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width, uint32_t *height, float *iscale,
                     const uint32_t imgid)
 {
@@ -1046,8 +1127,15 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
     return;
   }
 
+  // use the full buffer if somebody already has it in the cache. otherwise decode into a private buffer
+  // which is dropped right after binning: the full cache only has room for a few images, and regenerating
+  // a lot of thumbnails would otherwise evict the ones actually in use, e.g. by darkroom.
   dt_mipmap_buffer_t buf;
-  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  dt_cache_entry_t uncached_entry;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_TESTLOCK, 'r');
+  if(buf.buf && !_full_buffer_usable(&buf, imgid)) dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  const gboolean uncached = !buf.buf;
+  if(uncached) _open_full_uncached(imgid, filename, &uncached_entry, &buf);
 
   // lock image after we have the buffer, we might need to lock the image struct for
   // writing during raw loading, to write to width/height.
@@ -1116,7 +1204,10 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
     dt_iop_clip_and_zoom(out, (const float *)buf.buf, &roi_out, &roi_in, roi_out.width, roi_in.width);
   }
 
-  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  if(uncached)
+    dt_free_align(uncached_entry.data);
+  else
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   *width = roi_out.width;
   *height = roi_out.height;
@@ -1217,8 +1308,28 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     else
     {
       uint8_t *tmp = 0;
-      int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+      int32_t thumb_width, thumb_height, full_width, full_height;
+      // look for the preview ourselves first, exiv2 would parse all the metadata and decode the jpg at full
+      // size. the box is in the orientation of the stored jpg.
+      const gboolean swap_xy = orientation & ORIENTATION_SWAP_XY;
+      const int box_width = swap_xy ? ht : wd, box_height = swap_xy ? wd : ht;
+      res = dt_imageio_embedded_thumbnail(filename, box_width, box_height, &tmp, &thumb_width, &thumb_height,
+                                          &full_width, &full_height);
+      if(!res && full_width < box_width && full_height < box_height)
+      {
+        // exiv2 might know of a larger one, e.g. in the maker notes
+        dt_free_align(tmp);
+        tmp = NULL;
+        res = 1;
+      }
+      if(!res)
+        *color_space = DT_COLORSPACE_SRGB;
+      else
+      {
+        res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+        full_width = thumb_width;
+        full_height = thumb_height;
+      }
       if(!res)
       {
         // if the thumbnail is not large enough, we compute one
@@ -1226,7 +1337,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
         const int imgwd = img2->width;
         const int imght = img2->height;
         dt_image_cache_read_release(darktable.image_cache, img2);
-        if(thumb_width < wd && thumb_height < ht && thumb_width < imgwd - 4 && thumb_height < imght - 4)
+        if(full_width < wd && full_height < ht && full_width < imgwd - 4 && full_height < imght - 4)
         {
           res = 1;
         }
@@ -1253,7 +1364,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
       dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", size, imgid, k);
       *color_space = tmp.color_space;
       // downsample
-      dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
+      dt_iop_downsample_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, width, height);
 
       dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
       res = 0;
@@ -1261,6 +1372,30 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     }
   }
 
+  if(res)
+  {
+    // no larger mip in memory, but maybe one of them is in the disk cache. decoding that is still a lot
+    // cheaper than running the pipe, so only the largest size requested needs to be processed.
+    // mips are removed from both caches whenever the history changes, so any of them is up to date.
+    const dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+    for(dt_mipmap_size_t k = size + 1; k < DT_MIPMAP_8 && res; k++)
+    {
+      if(!_use_disk_backend(cache, k)) continue;
+      uint8_t *tmp = dt_alloc_align(64, (size_t)cache->max_width[k] * cache->max_height[k] * 4);
+      uint32_t tmp_width = 0, tmp_height = 0;
+      dt_colorspaces_color_profile_type_t tmp_color_space;
+      if(tmp && _read_disk_thumbnail(cache, imgid, k, tmp, &tmp_width, &tmp_height, &tmp_color_space))
+      {
+        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d on disk\n", size,
+                 imgid, k);
+        *color_space = tmp_color_space;
+        dt_iop_downsample_8(tmp, tmp_width, tmp_height, buf, wd, ht, width, height);
+        res = 0;
+      }
+      dt_free_align(tmp);
+    }
+  }
+
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
@@ -1302,7 +1437,6 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
   }
 
   // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
   // TODO: use mipf, but:
   // TODO: if output is cropped, don't use mipf!
 }
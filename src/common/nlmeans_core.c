@@ -197,6 +197,39 @@ static inline float pixel_difference_sse2(const float* const pix1, const float*
 }
 #endif /* __SSE2__ */
 
+#if defined(__SSE2__)
+// sum up the first three channels of four pixels at once, giving one lane per pixel
+static inline __m128 sum_channels_sse2(__m128 px0, __m128 px1, __m128 px2, __m128 px3)
+{
+  _MM_TRANSPOSE4_PS(px0, px1, px2, px3);
+  return px0 + px1 + px2;
+}
+#endif /* __SSE2__ */
+
+#if defined(__SSE2__)
+// compute gh() for four values at once, with the same result as the scalar version
+static inline __m128 gh_sse2(const __m128 f)
+{
+  const __m128i k0 = _mm_add_epi32(_mm_set1_epi32(0x3f800000),
+                                   _mm_cvttps_epi32(f * _mm_set1_ps(0x3f000000 - 0x3f800000)));
+  return _mm_castsi128_ps(_mm_and_si128(k0, _mm_cmpgt_epi32(k0, _mm_set1_epi32(0x7fffff))));
+}
+#endif /* __SSE2__ */
+
+#if defined(__SSE2__)
+// add the weighted patch-center pixels of four consecutive columns to the output
+static inline void accumulate_sse2(__m128 *const out, const float *const inpx, const __m128 wt)
+{
+  const __m128 one = { 0.0f, 0.0f, 0.0f, 1.0f };
+  const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  for (int i = 0; i < 4; i++)
+  {
+    const __m128 pixel = _mm_or_ps(_mm_and_ps(_mm_load_ps(inpx + 4*i), mask), one);
+    out[i] += pixel * _mm_set1_ps(wt[i]);
+  }
+}
+#endif /* __SSE2__ */
+
 #if defined(CACHE_PIXDIFFS) || defined(CACHE_PIXDIFFS_SSE)
 static inline float get_pixdiff(const float *const col_sums, const int radius, const int row, const int col)
 {
@@ -493,12 +526,13 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
           else
           {
             // computation as used by denoiseprofiled iop with non-local means
+            const float dissimilarity_scale = sharpness / (1.0f + params->center_weight);
             for (int col = col_min; col < col_max; col++)
             {
               distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
               const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
-                                           / (1.0f + params->center_weight);
-              const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
+                                          * dissimilarity_scale;
+              const float wt = gh(fmaxf(0.0f, dissimilarity - 2.0f));
               const float *const inpx = in + 4*col;
               const dt_aligned_pixel_t pixel = { inpx[offset],  inpx[offset+1], inpx[offset+2], 1.0f };
               for_four_channels(c,aligned(pixel,out:16))
@@ -698,32 +732,62 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
           __m128 *const out = (__m128*)outbuf + (size_t)width * row;
           const int offset = patch->offset;
           const float sharpness = params->sharpness;
+          // the distortions and weights of four columns are computed at once; the running sum of the sliding
+          //   window is extended over the four columns by a prefix sum
           if (params->center_weight < 0)
           {
             // computation as used by denoise(non-local) iop
-            for (int col = col_min; col < col_max; col++)
+            int col = col_min;
+            for ( ; col + 4 <= col_max; col += 4)
+            {
+              __m128 dist = _mm_loadu_ps(col_sums+col+radius) - _mm_loadu_ps(col_sums+col-radius-1);
+              dist += _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(dist), 4));
+              dist += _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(dist), 8));
+              dist += _mm_set1_ps(distortion);
+              distortion = dist[3];
+              accumulate_sse2(out+col, in+4*col+offset, gh_sse2(dist * _mm_set1_ps(sharpness)));
+              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
+            }
+            for ( ; col < col_max; col++)
             {
               distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
               const __m128 wt = _mm_set1_ps(gh(distortion * sharpness));
               __m128 pixel = _mm_load_ps(in+4*col+offset);
               pixel[3] = 1.0f;
               out[col] += (pixel * wt);
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
             }
           }
           else
           {
             // computation as used by denoiseprofiled iop with non-local means
-            for (int col = col_min; col < col_max; col++)
+            const float dissimilarity_scale = sharpness / (1.0f + params->center_weight);
+            int col = col_min;
+            for ( ; col + 4 <= col_max; col += 4)
+            {
+              __m128 dist = _mm_loadu_ps(col_sums+col+radius) - _mm_loadu_ps(col_sums+col-radius-1);
+              dist += _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(dist), 4));
+              dist += _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(dist), 8));
+              dist += _mm_set1_ps(distortion);
+              distortion = dist[3];
+              const float *const inpx = in + 4*col;
+              const __m128 center = sum_channels_sse2(channel_difference_sse2(inpx,inpx+offset,center_norm),
+                                                      channel_difference_sse2(inpx+4,inpx+4+offset,center_norm),
+                                                      channel_difference_sse2(inpx+8,inpx+8+offset,center_norm),
+                                                      channel_difference_sse2(inpx+12,inpx+12+offset,center_norm));
+              const __m128 dissimilarity = (dist + center) * _mm_set1_ps(dissimilarity_scale);
+              const __m128 wt = gh_sse2(_mm_max_ps(_mm_setzero_ps(), dissimilarity - _mm_set1_ps(2.0f)));
+              accumulate_sse2(out+col, inpx+offset, wt);
+              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0); // try to ensure next row is ready in time
+            }
+            for ( ; col < col_max; col++)
             {
               distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
               const float dissimilarity = (distortion + pixel_difference_sse2(in+4*col,in+4*col+offset,center_norm))
-                                           / (1.0f + params->center_weight);
-              const __m128 wt = _mm_set1_ps(gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f)));
+                                          * dissimilarity_scale;
+              const __m128 wt = _mm_set1_ps(gh(fmaxf(0.0f, dissimilarity - 2.0f)));
               __m128 pixel = _mm_load_ps(in+4*col+offset);
               pixel[3] = 1.0f;
               out[col] += (pixel * wt);
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0); // try to ensure next row is ready in time
             }
           }
           const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
@@ -751,7 +815,24 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
 #endif /* !CACHE_PIXDIFFS_SSE */
             const float *const bot_row = inbuf + (row+1+radius)*stride ;
             // both prior and new positions are entirely within the RoI, so subtract the old row and add the new one
-            for (int col = pcol_min; col < pcol_max; col++)
+            int col = pcol_min;
+#ifndef CACHE_PIXDIFFS_SSE
+            // update four column sums at once
+            for ( ; col + 4 <= pcol_max; col += 4)
+            {
+              const float *const top_px = top_row + 4*col;
+              const float *const bot_px = bot_row + 4*col;
+              __m128 dif[4];
+              for (int i = 0; i < 4; i++)
+                dif[i] = (channel_difference_sse2(bot_px+4*i,bot_px+4*i+offset,params->norm)
+                          - channel_difference_sse2(top_px+4*i,top_px+4*i+offset,params->norm));
+              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
+              const __m128 sums = sum_channels_sse2(dif[0],dif[1],dif[2],dif[3]);
+              _mm_storeu_ps(col_sums+col, _mm_loadu_ps(col_sums+col) + sums);
+              _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
+            }
+#endif /* !CACHE_PIXDIFFS_SSE */
+            for ( ; col < pcol_max; col++)
             {
 #ifdef CACHE_PIXDIFFS_SSE
               const float *const bot_px = bot_row + 4*col;
@@ -0,0 +1,236 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/scratch_pool.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#include <string.h>
+
+// smaller buffers are cheap enough to get from the allocator every time
+#define DT_SCRATCH_MIN_POOLED ((size_t)1 << 20)
+
+// every buffer is preceded by a header, keeping the returned memory 64 byte aligned
+#define DT_SCRATCH_HEADER_SIZE 64
+
+typedef struct dt_scratch_header_t
+{
+  dt_scratch_pool_t *pool; // NULL if the buffer doesn't belong to a pool
+  size_t capacity;         // usable bytes following the header
+} dt_scratch_header_t;
+
+struct dt_scratch_pool_t
+{
+  dt_pthread_mutex_t lock;
+  gint refcount;    // owners and handed out buffers
+  gchar *name;
+  GList *idle;      // dt_scratch_header_t of released buffers, most recent first
+  size_t max_idle;
+  gboolean shared;  // the one handed out by dt_scratch_pool_get_shared()
+  size_t in_use, idle_size, peak; // bytes handed out, kept for recycling and the maximum of both
+  uint64_t requests, reused;      // allocations big enough to be pooled, and those served by recycling
+};
+
+static GPrivate _current_pool;
+
+// the shared pool, without a reference of its own. it goes away with its last user.
+static GMutex _shared_lock;
+static dt_scratch_pool_t *_shared_pool = NULL;
+
+static inline void *_header_to_mem(dt_scratch_header_t *header)
+{
+  return (char *)header + DT_SCRATCH_HEADER_SIZE;
+}
+
+static inline dt_scratch_header_t *_mem_to_header(void *mem)
+{
+  return (dt_scratch_header_t *)((char *)mem - DT_SCRATCH_HEADER_SIZE);
+}
+
+static dt_scratch_header_t *_new_buffer(dt_scratch_pool_t *pool, const size_t capacity)
+{
+  dt_scratch_header_t *header = dt_alloc_align(64, capacity + DT_SCRATCH_HEADER_SIZE);
+  if(!header) return NULL;
+  header->pool = pool;
+  header->capacity = capacity;
+  return header;
+}
+
+// drop idle buffers, oldest first. must be called with the lock held.
+static void _trim_locked(dt_scratch_pool_t *pool, const size_t max_idle)
+{
+  while(pool->idle_size > max_idle && pool->idle)
+  {
+    GList *oldest = g_list_last(pool->idle);
+    dt_scratch_header_t *header = (dt_scratch_header_t *)oldest->data;
+    pool->idle_size -= header->capacity;
+    pool->idle = g_list_delete_link(pool->idle, oldest);
+    dt_free_align(header);
+  }
+}
+
+static void _destroy(dt_scratch_pool_t *pool)
+{
+  dt_print(DT_DEBUG_MEMORY, "[scratch_pool] `%s': %" G_GUINT64_FORMAT " requests, %" G_GUINT64_FORMAT
+                            " reused (%.0f%%), peak %.1f MB\n",
+           pool->name, pool->requests, pool->reused,
+           pool->requests ? 100.0 * pool->reused / pool->requests : 0.0, pool->peak / (1024.0 * 1024.0));
+
+  _trim_locked(pool, 0);
+  dt_pthread_mutex_destroy(&pool->lock);
+  g_free(pool->name);
+  free(pool);
+}
+
+dt_scratch_pool_t *dt_scratch_pool_new(const char *name, const size_t max_idle)
+{
+  dt_scratch_pool_t *pool = calloc(1, sizeof(dt_scratch_pool_t));
+  if(!pool) return NULL;
+  dt_pthread_mutex_init(&pool->lock, NULL);
+  pool->refcount = 1;
+  pool->name = g_strdup(name);
+  pool->max_idle = max_idle;
+  return pool;
+}
+
+dt_scratch_pool_t *dt_scratch_pool_ref(dt_scratch_pool_t *pool)
+{
+  if(pool) g_atomic_int_inc(&pool->refcount);
+  return pool;
+}
+
+dt_scratch_pool_t *dt_scratch_pool_get_shared(const size_t max_idle)
+{
+  g_mutex_lock(&_shared_lock);
+  if(_shared_pool)
+    dt_scratch_pool_ref(_shared_pool);
+  else if((_shared_pool = dt_scratch_pool_new("shared", max_idle)))
+    _shared_pool->shared = TRUE;
+  dt_scratch_pool_t *pool = _shared_pool;
+  g_mutex_unlock(&_shared_lock);
+  return pool;
+}
+
+void dt_scratch_pool_unref(dt_scratch_pool_t *pool)
+{
+  if(!pool) return;
+  if(!pool->shared)
+  {
+    if(g_atomic_int_dec_and_test(&pool->refcount)) _destroy(pool);
+    return;
+  }
+  // don't let dt_scratch_pool_get_shared() pick up a pool on its way out
+  g_mutex_lock(&_shared_lock);
+  const gboolean last = g_atomic_int_dec_and_test(&pool->refcount);
+  if(last) _shared_pool = NULL;
+  g_mutex_unlock(&_shared_lock);
+  if(last) _destroy(pool);
+}
+
+dt_scratch_pool_t *dt_scratch_pool_set_current(dt_scratch_pool_t *pool)
+{
+  dt_scratch_pool_t *previous = g_private_get(&_current_pool);
+  g_private_set(&_current_pool, pool);
+  return previous;
+}
+
+dt_scratch_pool_t *dt_scratch_pool_get_current(void)
+{
+  return g_private_get(&_current_pool);
+}
+
+void *dt_scratch_alloc(const size_t size)
+{
+  const size_t capacity = dt_round_size(MAX(size, 1), 64);
+  dt_scratch_pool_t *pool = g_private_get(&_current_pool);
+
+  if(!pool || capacity < DT_SCRATCH_MIN_POOLED)
+  {
+    dt_scratch_header_t *header = _new_buffer(NULL, capacity);
+    return header ? _header_to_mem(header) : NULL;
+  }
+
+  dt_pthread_mutex_lock(&pool->lock);
+  pool->requests++;
+
+  // best fit among the idle buffers, as long as not more than a quarter of it is wasted
+  GList *best = NULL;
+  for(GList *l = pool->idle; l; l = g_list_next(l))
+  {
+    const dt_scratch_header_t *header = (dt_scratch_header_t *)l->data;
+    if(header->capacity >= capacity && header->capacity - capacity <= header->capacity / 4
+       && (!best || header->capacity < ((dt_scratch_header_t *)best->data)->capacity))
+      best = l;
+  }
+
+  dt_scratch_header_t *header = NULL;
+  if(best)
+  {
+    header = (dt_scratch_header_t *)best->data;
+    pool->idle = g_list_delete_link(pool->idle, best);
+    pool->idle_size -= header->capacity;
+    pool->reused++;
+  }
+  else
+  {
+    header = _new_buffer(pool, capacity);
+    if(!header)
+    {
+      // make room by giving back what we keep and try again
+      _trim_locked(pool, 0);
+      header = _new_buffer(pool, capacity);
+    }
+  }
+
+  if(header)
+  {
+    pool->in_use += header->capacity;
+    pool->peak = MAX(pool->peak, pool->in_use + pool->idle_size);
+    // handed out buffers keep the pool alive
+    g_atomic_int_inc(&pool->refcount);
+  }
+  dt_pthread_mutex_unlock(&pool->lock);
+
+  return header ? _header_to_mem(header) : NULL;
+}
+
+void dt_scratch_free(void *mem)
+{
+  if(!mem) return;
+
+  dt_scratch_header_t *header = _mem_to_header(mem);
+  dt_scratch_pool_t *pool = header->pool;
+  if(!pool)
+  {
+    dt_free_align(header);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&pool->lock);
+  pool->in_use -= header->capacity;
+  pool->idle_size += header->capacity;
+  pool->idle = g_list_prepend(pool->idle, header);
+  _trim_locked(pool, pool->max_idle);
+  dt_pthread_mutex_unlock(&pool->lock);
+
+  dt_scratch_pool_unref(pool);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,57 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+/**
+ * pool of large, 64 byte aligned scratch buffers, recycled instead of going through mmap() and page faults
+ * for every image. the pixelpipes share one pool, made current in the thread running the pipe.
+ * dt_scratch_alloc() falls back to plain allocation in threads without a pool, e.g. OpenMP workers. its
+ * memory must be released with dt_scratch_free(), from any thread.
+ */
+
+typedef struct dt_scratch_pool_t dt_scratch_pool_t;
+
+// create a new pool, keeping at most max_idle bytes of released buffers. the name is used in debug output.
+dt_scratch_pool_t *dt_scratch_pool_new(const char *name, const size_t max_idle);
+dt_scratch_pool_t *dt_scratch_pool_ref(dt_scratch_pool_t *pool);
+// get a reference to the pool shared by the pixelpipes, creating it if nobody uses it right now. max_idle
+// only applies when it is created.
+dt_scratch_pool_t *dt_scratch_pool_get_shared(const size_t max_idle);
+// the pool goes away once the last reference is dropped and all its buffers have been released
+void dt_scratch_pool_unref(dt_scratch_pool_t *pool);
+
+// make the pool the current one of the calling thread, returns the previous one. pass NULL to unset.
+dt_scratch_pool_t *dt_scratch_pool_set_current(dt_scratch_pool_t *pool);
+dt_scratch_pool_t *dt_scratch_pool_get_current(void);
+
+// allocate a 64 byte aligned buffer, preferably from the current pool of the calling thread
+void *dt_scratch_alloc(const size_t size);
+void dt_scratch_free(void *mem);
+
+static inline float *dt_scratch_alloc_float(const size_t nfloats)
+{
+  return (float *)__builtin_assume_aligned(dt_scratch_alloc(nfloats * sizeof(float)), 64);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
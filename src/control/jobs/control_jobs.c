@@ -29,6 +29,7 @@
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/scratch_pool.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "common/grouping.h"
@@ -1335,6 +1336,10 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   // get a thread-safe fdata struct (one jpeg struct per thread etc):
   dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
 
+  // keep the shared pool alive while the job runs, so scratch buffers are recycled from image to image
+  dt_scratch_pool_t *scratch = dt_scratch_pool_get_shared((size_t)dt_conf_get_int("scratch_pool_size") << 20);
+  dt_scratch_pool_t *prev_scratch = dt_scratch_pool_set_current(scratch);
+
   if(mstorage->initialize_store)
   {
     if(mstorage->initialize_store(mstorage, sdata, &mformat, &fdata, &t, settings->high_quality, settings->upscale))
@@ -1443,6 +1448,9 @@ end:
   // all threads free their fdata
   mformat->free_params(mformat, fdata);
 
+  dt_scratch_pool_set_current(prev_scratch);
+  dt_scratch_pool_unref(scratch);
+
   // notify the user via the window manager
   dt_ui_notify_user();
 
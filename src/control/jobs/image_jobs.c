@@ -62,6 +62,102 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
   return job;
 }
 
+typedef struct dt_image_prefetch_t
+{
+  int32_t imgid;
+  gint generation;
+} dt_image_prefetch_t;
+
+// bumped to drop all pending prefetch jobs
+static gint _prefetch_generation = 0;
+
+static gboolean _prefetch_cancelled(const dt_image_prefetch_t *params)
+{
+  return g_atomic_int_get(&_prefetch_generation) != params->generation;
+}
+
+// upper bound of what a buffer of this image costs in the cache, 0 if we can't tell yet
+static size_t _prefetch_cost(const int32_t imgid, const dt_mipmap_size_t mip)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  if(mip == DT_MIPMAP_F) return cache->buffer_size[DT_MIPMAP_F];
+
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return 0;
+  // the widest full buffer is 4 floats per pixel
+  const size_t cost = (size_t)img->width * img->height * 4 * sizeof(float);
+  dt_image_cache_read_release(darktable.image_cache, img);
+  return cost;
+}
+
+// true if the buffer fits without pushing the cache over the point where dt_cache_get() starts evicting
+static gboolean _prefetch_room(const dt_mipmap_size_t mip, const size_t cost)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  dt_cache_t *c = mip == DT_MIPMAP_FULL ? &cache->mip_full.cache : &cache->mip_f.cache;
+  dt_pthread_mutex_lock(&c->lock);
+  const gboolean room = c->cost + cost <= 0.8f * c->cost_quota;
+  dt_pthread_mutex_unlock(&c->lock);
+  return room;
+}
+
+// load a buffer if it isn't cached yet, but only if that doesn't push other buffers out of the cache.
+// returns TRUE if the buffer is cached afterwards.
+static gboolean _prefetch_mip(const int32_t imgid, const dt_mipmap_size_t mip)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+  if(buf.buf)
+  {
+    dt_mipmap_cache_release(cache, &buf);
+    return TRUE;
+  }
+
+  // unknown size (never loaded before): don't risk evicting what the user is looking at
+  const size_t cost = _prefetch_cost(imgid, mip);
+  if(!cost || !_prefetch_room(mip, cost)) return FALSE;
+
+  dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_BLOCKING, 'r');
+  const gboolean loaded = buf.buf != NULL;
+  dt_mipmap_cache_release(cache, &buf);
+  return loaded;
+}
+
+static int32_t dt_image_prefetch_job_run(dt_job_t *job)
+{
+  dt_image_prefetch_t *params = dt_control_job_get_params(job);
+
+  // the full buffer first, mip_f is then downscaled from it instead of loading the image again.
+  // without it mip_f would load the full buffer itself, bypassing the room check above.
+  if(_prefetch_cancelled(params)) return 0;
+  if(!_prefetch_mip(params->imgid, DT_MIPMAP_FULL)) return 0;
+  if(_prefetch_cancelled(params)) return 0;
+  _prefetch_mip(params->imgid, DT_MIPMAP_F);
+  return 0;
+}
+
+dt_job_t *dt_image_prefetch_job_create(int32_t id)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_prefetch_job_run, "prefetch image %d", id);
+  if(!job) return NULL;
+  dt_image_prefetch_t *params = (dt_image_prefetch_t *)calloc(1, sizeof(dt_image_prefetch_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  dt_control_job_set_params(job, params, free);
+  params->imgid = id;
+  params->generation = g_atomic_int_get(&_prefetch_generation);
+  return job;
+}
+
+void dt_image_prefetch_cancel(void)
+{
+  g_atomic_int_inc(&_prefetch_generation);
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
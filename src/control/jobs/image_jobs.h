@@ -25,6 +25,12 @@
 
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
 
+// speculatively load the full and mip_f buffers of an image which is likely to be opened next, as long as
+// there is room for them in the mipmap cache
+dt_job_t *dt_image_prefetch_job_create(int32_t imgid);
+// drop pending prefetch jobs, running ones stop after the buffer they are loading
+void dt_image_prefetch_cancel(void);
+
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
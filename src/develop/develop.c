@@ -83,9 +83,13 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->form_visible = NULL;
   dev->form_gui = NULL;
   dev->allforms = NULL;
+  dev->masks_raster_cache = NULL;
 
   if(dev->gui_attached)
   {
+    const int cache_size = dt_conf_get_int("masks_raster_cache_size");
+    if(cache_size > 0) dev->masks_raster_cache = dt_masks_raster_cache_new((size_t)cache_size << 20);
+
     dev->pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
     dev->preview_pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
     dev->preview2_pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
@@ -187,6 +191,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
 
   g_list_free_full(dev->forms, (void (*)(void *))dt_masks_free_form);
   g_list_free_full(dev->allforms, (void (*)(void *))dt_masks_free_form);
+  dt_masks_raster_cache_free(dev->masks_raster_cache);
 
   dt_conf_set_int("darkroom/ui/rawoverexposed/mode", dev->rawoverexposed.mode);
   dt_conf_set_int("darkroom/ui/rawoverexposed/colorscheme", dev->rawoverexposed.colorscheme);
@@ -718,6 +723,9 @@ void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid)
 
   dev->image_status = dev->preview_status = dev->preview2_status = DT_DEV_PIXELPIPE_DIRTY;
 
+  // the shapes of the previous image are of no use anymore
+  dt_masks_raster_cache_clear(dev->masks_raster_cache);
+
   // we need a global lock as the dev->iop set must not be changed until read history is terminated
   dt_pthread_mutex_lock(&darktable.dev_threadsafe);
   dev->iop = dt_iop_load_modules(dev);
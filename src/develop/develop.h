@@ -208,6 +208,8 @@ typedef struct dt_develop_t
   struct dt_masks_form_gui_t *form_gui;
   // all forms to be linked here for cleanup:
   GList *allforms;
+  // rasterized shapes, reused while neither they nor the distortions before them change
+  struct dt_masks_raster_cache_t *masks_raster_cache;
 
   //full preview stuff
   int full_preview;
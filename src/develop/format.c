@@ -39,11 +39,50 @@ size_t dt_iop_buffer_dsc_to_bpp(const struct dt_iop_buffer_dsc_t *dsc)
   return bpp;
 }
 
+gboolean dt_iop_buffer_dsc_is_legacy(const struct dt_iop_buffer_dsc_t *dsc)
+{
+  return dsc->layout == LAYOUT_INTERLEAVED && dsc->channels != 3;
+}
+
+int dt_iop_buffer_convert_layout(void *out, const struct dt_iop_buffer_dsc_t *out_dsc, const void *in,
+                                 const struct dt_iop_buffer_dsc_t *in_dsc, const size_t width,
+                                 const size_t height)
+{
+  if(in_dsc->datatype != TYPE_FLOAT || out_dsc->datatype != TYPE_FLOAT
+     || in_dsc->channels < 3 || in_dsc->channels > 4 || out_dsc->channels < 3 || out_dsc->channels > 4
+     || (in_dsc->layout == LAYOUT_PLANAR && in_dsc->channels != 3)
+     || (out_dsc->layout == LAYOUT_PLANAR && out_dsc->channels != 3))
+    return 1;
+
+  // value c of pixel k is at [c * plane + k * stride]
+  const size_t npixels = width * height;
+  const size_t in_stride = in_dsc->layout == LAYOUT_PLANAR ? 1 : in_dsc->channels;
+  const size_t in_plane = in_dsc->layout == LAYOUT_PLANAR ? npixels : 1;
+  const size_t out_stride = out_dsc->layout == LAYOUT_PLANAR ? 1 : out_dsc->channels;
+  const size_t out_plane = out_dsc->layout == LAYOUT_PLANAR ? npixels : 1;
+  const gboolean alpha = out_dsc->channels == 4;
+  const float *const restrict inp = (const float *)in;
+  float *const restrict outp = (float *)out;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(inp, outp, npixels, in_stride, in_plane, out_stride, out_plane, alpha) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    for(int c = 0; c < 3; c++) outp[c * out_plane + k * out_stride] = inp[c * in_plane + k * in_stride];
+    if(alpha) outp[k * 4 + 3] = 0.0f;
+  }
+  return 0;
+}
+
 void default_input_format(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece,
                           dt_iop_buffer_dsc_t *dsc)
 {
   dsc->channels = 4;
   dsc->datatype = TYPE_FLOAT;
+  dsc->layout = LAYOUT_INTERLEAVED;
   dsc->cst = self->input_colorspace(self, pipe, piece);
 
   if(dsc->cst != iop_cs_RAW) return;
@@ -62,6 +101,7 @@ void default_output_format(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_d
 {
   dsc->channels = 4;
   dsc->datatype = TYPE_FLOAT;
+  dsc->layout = LAYOUT_INTERLEAVED;
   dsc->cst = self->output_colorspace(self, pipe, piece);
 
   if(dsc->cst != iop_cs_RAW) return;
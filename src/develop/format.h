@@ -32,12 +32,19 @@ typedef enum dt_iop_buffer_type_t {
   TYPE_UINT16,
 } dt_iop_buffer_type_t;
 
+typedef enum dt_iop_buffer_layout_t {
+  LAYOUT_INTERLEAVED, // the channels of a pixel are next to each other
+  LAYOUT_PLANAR,      // one plane of width * height values per channel
+} dt_iop_buffer_layout_t;
+
 typedef struct dt_iop_buffer_dsc_t
 {
-  /** how many channels the data has? 1 or 4 */
+  /** how many channels the data has? 1 or 4, or 3 for modules which don't need the fourth channel */
   unsigned int channels;
   /** what is the datatype? */
   dt_iop_buffer_type_t datatype;
+  /** how are the channels arranged? only 3 channel float buffers can be planar */
+  dt_iop_buffer_layout_t layout;
   /** Bayer demosaic pattern */
   uint32_t filters;
   /** filter for Fuji X-Trans images, only used if filters == 9u */
@@ -65,6 +72,18 @@ typedef struct dt_iop_buffer_dsc_t
 
 size_t dt_iop_buffer_dsc_to_bpp(const struct dt_iop_buffer_dsc_t *dsc);
 
+/** the buffers every module can deal with: 1 or 4 interleaved channels. modules which want 3 channels,
+ * interleaved or planar, ask for them in input_format() and output_format() and have to look at
+ * piece->dsc_in and piece->dsc_out in process(), the pipe falls back to 4 channels where it needs them.
+ * the pipe asks more than once, the answer must only depend on the module and its parameters. */
+gboolean dt_iop_buffer_dsc_is_legacy(const struct dt_iop_buffer_dsc_t *dsc);
+
+/** convert float buffers of width * height pixels between 4 channels, 3 channels and 3 planes.
+ * the fourth channel is set to 0 if it is added. returns 1 if the layouts can't be converted. */
+int dt_iop_buffer_convert_layout(void *out, const struct dt_iop_buffer_dsc_t *out_dsc, const void *in,
+                                 const struct dt_iop_buffer_dsc_t *in_dsc, const size_t width,
+                                 const size_t height);
+
 void default_input_format(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_t *pipe,
                           struct dt_dev_pixelpipe_iop_t *piece, struct dt_iop_buffer_dsc_t *dsc);
 
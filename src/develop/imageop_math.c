@@ -90,6 +90,59 @@ void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *
   }
 }
 
+void dt_iop_downsample_8(const uint8_t *const in, const int32_t iw, const int32_t ih, uint8_t *const out,
+                         const int32_t ow, const int32_t oh, uint32_t *width, uint32_t *height)
+{
+  // same output size as dt_iop_flip_and_zoom_8() without flipping
+  const float scale = fmaxf(1.0, fmaxf(iw / (float)ow, ih / (float)oh));
+  const uint32_t wd = *width = MIN(ow, iw / scale);
+  const uint32_t ht = *height = MIN(oh, ih / scale);
+  if(wd == 0 || ht == 0) return;
+
+  size_t padded_size;
+  uint32_t *const rows = dt_alloc_perthread(4 * iw, sizeof(uint32_t), &padded_size);
+  if(!rows)
+  {
+    dt_iop_flip_and_zoom_8(in, iw, ih, out, ow, oh, ORIENTATION_NONE, width, height);
+    return;
+  }
+
+  // every output pixel is the average of all input pixels within its footprint. the input rows of one
+  // output row are summed up first, which runs over contiguous memory and vectorizes well.
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, iw, ih, wd, ht, scale, rows, padded_size) \
+  schedule(static)
+#endif
+  for(uint32_t j = 0; j < ht; j++)
+  {
+    uint32_t *const acc = dt_get_perthread(rows, padded_size);
+    const int32_t y0 = MIN(ih - 1, (int32_t)(scale * j));
+    const int32_t y1 = MIN(ih, MAX(y0 + 1, (int32_t)(scale * (j + 1))));
+    const uint8_t *const first = in + (size_t)4 * iw * y0;
+    for(size_t k = 0; k < (size_t)4 * iw; k++) acc[k] = first[k];
+    for(int32_t y = y0 + 1; y < y1; y++)
+    {
+      const uint8_t *const row = in + (size_t)4 * iw * y;
+      for(size_t k = 0; k < (size_t)4 * iw; k++) acc[k] += row[k];
+    }
+
+    uint8_t *const out_row = out + (size_t)4 * wd * j;
+    for(uint32_t i = 0; i < wd; i++)
+    {
+      const int32_t x0 = MIN(iw - 1, (int32_t)(scale * i));
+      const int32_t x1 = MIN(iw, MAX(x0 + 1, (int32_t)(scale * (i + 1))));
+      uint32_t sum[4] = { 0, 0, 0, 0 };
+      for(int32_t x = x0; x < x1; x++)
+        for(int c = 0; c < 4; c++) sum[c] += acc[4 * x + c];
+      const uint32_t n = (uint32_t)(x1 - x0) * (y1 - y0);
+      for(int c = 0; c < 4; c++) out_row[4 * i + c] = (sum[c] + n / 2) / n;
+    }
+  }
+
+  dt_free_align(rows);
+}
+
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw,
                             int32_t ibh, uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh,
                             int32_t obw, int32_t obh)
@@ -36,6 +36,11 @@
 void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow, int32_t oh,
                             const dt_image_orientation_t orientation, uint32_t *width, uint32_t *height);
 
+/** downsample to fit the given size, averaging all input pixels under each output pixel. slower than
+ * dt_iop_flip_and_zoom_8, but without aliasing, for deriving thumbnails from larger ones. */
+void dt_iop_downsample_8(const uint8_t *const in, const int32_t iw, const int32_t ih, uint8_t *const out,
+                         const int32_t ow, const int32_t oh, uint32_t *width, uint32_t *height);
+
 /** for homebrew pixel pipe: zoom pixel array. */
 void dt_iop_clip_and_zoom(float *out, const float *const in, const struct dt_iop_roi_t *const roi_out,
                           const struct dt_iop_roi_t *const roi_in, const int32_t out_stride,
@@ -323,6 +323,18 @@ static inline int dt_masks_get_mask_roi(const dt_iop_module_t *const module, con
   return form->functions ? form->functions->get_mask_roi(module, piece, form, roi, buffer) : 0;
 }
 
+/** cache of rasterized shapes, shared by the pipes of an interactive develop.
+ * entries are keyed by image, form id, shape parameters, the distortions applied before the module and the
+ * roi, and evicted least recently used first once max_size bytes are exceeded */
+typedef struct dt_masks_raster_cache_t dt_masks_raster_cache_t;
+dt_masks_raster_cache_t *dt_masks_raster_cache_new(const size_t max_size);
+void dt_masks_raster_cache_free(dt_masks_raster_cache_t *cache);
+/** drop all rasters, e.g. when the develop moves on to another image */
+void dt_masks_raster_cache_clear(dt_masks_raster_cache_t *cache);
+/** same as dt_masks_get_mask_roi(), but reuses the raster of an unchanged shape from the cache of the develop */
+int dt_masks_get_mask_roi_cached(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                                 dt_masks_form_t *const form, const dt_iop_roi_t *roi, float *buffer);
+
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
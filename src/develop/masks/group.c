@@ -607,7 +607,7 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
     {
       // ensure that we start with a zeroed buffer regardless of what was previously written into 'bufs'
       memset(bufs, 0, npixels*sizeof(float));
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
+      const int ok = dt_masks_get_mask_roi_cached(module, piece, sel, roi, bufs);
       const float op = fpt->opacity;
       const int state = fpt->state;
 
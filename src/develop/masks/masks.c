@@ -2386,6 +2386,236 @@ void dt_masks_calculate_source_pos_value(dt_masks_form_gui_t *gui, const int mas
   *py = y;
 }
 
+typedef struct dt_masks_raster_t
+{
+  int formid;
+  uint64_t form_hash;    // shape parameters
+  uint64_t distort_hash; // distortions before the module and size of the pipe input
+  dt_iop_roi_t roi;
+  int ok;                // what the shape's get_mask_roi() returned
+  int x, y;              // bounding box of the non-zero pixels, relative to the roi
+  int width, height;
+  float *mask;           // raster of the bounding box, NULL if all of the roi is zero
+} dt_masks_raster_t;
+
+struct dt_masks_raster_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GList *lru;            // dt_masks_raster_t, most recently used first
+  size_t size;           // bytes used by the rasters
+  size_t max_size;
+  uint64_t hits, misses;
+};
+
+static inline size_t _raster_size(const dt_masks_raster_t *r)
+{
+  return sizeof(float) * r->width * r->height;
+}
+
+static void _raster_free(gpointer data)
+{
+  dt_masks_raster_t *r = (dt_masks_raster_t *)data;
+  dt_free_align(r->mask);
+  free(r);
+}
+
+dt_masks_raster_cache_t *dt_masks_raster_cache_new(const size_t max_size)
+{
+  dt_masks_raster_cache_t *cache = calloc(1, sizeof(dt_masks_raster_cache_t));
+  if(!cache) return NULL;
+  dt_pthread_mutex_init(&cache->lock, NULL);
+  cache->max_size = max_size;
+  return cache;
+}
+
+void dt_masks_raster_cache_free(dt_masks_raster_cache_t *cache)
+{
+  if(!cache) return;
+  dt_print(DT_DEBUG_MASKS, "[masks raster cache] %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n",
+           cache->hits, cache->misses);
+  g_list_free_full(cache->lru, _raster_free);
+  dt_pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+void dt_masks_raster_cache_clear(dt_masks_raster_cache_t *cache)
+{
+  if(!cache) return;
+  dt_pthread_mutex_lock(&cache->lock);
+  g_list_free_full(cache->lru, _raster_free);
+  cache->lru = NULL;
+  cache->size = 0;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+static uint64_t _form_hash(dt_masks_form_t *form)
+{
+  const int length = dt_masks_group_get_hash_buffer_length(form);
+  char *const str = malloc(length);
+  if(!str) return 0;
+  dt_masks_group_get_hash_buffer(form, str);
+  uint64_t hash = 5381;
+  for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
+  free(str);
+  return hash;
+}
+
+static uint64_t _distort_hash(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece)
+{
+  dt_develop_t *dev = module->dev;
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  // the shapes are transformed through all distorting modules up to and including this one
+  uint64_t hash = dt_dev_hash_distort_plus(dev, pipe, module->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  // ... starting from the input of the pipe's image, minus the modules hidden by the focused one.
+  // form ids survive copying the history to another image, so the image is part of the key.
+  const float scales[2] = { pipe->iscale, dev->preview_downsampling };
+  const int dims[4] = { pipe->image.id, pipe->iwidth, pipe->iheight, pipe->type };
+  const uintptr_t filter = dev->gui_module && dev->gui_module->operation_tags_filter()
+                           ? (uintptr_t)dev->gui_module : 0;
+  const char *str = (const char *)scales;
+  for(size_t i = 0; i < sizeof(scales); i++) hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)dims;
+  for(size_t i = 0; i < sizeof(dims); i++) hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)&filter;
+  for(size_t i = 0; i < sizeof(filter); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static inline gboolean _same_roi(const dt_iop_roi_t *a, const dt_iop_roi_t *b)
+{
+  return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height && a->scale == b->scale;
+}
+
+// find the bounding box of the non-zero pixels of the roi sized buffer
+static void _raster_bounding_box(const float *const buffer, const int width, const int height, int *x0, int *y0,
+                                 int *x1, int *y1)
+{
+  int xmin = width, ymin = height, xmax = -1, ymax = -1;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, width, height) \
+  reduction(min : xmin, ymin) reduction(max : xmax, ymax) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const float *const row = buffer + (size_t)j * width;
+    int first = 0;
+    while(first < width && row[first] == 0.0f) first++;
+    if(first == width) continue;
+    int last = width - 1;
+    while(row[last] == 0.0f) last--;
+    xmin = MIN(xmin, first);
+    xmax = MAX(xmax, last);
+    ymin = MIN(ymin, j);
+    ymax = MAX(ymax, j);
+  }
+  *x0 = xmin;
+  *y0 = ymin;
+  *x1 = xmax;
+  *y1 = ymax;
+}
+
+// copy the cached raster into the zeroed roi sized buffer
+static void _raster_paste(const dt_masks_raster_t *r, float *const buffer)
+{
+  const int width = r->roi.width;
+  for(int j = 0; j < r->height; j++)
+    memcpy(buffer + (size_t)(r->y + j) * width + r->x, r->mask + (size_t)j * r->width, sizeof(float) * r->width);
+}
+
+int dt_masks_get_mask_roi_cached(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                                 dt_masks_form_t *const form, const dt_iop_roi_t *roi, float *buffer)
+{
+  dt_masks_raster_cache_t *cache = module->dev->masks_raster_cache;
+  // groups depend on their members, which are cached on their own
+  if(!cache || !form->functions || (form->type & DT_MASKS_GROUP))
+    return dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+
+  const double start = dt_get_wtime();
+  const uint64_t form_hash = _form_hash(form);
+  const uint64_t distort_hash = _distort_hash(module, piece);
+
+  dt_pthread_mutex_lock(&cache->lock);
+  for(GList *l = cache->lru; l; l = g_list_next(l))
+  {
+    dt_masks_raster_t *r = (dt_masks_raster_t *)l->data;
+    if(r->formid == form->formid && r->form_hash == form_hash && r->distort_hash == distort_hash
+       && _same_roi(&r->roi, roi))
+    {
+      _raster_paste(r, buffer);
+      const int ok = r->ok;
+      cache->lru = g_list_remove_link(cache->lru, l);
+      cache->lru = g_list_concat(l, cache->lru);
+      cache->hits++;
+      dt_pthread_mutex_unlock(&cache->lock);
+
+      if(darktable.unmuted & DT_DEBUG_PERF)
+        dt_print(DT_DEBUG_MASKS, "[masks %d] cached raster took %0.04f sec\n", form->formid,
+                 dt_get_wtime() - start);
+      return ok;
+    }
+  }
+  cache->misses++;
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  const int ok = dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+
+  dt_masks_raster_t *r = calloc(1, sizeof(dt_masks_raster_t));
+  if(!r) return ok;
+  r->formid = form->formid;
+  r->form_hash = form_hash;
+  r->distort_hash = distort_hash;
+  r->roi = *roi;
+  r->ok = ok;
+  int x0, y0, x1, y1;
+  _raster_bounding_box(buffer, roi->width, roi->height, &x0, &y0, &x1, &y1);
+  if(x1 >= x0)
+  {
+    r->x = x0;
+    r->y = y0;
+    r->width = x1 - x0 + 1;
+    r->height = y1 - y0 + 1;
+    if(_raster_size(r) > cache->max_size / 4 || !(r->mask = dt_alloc_align_float((size_t)r->width * r->height)))
+    {
+      // not worth squeezing out everything else
+      free(r);
+      return ok;
+    }
+    for(int j = 0; j < r->height; j++)
+      memcpy(r->mask + (size_t)j * r->width, buffer + (size_t)(r->y + j) * roi->width + r->x,
+             sizeof(float) * r->width);
+  }
+
+  dt_pthread_mutex_lock(&cache->lock);
+  // drop what this shape looked like before it got edited
+  for(GList *l = cache->lru; l;)
+  {
+    dt_masks_raster_t *o = (dt_masks_raster_t *)l->data;
+    GList *next = g_list_next(l);
+    if(o->formid == r->formid && o->distort_hash == distort_hash && _same_roi(&o->roi, roi))
+    {
+      cache->size -= _raster_size(o);
+      cache->lru = g_list_delete_link(cache->lru, l);
+      _raster_free(o);
+    }
+    l = next;
+  }
+  cache->lru = g_list_prepend(cache->lru, r);
+  cache->size += _raster_size(r);
+  while(cache->size > cache->max_size)
+  {
+    GList *oldest = g_list_last(cache->lru);
+    dt_masks_raster_t *o = (dt_masks_raster_t *)oldest->data;
+    cache->size -= _raster_size(o);
+    cache->lru = g_list_delete_link(cache->lru, oldest);
+    _raster_free(o);
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+
+  return ok;
+}
+
 #include "detail.c"
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
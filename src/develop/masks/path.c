@@ -2701,6 +2701,131 @@ static int _path_crop_to_roi(float *path, const int point_count, float xmin, flo
   return 1;
 }
 
+// pixel where the path edge from (xstart, ystart) to (xend, yend), ystart <= yend, crosses row yy
+static inline int _path_edge_crossing(const float xstart, const float ystart, const float m, const int yy)
+{
+  const float xcross = xstart + m * (yy - ystart);
+  int xx = floorf(xcross);
+  if((float)xx + 0.5f <= xcross) xx++;
+  return xx;
+}
+
+/** fill the inside of the closed path in the roi sized buffer, which is all zeros. edges are walked once to
+    collect where they cross each row, then every row is filled span by span, so the cost is proportional to
+    the edge length plus the filled area. crossings toggle, i.e. a pixel crossed twice doesn't start a span.
+    the spans include both their first and last crossing and are limited to the given window; crossings
+    outside of it only flag their own pixel. */
+static int _path_fill_scanlines(float *const buffer, const float *const path, const int count, const int width,
+                                const int height, const int xxmin, const int xxmax, const int yymin,
+                                const int yymax)
+{
+  int *const offsets = dt_calloc_align(64, sizeof(int) * (height + 1));
+  if(offsets == NULL) return 0;
+
+  // first pass counts the crossings in each row, the second one stores them
+  int *crossings = NULL;
+  for(int pass = 0; pass < 2; pass++)
+  {
+    float xlast = path[(count - 1) * 2];
+    float ylast = path[(count - 1) * 2 + 1];
+    for(int i = 0; i < count; i++)
+    {
+      float xstart = xlast;
+      float ystart = ylast;
+      float xend = xlast = path[i * 2];
+      float yend = ylast = path[i * 2 + 1];
+
+      if(ystart > yend)
+      {
+        float tmp;
+        tmp = ystart, ystart = yend, yend = tmp;
+        tmp = xstart, xstart = xend, xend = tmp;
+      }
+
+      const float m = (xstart - xend) / (ystart - yend); // we don't need special handling of ystart==yend
+                                                         // as following loop will take care
+      for(int yy = (int)ceilf(ystart); (float)yy < yend; yy++)
+      {
+        const int xx = _path_edge_crossing(xstart, ystart, m, yy);
+        if(xx < 0 || xx >= width || yy < 0 || yy >= height)
+          continue; // sanity check just to be on the safe side
+
+        if(pass == 0)
+          offsets[yy + 1]++;
+        else
+          crossings[offsets[yy]++] = xx;
+      }
+    }
+
+    if(pass == 0)
+    {
+      for(int yy = 0; yy < height; yy++) offsets[yy + 1] += offsets[yy];
+      crossings = dt_alloc_align(64, sizeof(int) * MAX(offsets[height], 1));
+      if(crossings == NULL)
+      {
+        dt_free_align(offsets);
+        return 0;
+      }
+    }
+  }
+  // the second pass moved every offset to the start of the next row
+  for(int yy = height; yy > 0; yy--) offsets[yy] = offsets[yy - 1];
+  offsets[0] = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, crossings, offsets, width, height, xxmin, xxmax, yymin, yymax) \
+  schedule(dynamic, 16)
+#endif
+  for(int yy = 0; yy < height; yy++)
+  {
+    int *const row = crossings + offsets[yy];
+    const int n = offsets[yy + 1] - offsets[yy];
+    if(n == 0) continue;
+    float *const line = buffer + (size_t)yy * width;
+
+    // insertion sort, there are only a few crossings per row
+    for(int k = 1; k < n; k++)
+    {
+      const int v = row[k];
+      int j = k - 1;
+      for(; j >= 0 && row[j] > v; j--) row[j + 1] = row[j];
+      row[j + 1] = v;
+    }
+
+    const gboolean inside_rows = yy >= yymin && yy <= yymax;
+    int start = -1;
+    for(int k = 0; k < n;)
+    {
+      // pixels crossed an even number of times don't toggle
+      const int xx = row[k];
+      int times = 0;
+      for(; k < n && row[k] == xx; k++) times++;
+      if(!(times & 1)) continue;
+
+      if(!inside_rows || xx < xxmin || xx > xxmax)
+      {
+        line[xx] = 1.0f;
+        continue;
+      }
+      if(start < 0)
+        start = xx;
+      else
+      {
+        for(int x = start; x <= xx; x++) line[x] = 1.0f;
+        start = -1;
+      }
+    }
+    // an unterminated span runs to the end of the window
+    if(start >= 0)
+      for(int x = start; x <= xxmax; x++) line[x] = 1.0f;
+  }
+
+  dt_free_align(crossings);
+  dt_free_align(offsets);
+  return 1;
+}
+
 /** we write a falloff segment respecting limits of buffer */
 static void _path_falloff_roi(float *buffer, int *p0, int *p1, int bw, int bh)
 {
@@ -2913,84 +3038,24 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
     else
     {
       // all other cases
-
-      // edge-flag polygon fill: we write all the point around the path into the buffer
-      float xlast = cpoints[(points_count - 1) * 2];
-      float ylast = cpoints[(points_count - 1) * 2 + 1];
-
-      for(int i = nb_corner * 3; i < points_count; i++)
-      {
-        float xstart = xlast;
-        float ystart = ylast;
-
-        float xend = xlast = cpoints[i * 2];
-        float yend = ylast = cpoints[i * 2 + 1];
-
-        if(ystart > yend)
-        {
-          float tmp;
-          tmp = ystart, ystart = yend, yend = tmp;
-          tmp = xstart, xstart = xend, xend = tmp;
-        }
-
-        const float m = (xstart - xend) / (ystart - yend); // we don't need special handling of ystart==yend
-                                                           // as following loop will take care
-
-        for(int yy = (int)ceilf(ystart); (float)yy < yend;
-            yy++) // this would normally never touch the last roi line => see comment further above
-        {
-          const float xcross = xstart + m * (yy - ystart);
-
-          int xx = floorf(xcross);
-          if((float)xx + 0.5f <= xcross) xx++;
-
-          if(xx < 0 || xx >= width || yy < 0 || yy >= height)
-            continue; // sanity check just to be on the safe side
-
-          const size_t index = (size_t)yy * width + xx;
-
-          buffer[index] = 1.0f - buffer[index];
-        }
-      }
-
-      if(darktable.unmuted & DT_DEBUG_PERF)
-      {
-        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill draw path took %0.04f sec\n", form->name,
-                 dt_get_wtime() - start2);
-        start2 = dt_get_wtime();
-      }
-
-      // we fill the inside plain
       // we don't need to deal with parts of shape outside of roi
       const int xxmin = MAX(xmin, 0);
       const int xxmax = MIN(xmax, width - 1);
       const int yymin = MAX(ymin, 0);
       const int yymax = MIN(ymax, height - 1);
 
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(xxmin, xxmax, yymin, yymax, width) \
-  shared(buffer) schedule(static) num_threads(MIN(8,darktable.num_openmp_threads))
-#else
-#pragma omp parallel for shared(buffer)
-#endif
-#endif
-      for(int yy = yymin; yy <= yymax; yy++)
+      if(!_path_fill_scanlines(buffer, cpoints + 2 * (nb_corner * 3), points_count - nb_corner * 3, width, height,
+                               xxmin, xxmax, yymin, yymax))
       {
-        int state = 0;
-        for(int xx = xxmin; xx <= xxmax; xx++)
-        {
-          const size_t index = (size_t)yy * width + xx;
-          const float v = buffer[index];
-          if(v > 0.5f) state = !state;
-          if(state) buffer[index] = 1.0f;
-        }
+        dt_free_align(cpoints);
+        dt_free_align(points);
+        dt_free_align(border);
+        return 0;
       }
 
       if(darktable.unmuted & DT_DEBUG_PERF)
       {
-        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill fill plain took %0.04f sec\n", form->name,
+        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill scanlines took %0.04f sec\n", form->name,
                  dt_get_wtime() - start2);
         start2 = dt_get_wtime();
       }
@@ -3042,6 +3107,11 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
         p1[1] = pf1[1] = border[next * 2 + 1];
       }
 
+      // segments which can't touch the roi are skipped, one pixel of margin accounts for the gap filling
+      if(MAX(p0[0], p1[0]) < -1 || MIN(p0[0], p1[0]) > width || MAX(p0[1], p1[1]) < -1
+         || MIN(p0[1], p1[1]) > height)
+        continue;
+
       // and we draw the falloff
       if(last0[0] != p0[0] || last0[1] != p0[1] || last1[0] != p1[0] || last1[1] != p1[1])
       {
@@ -22,6 +22,111 @@
 #include "libs/lib.h"
 #include "libs/colorpicker.h"
 #include <stdlib.h>
+#include <string.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// largest finite half float
+#define DT_HALF_MAX 65504.0f
+// elements converted per omp work item
+#define DT_HALF_BLOCK 65536
+
+// float to half float rounding to nearest even, and back, both without hardware support.
+// see https://gist.github.com/rygorous/2156668
+static inline uint16_t _float_to_half(const float f)
+{
+  union { float f; uint32_t u; } v = { .f = f };
+  const uint32_t sign = v.u & 0x80000000u;
+  v.u ^= sign;
+  uint32_t h;
+  if(v.u >= (127 + 16) << 23)
+    h = v.u > 255u << 23 ? 0x7e00 : 0x7c00; // nan, or inf
+  else if(v.u < 113 << 23)
+  {
+    // subnormal or zero, let the fpu do the rounding
+    const union { uint32_t u; float f; } magic = { .u = 126 << 23 };
+    v.f += magic.f;
+    h = v.u - magic.u;
+  }
+  else
+  {
+    const uint32_t mant_odd = (v.u >> 13) & 1;
+    v.u += ((uint32_t)(15 - 127) << 23) + 0xfff + mant_odd;
+    h = v.u >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const uint32_t shifted_exp = 0x7c00 << 13;
+  union { uint32_t u; float f; } v = { .u = (uint32_t)(h & 0x7fff) << 13 };
+  const uint32_t exp = v.u & shifted_exp;
+  v.u += (127 - 15) << 23;
+  if(exp == shifted_exp)
+    v.u += (128 - 16) << 23; // inf or nan
+  else if(exp == 0)
+  {
+    // subnormal
+    const union { uint32_t u; float f; } magic = { .u = 113 << 23 };
+    v.u += 1 << 23;
+    v.f -= magic.f;
+  }
+  v.u |= (uint32_t)(h & 0x8000) << 16;
+  return v.f;
+}
+
+static void _pack_block(uint16_t *const out, const float *const in, const size_t n)
+{
+  size_t i = 0;
+#if defined(__F16C__)
+  const __m256 max = _mm256_set1_ps(DT_HALF_MAX);
+  const __m256 min = _mm256_set1_ps(-DT_HALF_MAX);
+  for(; i + 8 <= n; i += 8)
+  {
+    const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), min), max);
+    _mm_storeu_si128((__m128i *)(out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for(; i < n; i++) out[i] = _float_to_half(CLAMPS(in[i], -DT_HALF_MAX, DT_HALF_MAX));
+}
+
+static void _unpack_block(float *const out, const uint16_t *const in, const size_t n)
+{
+  size_t i = 0;
+#if defined(__F16C__)
+  for(; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + i))));
+#endif
+  for(; i < n; i++) out[i] = _half_to_float(in[i]);
+}
+
+void dt_dev_pixelpipe_cache_pack(uint16_t *const out, const float *const in, const size_t n)
+{
+  const size_t blocks = (n + DT_HALF_BLOCK - 1) / DT_HALF_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(out, in, n, blocks) schedule(static)
+#endif
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t start = b * DT_HALF_BLOCK;
+    _pack_block(out + start, in + start, MIN(n - start, DT_HALF_BLOCK));
+  }
+}
+
+void dt_dev_pixelpipe_cache_unpack(float *const out, const uint16_t *const in, const size_t n)
+{
+  const size_t blocks = (n + DT_HALF_BLOCK - 1) / DT_HALF_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(out, in, n, blocks) schedule(static)
+#endif
+  for(size_t b = 0; b < blocks; b++)
+  {
+    const size_t start = b * DT_HALF_BLOCK;
+    _unpack_block(out + start, in + start, MIN(n - start, DT_HALF_BLOCK));
+  }
+}
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -45,6 +150,16 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
   cache->basichash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->filled = (size_t *)calloc(entries, sizeof(size_t));
+  cache->hits = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->packed_entries = 0;
+  cache->packed = NULL;
+  cache->packed_size = NULL;
+  cache->packed_dsc = NULL;
+  cache->packed_basichash = NULL;
+  cache->packed_hash = NULL;
+  cache->packed_used = NULL;
+  cache->packed_budget = 0;
   for(int k = 0; k < entries; k++)
   {
     cache->size[k] = size;
@@ -62,7 +177,7 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     cache->hash[k] = -1;
     cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
+  cache->queries = cache->misses = cache->unpacked = 0;
   return 1;
 
 alloc_memory_fail:
@@ -80,6 +195,48 @@ alloc_memory_fail:
   return 0;
 }
 
+// the budget for packed lines is shared by all caches, bytes of half floats kept by all of them
+static GMutex _packed_lock;
+static size_t _packed_total = 0;
+
+static void _drop_packed(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(cache->packed[k])
+  {
+    g_mutex_lock(&_packed_lock);
+    _packed_total -= cache->packed_size[k] / 2;
+    g_mutex_unlock(&_packed_lock);
+  }
+  dt_free_align(cache->packed[k]);
+  cache->packed[k] = NULL;
+  cache->packed_size[k] = 0;
+  cache->packed_basichash[k] = -1;
+  cache->packed_hash[k] = -1;
+}
+
+void dt_dev_pixelpipe_cache_set_packed_budget(dt_dev_pixelpipe_cache_t *cache, const size_t budget)
+{
+  if(budget && !cache->packed_entries)
+  {
+    // the budget decides how many lines really are kept
+    const int entries = 2 * cache->entries;
+    cache->packed = (uint16_t **)calloc(entries, sizeof(uint16_t *));
+    cache->packed_size = (size_t *)calloc(entries, sizeof(size_t));
+    cache->packed_dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+    cache->packed_basichash = (uint64_t *)calloc(entries, sizeof(uint64_t));
+    cache->packed_hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
+    cache->packed_used = (int32_t *)calloc(entries, sizeof(int32_t));
+    if(!cache->packed || !cache->packed_size || !cache->packed_dsc || !cache->packed_basichash
+       || !cache->packed_hash || !cache->packed_used)
+      return;
+    cache->packed_entries = entries;
+    for(int k = 0; k < entries; k++) _drop_packed(cache, k);
+  }
+  for(int k = 0; k < cache->packed_entries; k++)
+    if(cache->packed_size[k] / 2 > budget) _drop_packed(cache, k);
+  cache->packed_budget = budget;
+}
+
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
@@ -89,6 +246,15 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->filled);
+  free(cache->hits);
+  for(int k = 0; k < cache->packed_entries; k++) _drop_packed(cache, k);
+  free(cache->packed);
+  free(cache->packed_size);
+  free(cache->packed_dsc);
+  free(cache->packed_basichash);
+  free(cache->packed_hash);
+  free(cache->packed_used);
 }
 
 uint64_t dt_dev_pixelpipe_cache_basichash(int imgid, struct dt_dev_pixelpipe_t *pipe, int module)
@@ -167,12 +333,74 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
   return hash;
 }
 
+static int _find_packed(const dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  for(int k = 0; k < cache->packed_entries; k++)
+    if(cache->packed_hash[k] == hash) return k;
+  return -1;
+}
+
+// keep line k as half floats before it gets overwritten, if it has been reused and fits into the budget.
+// only 4 channel color lines are packed: raw data and masks need more precision than 11 bits near black.
+// the packed line keep is about to be restored and must not make room for it.
+static void _pack_line(dt_dev_pixelpipe_cache_t *cache, const int k, const int keep)
+{
+  const size_t size = cache->filled[k];
+  const size_t packed_size = size / 2;
+  if(!cache->packed_entries || cache->hash[k] == (uint64_t)-1 || cache->hits[k] == 0 || !cache->data[k]
+     || cache->dsc[k].datatype != TYPE_FLOAT || cache->dsc[k].channels != 4 || cache->dsc[k].filters
+     || cache->dsc[k].cst == iop_cs_RAW || !size || size % sizeof(float) || packed_size > cache->packed_budget
+     || _find_packed(cache, cache->hash[k]) >= 0)
+    return;
+
+  // make room among our own lines, least recently used first
+  int slot = -1;
+  while(TRUE)
+  {
+    int lru = -1, empty = -1;
+    for(int p = 0; p < cache->packed_entries; p++)
+    {
+      if(!cache->packed[p])
+        empty = p;
+      else if(p != keep && (lru < 0 || cache->packed_used[p] > cache->packed_used[lru]))
+        lru = p;
+    }
+    g_mutex_lock(&_packed_lock);
+    const gboolean room = empty >= 0 && _packed_total + packed_size <= cache->packed_budget;
+    if(room) _packed_total += packed_size;
+    g_mutex_unlock(&_packed_lock);
+    if(room)
+    {
+      slot = empty;
+      break;
+    }
+    // the rest of the budget is taken by other pipes
+    if(lru < 0) return;
+    _drop_packed(cache, lru);
+  }
+
+  cache->packed[slot] = dt_alloc_align(64, packed_size);
+  if(!cache->packed[slot])
+  {
+    g_mutex_lock(&_packed_lock);
+    _packed_total -= packed_size;
+    g_mutex_unlock(&_packed_lock);
+    return;
+  }
+  dt_dev_pixelpipe_cache_pack(cache->packed[slot], (const float *)cache->data[k], size / sizeof(float));
+  cache->packed_size[slot] = size;
+  cache->packed_dsc[slot] = cache->dsc[k];
+  cache->packed_basichash[slot] = cache->basichash[k];
+  cache->packed_hash[slot] = cache->hash[k];
+  cache->packed_used[slot] = 0;
+}
+
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
   // search for hash in cache
   for(int32_t k = 0; k < cache->entries; k++)
     if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _find_packed(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash,
@@ -210,6 +438,7 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
       *dsc = &cache->dsc[k];
       sz = cache->size[k];
       cache->used[k] = weight; // this is the MRU entry
+      cache->hits[k]++;
 
       ASAN_POISON_MEMORY_REGION(*data, sz);
       ASAN_UNPOISON_MEMORY_REGION(*data, size);
@@ -221,6 +450,11 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     // kill LRU entry
     // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
     // weight);
+    for(int p = 0; p < cache->packed_entries; p++) cache->packed_used[p]++;
+    // an evicted line might still be around as half floats. look it up before making room, so that packing
+    // the victim doesn't drop it.
+    const int p = _find_packed(cache, hash);
+    _pack_line(cache, max, p);
     if(cache->size[max] < size)
     {
       dt_free_align(cache->data[max]);
@@ -233,13 +467,27 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     ASAN_POISON_MEMORY_REGION(*data, sz);
     ASAN_UNPOISON_MEMORY_REGION(*data, size);
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
-
     cache->basichash[max] = basichash;
     cache->hash[max] = hash;
     cache->used[max] = weight;
+    cache->filled[max] = size;
+
+    if(p >= 0 && *data && cache->packed_size[p] == size)
+    {
+      dt_dev_pixelpipe_cache_unpack((float *)*data, cache->packed[p], size / sizeof(float));
+      cache->dsc[max] = cache->packed_dsc[p];
+      *dsc = &cache->dsc[max];
+      cache->hits[max] = 1;
+      _drop_packed(cache, p);
+      cache->unpacked++;
+      return 0;
+    }
+    if(p >= 0) _drop_packed(cache, p);
+
+    // first, update our copy, then update the pointer to point at our copy
+    cache->dsc[max] = **dsc;
+    *dsc = &cache->dsc[max];
+    cache->hits[max] = 0;
     cache->misses++;
     return 1;
   }
@@ -256,6 +504,7 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
     cache->used[k] = 0;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  for(int k = 0; k < cache->packed_entries; k++) _drop_packed(cache, k);
 }
 
 void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint64_t basichash)
@@ -269,6 +518,8 @@ void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint6
     cache->used[k] = 0;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  for(int k = 0; k < cache->packed_entries; k++)
+    if(cache->packed_basichash[k] != basichash) _drop_packed(cache, k);
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
@@ -303,7 +554,12 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
     printf("used %d by %" PRIu64 " (%" PRIu64 ")", cache->used[k], cache->hash[k], cache->basichash[k]);
     printf("\n");
   }
-  printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  for(int k = 0; k < cache->packed_entries; k++)
+    if(cache->packed[k])
+      printf("pixelpipe packed cacheline %d used %d by %" PRIu64 " (%" PRIu64 ")\n", k, cache->packed_used[k],
+             cache->packed_hash[k], cache->packed_basichash[k]);
+  printf("cache hit rate so far: %.3f, %" PRIu64 " hits from packed lines\n",
+         (cache->queries - cache->misses) / (float)cache->queries, cache->unpacked);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
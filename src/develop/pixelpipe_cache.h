@@ -19,6 +19,7 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
@@ -39,18 +40,38 @@ typedef struct dt_dev_pixelpipe_cache_t
   uint64_t *basichash;
   uint64_t *hash;
   int32_t *used;
+  size_t *filled; // bytes requested when the line was last filled
+  int32_t *hits;  // number of times the line was reused since
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
+  // lines which have been reused are not dropped when evicted, but kept as half floats at half the size, as
+  // long as they fit into the budget. the budget is shared by all caches.
+  int32_t packed_entries;
+  uint16_t **packed;
+  size_t *packed_size; // size of the unpacked float buffer in bytes
+  struct dt_iop_buffer_dsc_t *packed_dsc;
+  uint64_t *packed_basichash;
+  uint64_t *packed_hash;
+  int32_t *packed_used;
+  size_t packed_budget;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t unpacked;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
   \param[out] returns 0 if fail to allocate mem cache.
 */
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+/** keep evicted float lines as half floats, as long as the lines packed by all caches together take at most
+ * budget bytes. 0 disables that. */
+void dt_dev_pixelpipe_cache_set_packed_budget(dt_dev_pixelpipe_cache_t *cache, const size_t budget);
+
+/** convert n floats to half floats and back. values beyond the half float range are clamped to it. */
+void dt_dev_pixelpipe_cache_pack(uint16_t *const out, const float *const in, const size_t n);
+void dt_dev_pixelpipe_cache_unpack(float *const out, const uint16_t *const in, const size_t n);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -77,7 +98,9 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
                                         const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
-/** test availability of a cache line without destroying another, if it is not found. */
+/** test availability of a cache line without destroying another, if it is not found. packed lines count as
+ * available, they are unpacked by the next dt_dev_pixelpipe_cache_get(). that can still fail, e.g. if the
+ * requested size differs or memory runs out, so callers have to check its return value all the same. */
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
 
 /** invalidates all cachelines. */
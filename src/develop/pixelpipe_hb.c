@@ -20,6 +20,7 @@
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
+#include "common/scratch_pool.h"
 #include "common/iop_order.h"
 #include "control/control.h"
 #include "control/signal.h"
@@ -115,6 +116,7 @@ int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
+  pipe->pointwise_fusion |= dt_conf_get_bool("plugins/lighttable/export/pointwise_fusion");
   return res;
 }
 
@@ -137,6 +139,10 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
   const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  // interactive pipes keep evicted intermediate results as half floats, within one budget for all of them
+  if(res)
+    dt_dev_pixelpipe_cache_set_packed_budget(&pipe->cache,
+                                             (size_t)dt_conf_get_int("pixelpipe_cache_packed_size") << 20);
   return res;
 }
 
@@ -153,6 +159,10 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
   const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  // interactive pipes keep evicted intermediate results as half floats, within one budget for all of them
+  if(res)
+    dt_dev_pixelpipe_cache_set_packed_budget(&pipe->cache,
+                                             (size_t)dt_conf_get_int("pixelpipe_cache_packed_size") << 20);
   return res;
 }
 
@@ -196,10 +206,16 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->pointwise_fusion = dt_conf_get_bool("cache_blocked_pixelpipe");
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
 
+  // callers may set a pool of their own, the others share one for all pipes
+  dt_scratch_pool_t *current = dt_scratch_pool_get_current();
+  pipe->scratch = current ? dt_scratch_pool_ref(current)
+                          : dt_scratch_pool_get_shared((size_t)dt_conf_get_int("scratch_pool_size") << 20);
+
   return 1;
 }
 
@@ -251,6 +267,9 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
   }
+
+  dt_scratch_pool_unref(pipe->scratch);
+  pipe->scratch = NULL;
 }
 
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
@@ -338,6 +357,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->hash = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
+    piece->process_pointwise_ready = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
@@ -945,11 +965,11 @@ static void collect_histogram_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev
   return;
 }
 
-static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
-                                    float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
-                                    void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
-                                    dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
-                                    dt_develop_tiling_t *tiling, dt_pixelpipe_flow_t *pixelpipe_flow)
+static int _process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                           float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
+                           void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                           dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                           dt_develop_tiling_t *tiling, dt_pixelpipe_flow_t *pixelpipe_flow)
 {
   if(dt_atomic_get_int(&pipe->shutdown))
     return 1;
@@ -1006,7 +1026,7 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   }
 
   // Lab color picking for module
-  if(_request_color_pick(pipe, dev, module))
+  if(_request_color_pick(pipe, dev, module) && dt_iop_buffer_dsc_is_legacy(&piece->dsc_out))
   {
     // ensure that we are using the right color space
     dt_iop_colorspace_type_t picker_cst = _transform_for_picker(module, pipe->dsc.cst);
@@ -1058,6 +1078,371 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   return 0; //no errors
 }
 
+static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                                    float *input, dt_iop_buffer_dsc_t *input_format, const dt_iop_roi_t *roi_in,
+                                    void **output, dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                    dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                    dt_develop_tiling_t *tiling, dt_pixelpipe_flow_t *pixelpipe_flow)
+{
+  if(input_format->channels == piece->dsc_in.channels && input_format->layout == piece->dsc_in.layout)
+    return _process_on_CPU(pipe, dev, input, input_format, roi_in, output, out_format, roi_out, module, piece,
+                           tiling, pixelpipe_flow);
+
+  // the module negotiated another layout than its input has been written in. the cached input stays as it is.
+  dt_iop_buffer_dsc_t converted_format = *input_format;
+  converted_format.channels = piece->dsc_in.channels;
+  converted_format.layout = piece->dsc_in.layout;
+  const size_t size = dt_iop_buffer_dsc_to_bpp(&converted_format) * roi_in->width * roi_in->height;
+  float *converted = dt_alloc_align(64, size);
+  if(!converted
+     || dt_iop_buffer_convert_layout(converted, &converted_format, input, input_format, roi_in->width,
+                                     roi_in->height))
+  {
+    fprintf(stderr, "[dev_pixelpipe] could not convert the input of `%s' to %d channels [%s]\n", module->op,
+            converted_format.channels, _pipe_type_to_str(pipe->type));
+    dt_free_align(converted);
+    return 1;
+  }
+
+  const int err = _process_on_CPU(pipe, dev, converted, &converted_format, roi_in, output, out_format, roi_out,
+                                  module, piece, tiling, pixelpipe_flow);
+  dt_free_align(converted);
+  return err;
+}
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// a module which is disabled, or filtered out by the focused module, is passed through by the pipe
+static inline gboolean _skip_piece(const dt_develop_t *dev, const dt_iop_module_t *module,
+                                   const dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module != module
+             && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+/* buffer layouts: modules which don't need the fourth channel can ask for 3 channel buffers, interleaved or
+ * planar, in input_format() and output_format(). everything the pipe does around process() (opencl, tiling
+ * of planar buffers, blending, pickers, histograms, mask display) still expects 4 channels, so the pipe
+ * falls back to those whenever any of that is involved. a buffer is only converted when the module reading
+ * it negotiated another layout than the one it has been written in. */
+
+static void _legacy_layout(dt_iop_buffer_dsc_t *dsc)
+{
+  if(dt_iop_buffer_dsc_is_legacy(dsc)) return;
+  dsc->channels = 4;
+  dsc->layout = LAYOUT_INTERLEAVED;
+}
+
+static gboolean _layout_possible(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                 dt_dev_pixelpipe_iop_t *piece, const dt_iop_buffer_dsc_t *dsc)
+{
+  if(dt_iop_buffer_dsc_is_legacy(dsc)) return TRUE;
+  if(dsc->datatype != TYPE_FLOAT || dsc->channels != 3) return FALSE;
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return FALSE;
+#endif
+  // the generic tiling copies rows of interleaved pixels
+  if(dsc->layout == LAYOUT_PLANAR
+     && (piece->process_tiling_ready || (darktable.unmuted & DT_DEBUG_TILING)))
+    return FALSE;
+  // masks are displayed in the fourth channel
+  if(dev->gui_attached && dev->gui_module && dev->gui_module->request_mask_display) return FALSE;
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  return !_request_color_pick(pipe, dev, module);
+}
+
+// the layout the module will get its input in
+static void _negotiate_input_format(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                    dt_dev_pixelpipe_iop_t *piece, dt_iop_buffer_dsc_t *dsc)
+{
+  dt_iop_buffer_dsc_t wanted = *dsc;
+  module->input_format(module, pipe, piece, &wanted);
+  // the input is converted to another colorspace and histograms are collected on 4 channels
+  if(!dt_iop_buffer_dsc_is_legacy(&wanted) && wanted.datatype == dsc->datatype
+     && dsc->cst == module->input_colorspace(module, pipe, piece)
+     && !((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
+          && (piece->request_histogram & DT_REQUEST_ON))
+     && _layout_possible(pipe, dev, module, piece, &wanted))
+  {
+    dsc->channels = wanted.channels;
+    dsc->layout = wanted.layout;
+  }
+  else
+    _legacy_layout(dsc);
+}
+
+// the layout the module will write its output in. the last module of the pipe always writes 4 channels, and
+// so does the one feeding gamma: the pickers and the final histogram read the input of gamma.
+static void _negotiate_output_format(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *modules,
+                                     GList *pieces, dt_iop_buffer_dsc_t *dsc)
+{
+  dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+  module->output_format(module, pipe, piece, dsc);
+  if(!_layout_possible(pipe, dev, module, piece, dsc))
+  {
+    _legacy_layout(dsc);
+    return;
+  }
+  for(GList *m = g_list_next(modules), *p = g_list_next(pieces); m && p; m = g_list_next(m), p = g_list_next(p))
+  {
+    const dt_iop_module_t *next = (dt_iop_module_t *)m->data;
+    if(_skip_piece(dev, next, (dt_dev_pixelpipe_iop_t *)p->data)) continue;
+    if(!strcmp(next->op, "gamma")) break;
+    return;
+  }
+  _legacy_layout(dsc);
+}
+
+/* pointwise fusion: modules flagged with IOP_FLAGS_POINTWISE don't need any neighbouring pixels, so a run of
+ * them doesn't have to write every intermediate full buffer to memory. instead, bands of rows are streamed
+ * through the whole run while they are still in cache, and only the output of the last module is stored.
+ * everything else (neighbourhood filters, distortions, blending, ...) ends a run and is processed on the
+ * whole buffer as usual. */
+
+// fallback if the cache size can't be queried
+#define DT_PIXELPIPE_DEFAULT_L2_SIZE ((size_t)256 * 1024)
+
+static size_t _l2_cache_size(void)
+{
+  static size_t l2_size = 0;
+  if(l2_size == 0)
+  {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    l2_size = size > 0 ? (size_t)size : DT_PIXELPIPE_DEFAULT_L2_SIZE;
+#else
+    l2_size = DT_PIXELPIPE_DEFAULT_L2_SIZE;
+#endif
+  }
+  return l2_size;
+}
+
+static gboolean _pointwise_fusion_enabled(const dt_dev_pixelpipe_t *pipe)
+{
+  if(!pipe->pointwise_fusion) return FALSE;
+  // these want to look at every single module output
+  if(darktable.unmuted & (DT_DEBUG_NAN | DT_DEBUG_TILING)) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+#ifdef HAVE_OPENCL
+  // buffers stay on the device in the opencl path anyway
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return FALSE;
+#endif
+  return TRUE;
+}
+
+static gboolean _piece_is_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                  dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  if(!(module->flags() & IOP_FLAGS_POINTWISE) || !piece->process_pointwise_ready) return FALSE;
+  // the bands are streamed through in 4 channels
+  if(module->input_format != default_input_format || module->output_format != default_output_format)
+    return FALSE;
+  // mosaiced data depends on the position of the pixel
+  if(piece->colors != 4) return FALSE;
+  // blending, histograms and pickers need the full input and output buffers
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
+     && (piece->request_histogram & DT_REQUEST_ON))
+    return FALSE;
+  if(module == dev->gui_module || _request_color_pick(pipe, dev, module)) return FALSE;
+
+  // all modules of the run have to work on the same region of interest
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+static int _fused_band_height(const dt_iop_roi_t *roi, const size_t bpp)
+{
+  // the modules split every band by rows among the threads, always the same way with static scheduling.
+  // the share of one thread in both the input and the output band should stay in its L2 cache.
+  const size_t band_size = _l2_cache_size() / 4 * dt_get_num_threads();
+  const size_t row_size = MAX((size_t)roi->width * bpp, 1);
+  // modules assume 64 byte aligned buffers, so start every band on a multiple of four rows
+  const size_t rows = MAX(band_size / row_size, 4) & ~(size_t)3;
+  return (int)MIN(rows, (size_t)roi->height);
+}
+
+// processes the run of pointwise modules ending with the given one in bands of rows.
+// returns -1 if there is no run worth fusing, otherwise the same as dt_dev_pixelpipe_process_rec().
+static int _pixelpipe_process_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                            dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi,
+                                            GList *modules, GList *pieces, int pos, const uint64_t basichash,
+                                            const uint64_t hash, const size_t bufsize)
+{
+  if(roi->width < 1 || roi->height < 1) return -1;
+
+  // 1) collect the run, walking upstream from the current module
+  GList *run = NULL;
+  int run_length = 0;
+  GList *first_module = modules, *first_piece = pieces;
+  int first_pos = pos;
+  for(GList *m = modules, *p = pieces; m && p; m = g_list_previous(m), p = g_list_previous(p), pos--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_skip_piece(dev, module, piece)) continue;
+    if(!_piece_is_fusable(pipe, dev, module, piece, roi)) break;
+    // no need to go further upstream than an output we already have
+    if(run_length > 0)
+    {
+      uint64_t module_basichash = 0, module_hash = 0;
+      dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi, pipe, pos, &module_basichash, &module_hash);
+      if(dt_dev_pixelpipe_cache_available(&(pipe->cache), module_hash)) break;
+    }
+    run = g_list_prepend(run, piece);
+    run_length++;
+    first_module = m;
+    first_piece = p;
+    first_pos = pos;
+  }
+
+  if(run_length < 2)
+  {
+    g_list_free(run);
+    return -1;
+  }
+
+  // 2) get the input of the first module of the run
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+  {
+    g_list_free(run);
+    return 1;
+  }
+  // a module upstream wrote another layout, process the run module by module then
+  if(!dt_iop_buffer_dsc_is_legacy(input_format))
+  {
+    g_list_free(run);
+    return -1;
+  }
+
+  // 3) negotiate the formats along the run
+  dt_iop_buffer_dsc_t format = *input_format;
+  size_t max_bpp = dt_iop_buffer_dsc_to_bpp(&format);
+  for(GList *r = run; r; r = g_list_next(r))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)r->data;
+    piece->processed_roi_in = piece->processed_roi_out = *roi;
+    piece->dsc_out = piece->dsc_in = format;
+    piece->module->output_format(piece->module, pipe, piece, &piece->dsc_out);
+    format = piece->dsc_out;
+    max_bpp = MAX(max_bpp, dt_iop_buffer_dsc_to_bpp(&format));
+  }
+  **out_format = pipe->dsc = format;
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+
+  const int band_height = _fused_band_height(roi, max_bpp);
+  const size_t band_size = max_bpp * roi->width * band_height;
+  void *band[2] = { dt_alloc_align(64, band_size), dt_alloc_align(64, band_size) };
+  if(!band[0] || !band[1])
+  {
+    fprintf(stderr, "[dev_pixelpipe] could not allocate buffers for pointwise fusion [%s]\n",
+            _pipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    dt_free_align(band[0]);
+    dt_free_align(band[1]);
+    g_list_free(run);
+    return 1;
+  }
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // 4) stream the bands through the run
+  const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
+  const size_t out_bpp = dt_iop_buffer_dsc_to_bpp(&format);
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+  int cst = input_format->cst;
+
+  for(int y = 0; y < roi->height; y += band_height)
+  {
+    if(dt_atomic_get_int(&pipe->shutdown))
+    {
+      // the output has only been filled in part
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+      dt_free_align(band[0]);
+      dt_free_align(band[1]);
+      g_list_free(run);
+      return 1;
+    }
+
+    dt_iop_roi_t band_roi = *roi;
+    band_roi.y += y;
+    band_roi.height = MIN(band_height, roi->height - y);
+
+    float *in = (float *)((char *)input + in_bpp * roi->width * y);
+    cst = input_format->cst;
+    int b = 0;
+    // every band starts from the descriptor of the run's input. each module gets what the previous one made
+    // of it, e.g. of processed_maximum, as if the modules were processed one after the other.
+    dt_iop_buffer_dsc_t dsc = *input_format;
+
+    for(GList *r = run; r; r = g_list_next(r))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)r->data;
+      dt_iop_module_t *module = piece->module;
+      float *out = g_list_next(r) ? (float *)band[b] : (float *)((char *)*output + out_bpp * roi->width * y);
+
+      // transform to module input colorspace. the input of the run is a cache line which must stay as it is,
+      // even if we stop half way, so its bands are converted in the band buffer the first module doesn't write.
+      const int module_cst = module->input_colorspace(module, pipe, piece);
+      if(r == run && cst != module_cst)
+      {
+        memcpy(band[1], in, in_bpp * band_roi.width * band_roi.height);
+        in = (float *)band[1];
+      }
+      dt_ioppr_transform_image_colorspace(module, in, in, band_roi.width, band_roi.height, cst, module_cst, &cst,
+                                          cst != iop_cs_RAW ? work_profile : NULL);
+
+      piece->dsc_out = piece->dsc_in = dsc;
+      module->input_format(module, pipe, piece, &piece->dsc_in);
+      module->output_format(module, pipe, piece, &piece->dsc_out);
+      pipe->dsc = piece->dsc_out;
+      module->process(module, piece, in, out, &band_roi, &band_roi);
+      cst = pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+      // in case we get this buffer from the cache in the future, and for the next module
+      dsc = piece->dsc_out = pipe->dsc;
+
+      in = out;
+      b ^= 1;
+    }
+  }
+
+  dt_free_align(band[0]);
+  dt_free_align(band[1]);
+
+  dt_dev_pixelpipe_iop_t *last = (dt_dev_pixelpipe_iop_t *)g_list_last(run)->data;
+  **out_format = pipe->dsc = last->dsc_out;
+
+  // every module but the last would have written its output and the next one would have read it again
+  const double saved_mb = 2.0 * (run_length - 1) * max_bpp * roi->width * roi->height / (1024.0 * 1024.0);
+  gchar *first_label = dt_history_item_get_name(((dt_dev_pixelpipe_iop_t *)run->data)->module);
+  gchar *last_label = dt_history_item_get_name(last->module);
+  dt_show_times_f(&start, "[dev_pixelpipe]",
+                  "processed %d pointwise modules `%s' to `%s' fused in bands of %d rows on CPU,"
+                  " saved %.1f MB of memory traffic [%s]",
+                  run_length, first_label, last_label, band_height, saved_mb, _pipe_type_to_str(pipe->type));
+  g_free(first_label);
+  g_free(last_label);
+
+  g_list_free(run);
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1087,15 +1472,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     module = (dt_iop_module_t *)modules->data;
     piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
     // skip this module?
-    if(!piece->enabled
-       || (dev->gui_module && dev->gui_module != module
-           && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+    if(_skip_piece(dev, module, piece))
       return dt_dev_pixelpipe_process_rec(pipe, dev, output, cl_mem_output, out_format, &roi_in,
                                           g_list_previous(modules), g_list_previous(pieces), pos - 1);
   }
 
   if(module) g_strlcpy(module_name, module->op, MIN(sizeof(module_name), sizeof(module->op)));
-  get_output_format(module, pipe, piece, dev, *out_format);
+  if(module)
+    _negotiate_output_format(pipe, dev, modules, pieces, *out_format);
+  else
+    get_output_format(NULL, pipe, NULL, dev, *out_format);
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
   const size_t bufsize = (size_t)bpp * roi_out->width * roi_out->height;
 
@@ -1113,6 +1499,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
      || strcmp(module->op, "gamma") != 0)
   {
     dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi_out, pipe, pos, &basichash, &hash);
+    // the same output in another layout is not interchangeable, e.g. if the module became the last one
+    if(!dt_iop_buffer_dsc_is_legacy(*out_format))
+      hash = ((hash << 5) + hash) ^ ((*out_format)->channels | (*out_format)->layout << 8);
     cache_available = dt_dev_pixelpipe_cache_available(&(pipe->cache), hash);
   }
   if(cache_available)
@@ -1121,11 +1510,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // if(module) printf("found valid buf pos %d in cache for module %s %s %lu\n", pos, module->op, pipe ==
     // dev->preview_pipe ? "[preview]" : "", hash);
 
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
-
-    if(!modules) return 0;
-    // go to post-collect directly:
-    goto post_process_collect_info;
+    if(!dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format))
+    {
+      if(!modules) return 0;
+      // go to post-collect directly:
+      goto post_process_collect_info;
+    }
+    // a packed line could not be restored after all. forget the empty line we got, so that it isn't taken
+    // for a valid one below, and compute the output as if it had never been there.
+    if(*output) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    dt_print(DT_DEBUG_PARAMS, "[pixelpipe] dt_dev_pixelpipe_process_rec, cache line lost for pipe %i with hash %lu\n", pipe->type, (long unsigned int)hash);
   }
 
   // 2) if history changed or exit event, abort processing?
@@ -1201,6 +1595,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   {
     // 3b) recurse and obtain output array in &input
 
+    // process a run of pointwise modules in one go if we can
+    if(_pointwise_fusion_enabled(pipe))
+    {
+      const int fused = _pixelpipe_process_pointwise_run(pipe, dev, output, out_format, roi_out, modules, pieces,
+                                                         pos, basichash, hash, bufsize);
+      if(fused >= 0) return fused;
+    }
+
     // get region of interest which is needed in input
     if(dt_atomic_get_int(&pipe->shutdown))
     {
@@ -1226,7 +1628,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     piece->dsc_out = piece->dsc_in = *input_format;
 
+    _negotiate_input_format(pipe, dev, module, piece, &piece->dsc_in);
     module->output_format(module, pipe, piece, &piece->dsc_out);
+    // stick to the layout the output buffer is going to be sized for
+    piece->dsc_out.channels = (*out_format)->channels;
+    piece->dsc_out.layout = (*out_format)->layout;
 
     **out_format = pipe->dsc = piece->dsc_out;
 
@@ -2222,10 +2628,12 @@ restart:
   dt_iop_buffer_dsc_t _out_format = { 0 };
   dt_iop_buffer_dsc_t *out_format = &_out_format;
 
-  // run pixelpipe recursively and get error status
+  // run pixelpipe recursively and get error status. modules take their scratch buffers from the pipe's pool.
+  dt_scratch_pool_t *prev_scratch = dt_scratch_pool_set_current(pipe->scratch);
   const int err =
     dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
                                               pieces, pos);
+  dt_scratch_pool_set_current(prev_scratch);
 
   // get status summary of opencl queue by checking the eventlist
   const int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
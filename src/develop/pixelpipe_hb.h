@@ -66,6 +66,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  int process_pointwise_ready; // set this to 0 in commit_params if the current params need neighbouring pixels
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
@@ -173,6 +174,10 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // stream runs of pointwise modules through in bands, from the config when the pipe was initialized
+  gboolean pointwise_fusion;
+  // recycled scratch buffers of the modules, shared with the job that created the pipe if it has a pool
+  struct dt_scratch_pool_t *scratch;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
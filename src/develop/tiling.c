@@ -587,9 +587,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
 {
   void *input = NULL;
   void *output = NULL;
-  dt_iop_buffer_dsc_t dsc;
-  self->output_format(self, piece->pipe, piece, &dsc);
-  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
+  // the output format as negotiated by the pipe
+  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
 
   const int ipitch = roi_in->width * in_bpp;
   const int opitch = roi_out->width * out_bpp;
@@ -847,9 +846,8 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   //_print_roi(roi_in, "module roi_in");
   //_print_roi(roi_out, "module roi_out");
 
-  dt_iop_buffer_dsc_t dsc;
-  self->output_format(self, piece->pipe, piece, &dsc);
-  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
+  // the output format as negotiated by the pipe
+  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
 
   const int ipitch = roi_in->width * in_bpp;
   const int opitch = roi_out->width * out_bpp;
@@ -24,6 +24,7 @@
 #include <png.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
 #include "bauhaus/bauhaus.h"
@@ -117,6 +118,210 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
+// the filtered rows are deflated in blocks of about this size in parallel, and the blocks are joined into
+// one zlib stream, as done by pigz
+#define PNG_BLOCK_SIZE (1024 * 1024)
+
+typedef struct _png_block_t
+{
+  uint8_t *data;
+  size_t length;
+  uLong adler;
+  size_t in_length;
+  int failed;
+} _png_block_t;
+
+// drop the alpha channel, 16 bit samples are stored most significant byte first
+static void _pack_row(const void *ivoid, const size_t width, const int bpp, const size_t y, uint8_t *out)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *in = (const uint16_t *)ivoid + 4 * width * y;
+    for(size_t x = 0; x < width; x++, in += 4, out += 6)
+      for(int c = 0; c < 3; c++)
+      {
+        out[2 * c] = in[c] >> 8;
+        out[2 * c + 1] = in[c] & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *in = (const uint8_t *)ivoid + 4 * width * y;
+    for(size_t x = 0; x < width; x++, in += 4, out += 3)
+      for(int c = 0; c < 3; c++) out[c] = in[c];
+  }
+}
+
+static inline int _paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+static inline size_t _magnitude(const uint8_t v)
+{
+  return v < 128 ? v : 256 - v;
+}
+
+// filter one row, choosing the filter type like libpng does: the one with the smallest sum of the
+// residuals taken as signed bytes. prev is the unfiltered previous row, or zeros for the first one.
+static void _filter_row(const uint8_t *row, const uint8_t *prev, const size_t rowbytes, const size_t pixel_bytes,
+                        const gboolean adaptive, uint8_t *out)
+{
+  int best = 0;
+  if(adaptive)
+  {
+    size_t sum[5] = { 0 };
+    for(size_t i = 0; i < rowbytes; i++)
+    {
+      const int a = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+      const int b = prev[i];
+      const int c = i >= pixel_bytes ? prev[i - pixel_bytes] : 0;
+      sum[0] += _magnitude(row[i]);
+      sum[1] += _magnitude(row[i] - a);
+      sum[2] += _magnitude(row[i] - b);
+      sum[3] += _magnitude(row[i] - ((a + b) >> 1));
+      sum[4] += _magnitude(row[i] - _paeth(a, b, c));
+    }
+    for(int k = 1; k < 5; k++)
+      if(sum[k] < sum[best]) best = k;
+  }
+
+  out[0] = best;
+  out++;
+  for(size_t i = 0; i < rowbytes; i++)
+  {
+    const int a = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+    const int b = prev[i];
+    const int c = i >= pixel_bytes ? prev[i - pixel_bytes] : 0;
+    switch(best)
+    {
+      case 0: out[i] = row[i]; break;
+      case 1: out[i] = row[i] - a; break;
+      case 2: out[i] = row[i] - b; break;
+      case 3: out[i] = row[i] - ((a + b) >> 1); break;
+      default: out[i] = row[i] - _paeth(a, b, c); break;
+    }
+  }
+}
+
+static void _deflate_block(_png_block_t *block, const uint8_t *in, const size_t length, const uint8_t *dict,
+                           const size_t dict_length, const int level, const gboolean last)
+{
+  z_stream strm = { 0 };
+  block->failed = TRUE;
+  block->in_length = length;
+  block->adler = adler32(adler32(0L, Z_NULL, 0), in, length);
+  if(deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+  // keep the compression ratio of one stream by priming each block with the end of the previous one
+  if(dict_length && deflateSetDictionary(&strm, dict, dict_length) != Z_OK) goto end;
+
+  // room for the sync flush marker
+  const size_t bound = deflateBound(&strm, length) + 16;
+  block->data = malloc(bound);
+  if(!block->data) goto end;
+  strm.next_in = (Bytef *)in;
+  strm.avail_in = length;
+  strm.next_out = block->data;
+  strm.avail_out = bound;
+  // all blocks but the last end byte aligned, so that they can be concatenated
+  const int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+  if((last && ret != Z_STREAM_END) || (!last && ret != Z_OK) || strm.avail_in) goto end;
+  block->length = bound - strm.avail_out;
+  block->failed = FALSE;
+
+end:
+  deflateEnd(&strm);
+}
+
+// write the image data as one zlib stream, which is filtered and deflated in parallel. returns 0 on success.
+static int _write_image_data(png_structp png_ptr, const void *ivoid, const size_t width, const size_t height,
+                             const int bpp, const int level)
+{
+  const size_t pixel_bytes = bpp > 8 ? 6 : 3;
+  const size_t rowbytes = width * pixel_bytes;
+  const size_t rows_per_block = CLAMPS(PNG_BLOCK_SIZE / (rowbytes + 1), 1, height);
+  const size_t nblocks = (height + rows_per_block - 1) / rows_per_block;
+
+  size_t padded_size;
+  // every thread needs the current and the previous row unfiltered
+  uint8_t *const scratch = dt_alloc_perthread(2 * rowbytes, sizeof(uint8_t), &padded_size);
+  uint8_t *const filtered = dt_alloc_align(64, (rowbytes + 1) * height);
+  _png_block_t *const blocks = calloc(nblocks, sizeof(_png_block_t));
+  int rc = 1;
+  if(!scratch || !filtered || !blocks) goto exit;
+
+  // rows are filtered block by block, so that every row only needs to be packed once
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ivoid, width, height, bpp, pixel_bytes, rowbytes, rows_per_block, nblocks) \
+  dt_omp_firstprivate(scratch, padded_size, filtered, level) \
+  schedule(dynamic)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    uint8_t *const buf = dt_get_perthread(scratch, padded_size);
+    uint8_t *prev = buf;
+    uint8_t *row = buf + rowbytes;
+    const size_t y0 = b * rows_per_block;
+    const size_t y1 = MIN(y0 + rows_per_block, height);
+    if(y0 > 0)
+      _pack_row(ivoid, width, bpp, y0 - 1, prev);
+    else
+      memset(prev, 0, rowbytes);
+    for(size_t y = y0; y < y1; y++)
+    {
+      _pack_row(ivoid, width, bpp, y, row);
+      _filter_row(row, prev, rowbytes, pixel_bytes, level > 0, filtered + y * (rowbytes + 1));
+      uint8_t *const tmp = prev;
+      prev = row;
+      row = tmp;
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, rowbytes, rows_per_block, nblocks, filtered, blocks, level) \
+  schedule(dynamic)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    const size_t start = b * rows_per_block * (rowbytes + 1);
+    const size_t end = MIN((b + 1) * rows_per_block, height) * (rowbytes + 1);
+    const size_t dict_length = MIN(start, 32768);
+    _deflate_block(blocks + b, filtered + start, end - start, filtered + start - dict_length, dict_length, level,
+                   b == nblocks - 1);
+  }
+
+  // zlib header without preset dictionary, and the compression level hint zlib would write
+  const int level_flags = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+  unsigned int header = (0x78 << 8) | (level_flags << 6);
+  header += 31 - header % 31;
+  const uint8_t zlib_header[2] = { header >> 8, header & 0xff };
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    if(blocks[b].failed) goto exit;
+    adler = adler32_combine(adler, blocks[b].adler, blocks[b].in_length);
+  }
+  const uint8_t zlib_trailer[4] = { adler >> 24, (adler >> 16) & 0xff, (adler >> 8) & 0xff, adler & 0xff };
+
+  png_write_chunk(png_ptr, (png_const_bytep) "IDAT", zlib_header, sizeof(zlib_header));
+  for(size_t b = 0; b < nblocks; b++)
+    png_write_chunk(png_ptr, (png_const_bytep) "IDAT", blocks[b].data, blocks[b].length);
+  png_write_chunk(png_ptr, (png_const_bytep) "IDAT", zlib_trailer, sizeof(zlib_trailer));
+  rc = 0;
+
+exit:
+  if(blocks)
+    for(size_t b = 0; b < nblocks; b++) free(blocks[b].data);
+  free(blocks);
+  dt_free_align(filtered);
+  dt_free_align(scratch);
+  return rc;
+}
+
 int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -195,31 +400,16 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
 
   png_write_info(png_ptr, info_ptr);
 
-  /*
-   * Get rid of filler (OR ALPHA) bytes, pack XRGB/RGBX/ARGB/RGBA into
-   * RGB (4 channels -> 3 channels). The second parameter is not used.
-   */
-  png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
-
-  png_bytep *row_pointers = dt_alloc_align(64, sizeof(png_bytep) * height);
-
-  if(p->bpp > 8)
-  {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
-
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
-  }
-  else
+  if(_write_image_data(png_ptr, ivoid, width, height, p->bpp, p->compression))
   {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(f);
+    return 1;
   }
 
-  png_write_image(png_ptr, row_pointers);
-
-  dt_free_align(row_pointers);
-
-  png_write_end(png_ptr, info_ptr);
+  // the image data didn't go through libpng, which would complain about missing IDAT chunks in
+  // png_write_end(). there is nothing left to write after the image data but the end marker.
+  png_write_chunk(png_ptr, (png_const_bytep) "IEND", NULL, 0);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   fclose(f);
   return 0;
@@ -57,6 +57,223 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+// uncompressed size of the strips we write. big enough to compress well, small enough to give every
+// thread a couple of them.
+#define TIFF_STRIP_SIZE (256 * 1024)
+
+// what goes into one page: either the 4 channel image in the output format, or a single channel float mask
+typedef struct _tiff_source_t
+{
+  const void *in;
+  gboolean is_mask;
+  size_t width;
+  uint16_t layers;
+  int bpp;
+} _tiff_source_t;
+
+static void _pack_row(const _tiff_source_t *src, const size_t y, void *row)
+{
+  const size_t width = src->width;
+  const uint16_t layers = src->layers;
+  if(src->is_mask)
+  {
+    const float *in = (const float *)src->in + y * width;
+    if(src->bpp == 32)
+    {
+      float *out = (float *)row;
+      for(size_t x = 0; x < width; x++, out += layers)
+        for(int c = 0; c < layers; c++) out[c] = in[x];
+    }
+    else if(src->bpp == 16)
+    {
+      uint16_t *out = (uint16_t *)row;
+      for(size_t x = 0; x < width; x++, out += layers)
+        for(int c = 0; c < layers; c++) out[c] = CLIP(in[x]) * 65535.0f + 0.5f;
+    }
+    else
+    {
+      uint8_t *out = (uint8_t *)row;
+      for(size_t x = 0; x < width; x++, out += layers)
+        for(int c = 0; c < layers; c++) out[c] = CLIP(in[x]) * 255.0f + 0.5f;
+    }
+  }
+  else
+  {
+    const size_t bytes = src->bpp / 8;
+    const uint8_t *in = (const uint8_t *)src->in + 4 * bytes * y * width;
+    uint8_t *out = (uint8_t *)row;
+    for(size_t x = 0; x < width; x++, in += 4 * bytes, out += layers * bytes) memcpy(out, in, layers * bytes);
+  }
+}
+
+// in-memory file for the per thread tiff encoders
+typedef struct _tiff_memfile_t
+{
+  uint8_t *data;
+  size_t size;
+  size_t alloc;
+  size_t pos;
+} _tiff_memfile_t;
+
+static tmsize_t _memfile_read(thandle_t handle, void *buf, tmsize_t size)
+{
+  _tiff_memfile_t *f = (_tiff_memfile_t *)handle;
+  const size_t n = f->pos < f->size ? MIN((size_t)size, f->size - f->pos) : 0;
+  memcpy(buf, f->data + f->pos, n);
+  f->pos += n;
+  return n;
+}
+
+static tmsize_t _memfile_write(thandle_t handle, void *buf, tmsize_t size)
+{
+  _tiff_memfile_t *f = (_tiff_memfile_t *)handle;
+  if(f->pos + size > f->alloc)
+  {
+    const size_t alloc = MAX(2 * f->alloc, f->pos + size);
+    uint8_t *data = g_try_realloc(f->data, alloc);
+    if(!data) return -1;
+    f->data = data;
+    f->alloc = alloc;
+  }
+  if(f->pos > f->size) memset(f->data + f->size, 0, f->pos - f->size);
+  memcpy(f->data + f->pos, buf, size);
+  f->pos += size;
+  f->size = MAX(f->size, f->pos);
+  return size;
+}
+
+static toff_t _memfile_seek(thandle_t handle, toff_t offset, int whence)
+{
+  _tiff_memfile_t *f = (_tiff_memfile_t *)handle;
+  if(whence == SEEK_CUR)
+    f->pos += offset;
+  else if(whence == SEEK_END)
+    f->pos = f->size + offset;
+  else
+    f->pos = offset;
+  return f->pos;
+}
+
+static int _memfile_close(thandle_t handle)
+{
+  return 0;
+}
+
+static toff_t _memfile_size(thandle_t handle)
+{
+  return ((_tiff_memfile_t *)handle)->size;
+}
+
+static int _memfile_map(thandle_t handle, void **base, toff_t *size)
+{
+  return 0;
+}
+
+static void _memfile_unmap(thandle_t handle, void *base, toff_t size)
+{
+}
+
+// an encoder writing to memory, with the same layout and compression as the page of tif
+static TIFF *_strip_encoder_open(_tiff_memfile_t *f, TIFF *tif)
+{
+  TIFF *enc = TIFFClientOpen("strip encoder", "wlm", (thandle_t)f, _memfile_read, _memfile_write, _memfile_seek,
+                             _memfile_close, _memfile_size, _memfile_map, _memfile_unmap);
+  if(!enc) return NULL;
+
+  // the codec specific tags only exist once the compression is set
+  static const ttag_t tags_16[] = { TIFFTAG_COMPRESSION, TIFFTAG_PREDICTOR, TIFFTAG_BITSPERSAMPLE,
+                                    TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_SAMPLEFORMAT, TIFFTAG_PHOTOMETRIC,
+                                    TIFFTAG_PLANARCONFIG };
+  static const ttag_t tags_32[] = { TIFFTAG_IMAGEWIDTH, TIFFTAG_IMAGELENGTH, TIFFTAG_ROWSPERSTRIP };
+  uint16_t value_16;
+  uint32_t value_32;
+  int quality;
+  for(size_t k = 0; k < sizeof(tags_16) / sizeof(tags_16[0]); k++)
+    if(TIFFGetField(tif, tags_16[k], &value_16)) TIFFSetField(enc, tags_16[k], value_16);
+  for(size_t k = 0; k < sizeof(tags_32) / sizeof(tags_32[0]); k++)
+    if(TIFFGetField(tif, tags_32[k], &value_32)) TIFFSetField(enc, tags_32[k], value_32);
+  if(TIFFGetField(tif, TIFFTAG_ZIPQUALITY, &quality)) TIFFSetField(enc, TIFFTAG_ZIPQUALITY, quality);
+  return enc;
+}
+
+// write the page in large strips. the strips are filled and encoded in parallel, each thread by a tiff
+// encoder of its own writing to memory, and are then copied to the file as they are. all tags of the page
+// have to be set already. returns 0 on success.
+static int _write_strips(TIFF *tif, const _tiff_source_t *src, const size_t height)
+{
+  const size_t rowsize = src->width * src->layers * src->bpp / 8;
+  const size_t rows_per_strip = CLAMPS(TIFF_STRIP_SIZE / rowsize, 1, height);
+  const size_t nstrips = (height + rows_per_strip - 1) / rows_per_strip;
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)rows_per_strip);
+
+  const int nthreads = dt_get_num_threads();
+  size_t padded_size;
+  uint8_t *const strips = dt_alloc_perthread(rows_per_strip * rowsize, sizeof(uint8_t), &padded_size);
+  _tiff_memfile_t *const files = calloc(nthreads, sizeof(_tiff_memfile_t));
+  // where each encoded strip ended up
+  int *const strip_file = malloc(nstrips * sizeof(int));
+  size_t *const strip_offset = malloc(nstrips * sizeof(size_t));
+  size_t *const strip_length = malloc(nstrips * sizeof(size_t));
+  int rc = 1;
+  if(!strips || !files || !strip_file || !strip_offset || !strip_length) goto exit;
+
+  gboolean failed = FALSE;
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(tif, src, height, rowsize, rows_per_strip, nstrips, strips, padded_size, files) \
+  dt_omp_firstprivate(strip_file, strip_offset, strip_length) \
+  reduction(|| : failed)
+#endif
+  {
+    const int thread = dt_get_thread_num();
+    _tiff_memfile_t *const f = files + thread;
+    uint8_t *const strip = dt_get_perthread(strips, padded_size);
+    TIFF *enc = NULL;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    enc = _strip_encoder_open(f, tif);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for(size_t s = 0; s < nstrips; s++)
+    {
+      const size_t y0 = s * rows_per_strip;
+      const size_t rows = MIN(rows_per_strip, height - y0);
+      for(size_t r = 0; r < rows; r++) _pack_row(src, y0 + r, strip + r * rowsize);
+
+      // a new strip is always appended to the end of the file
+      const size_t start = f->size;
+      if(!enc || TIFFWriteEncodedStrip(enc, s, strip, rows * rowsize) == -1)
+      {
+        failed = TRUE;
+        continue;
+      }
+      strip_file[s] = thread;
+      strip_offset[s] = start;
+      strip_length[s] = f->size - start;
+    }
+
+    if(enc) TIFFClose(enc);
+  }
+  if(failed) goto exit;
+
+  for(size_t s = 0; s < nstrips; s++)
+    if(TIFFWriteRawStrip(tif, s, files[strip_file[s]].data + strip_offset[s], strip_length[s]) == -1) goto exit;
+  rc = 0;
+
+exit:
+  if(files)
+    for(int k = 0; k < nthreads; k++) g_free(files[k].data);
+  free(files);
+  dt_free_align(strips);
+  free(strip_file);
+  free(strip_offset);
+  free(strip_length);
+  return rc;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -69,8 +286,6 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFF *tif = NULL;
 
-  void *rowdata = NULL;
-
   gboolean free_mask = FALSE;
   float *raster_mask = NULL;
 #ifdef _WIN32
@@ -239,78 +454,18 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
   TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
-
   const int resolution = dt_conf_get_int("metadata/resolution");
   TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
   TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
-  const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  const _tiff_source_t image = { in_void, FALSE, d->global.width, layers, d->bpp };
+  if(_write_strips(tif, &image, d->global.height))
   {
     rc = 1;
     goto exit;
   }
 
-  if(d->bpp == 32)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(float) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-
   rc = 0;
 
   // close the file before adding exif data
@@ -419,74 +574,11 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
           TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
         else
           TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
-
-        if(w != d->global.width)
-        {
-          free(rowdata);
-          const size_t _rowsize = (w * layers) * d->bpp / 8;
-          rowdata = malloc(_rowsize);
-        }
-
-        if(d->bpp == 32)
-        {
-          for(int y = 0; y < h; y++)
-          {
-            const float *in = raster_mask + (size_t)y * w;
-            float *out = (float *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = in[x];
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
-          }
-        }
-        else if(d->bpp == 16)
+        const _tiff_source_t mask = { raster_mask, TRUE, w, layers, d->bpp };
+        if(_write_strips(tif, &mask, h))
         {
-          for(int y = 0; y < h; y++)
-          {
-            const float *in = raster_mask + (size_t)y * w;
-            uint16_t *out = (uint16_t *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = CLIP(in[x]) * 65535.0f + 0.5f;
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
-          }
-        }
-        else
-        {
-          for(int y = 0; y < h; y++)
-          {
-            const float *in = raster_mask + (size_t)y * w;
-            uint8_t *out = (uint8_t *)rowdata;
-
-            for(int x = 0; x < w; x++, out += layers)
-            {
-              for(int c = 0; c < layers; c++)
-                out[c] = CLIP(in[x]) * 255.0f + 0.5f;
-            }
-
-            if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-            {
-              rc = 1;
-              goto exit;
-            }
-          }
+          rc = 1;
+          goto exit;
         }
 #else // MASKS_USE_SAME_FORMAT
         TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
@@ -529,8 +621,6 @@ exit:
   }
   free(profile);
   profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
 #ifdef _WIN32
   g_free(wfilename);
 #endif
@@ -151,6 +151,8 @@ int write_image(dt_imageio_module_data_t *webp, const char *filename, const void
   // TODO(jinxos): these values should be adjusted as needed and ideally determined at runtime.
   config.segments = 4;
   config.partition_limit = 70;
+  // let libwebp use its worker threads (analysis and lossy filtering, the lossless entropy passes)
+  config.thread_level = dt_get_num_threads() > 1;
   if(!WebPValidateConfig(&config))
   {
     fprintf(stderr, "[webp export] error validating encoder configuration\n");
@@ -27,6 +27,7 @@
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_cache.h"
 #include "develop/tiling.h"
 #include "gui/gtk.h"
 #include "gui/presets.h"
@@ -74,7 +75,16 @@ typedef struct dt_iop_bilat_params_v1_t
 }
 dt_iop_bilat_params_v1_t;
 
-typedef dt_iop_bilat_params_t dt_iop_bilat_data_t;
+typedef struct dt_iop_bilat_data_t
+{
+  dt_iop_bilat_mode_t mode;
+  float sigma_r;
+  float sigma_s;
+  float detail;
+  float midtone;
+  local_laplacian_cache_t ll_cache; // input pyramid of the last local laplacian run
+}
+dt_iop_bilat_data_t;
 
 typedef struct dt_iop_bilat_gui_data_t
 {
@@ -274,7 +284,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 {
   dt_iop_bilat_params_t *p = (dt_iop_bilat_params_t *)p1;
   dt_iop_bilat_data_t *d = (dt_iop_bilat_data_t *)piece->data;
-  *d = *p;
+  d->mode = p->mode;
+  d->sigma_r = p->sigma_r;
+  d->sigma_s = p->sigma_s;
+  d->detail = p->detail;
+  d->midtone = p->midtone;
 
 #ifdef HAVE_OPENCL
   if(d->mode == s_mode_bilateral)
@@ -282,6 +296,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 #endif
   if(d->mode == s_mode_local_laplacian)
     piece->process_tiling_ready = 0; // can't deal with tiles, sorry.
+  else
+    local_laplacian_cache_free(&d->ll_cache);
 }
 
 
@@ -293,11 +309,38 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_bilat_data_t *d = (dt_iop_bilat_data_t *)piece->data;
+  local_laplacian_cache_free(&d->ll_cache);
   free(piece->data);
   piece->data = NULL;
 }
 
 
+// prepare the local laplacian cache for processing the given input. the cached pyramid is 4/3 the size of
+// the padded input and stays around between runs, which only pays off while the sliders are moved in the
+// darkroom. other pipes process an image once, they don't keep it.
+static local_laplacian_cache_t *_ll_cache(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                          const dt_iop_roi_t *const roi_in)
+{
+  dt_iop_bilat_data_t *d = (dt_iop_bilat_data_t *)piece->data;
+  local_laplacian_cache_t *c = &d->ll_cache;
+  if(!(piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW)))
+  {
+    local_laplacian_cache_free(c);
+    return NULL;
+  }
+  c->hash = 0;
+  // the input pyramid only depends on what comes in, whatever the pipe type. a zero hash
+  // means it can't be identified and is rebuilt.
+  uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(piece->pipe->image.id, piece->pipe, self);
+  if(hash == (uint64_t)-1) return c;
+  // the same input may come in different regions of interest
+  const char *str = (const char *)roi_in;
+  for(size_t k = 0; k < sizeof(dt_iop_roi_t); k++) hash = ((hash << 5) + hash) ^ str[k];
+  c->hash = hash;
+  return c;
+}
+
 #if defined(__SSE2__)
 void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -322,7 +365,8 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
   }
   else // s_mode_local_laplacian
   {
-    local_laplacian_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
+    local_laplacian_sse2(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0,
+                         _ll_cache(self, piece, roi_in));
   }
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(i, o, roi_in->width, roi_in->height);
@@ -352,7 +396,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
   else // s_mode_local_laplacian
   {
-    local_laplacian(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0);
+    local_laplacian(i, o, roi_in->width, roi_in->height, d->midtone, d->sigma_s, d->sigma_r, d->detail, 0,
+                    _ll_cache(self, piece, roi_in));
   }
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(i, o, roi_in->width, roi_in->height);
@@ -109,7 +109,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     return; // image has been copied through to output and module's trouble flag has been updated
 
   float *restrict blurlightness;
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 1, &blurlightness, 0))
+  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 1 | DT_IMGSZ_SCRATCH, &blurlightness, 0))
   {
     // out of memory, so just copy image through to output
     dt_iop_copy_image_roi(ovoid, ivoid, piece->colors, roi_in, roi_out, TRUE);
@@ -163,7 +163,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     out[4*k+2] = in[4*k+2];
     out[4*k+3] = in[4*k+3];
   }
-  dt_free_align(blurlightness);
+  dt_scratch_free(blurlightness);
 
 //  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
 //    dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
@@ -1308,7 +1308,8 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   float *restrict precond = NULL;
   float *restrict tmp = NULL;
 
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &precond, 4, &tmp, 4, &buf, 0))
+  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4 | DT_IMGSZ_SCRATCH, &precond, 4 | DT_IMGSZ_SCRATCH, &tmp,
+                                  4 | DT_IMGSZ_SCRATCH, &buf, 0))
   {
     dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out, TRUE);
     return;
@@ -1412,9 +1413,9 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     backtransform_Y0U0V0(out, width, height, d->a[1] * compensate_p, p, d->b[1], d->bias - 0.5 * logf(in_scale), wb, toRGB);
   }
 
-  dt_free_align(buf);
-  dt_free_align(tmp);
-  dt_free_align(precond);
+  dt_scratch_free(buf);
+  dt_scratch_free(tmp);
+  dt_scratch_free(precond);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -1585,7 +1586,7 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
     return; // image has been copied through to output and module's trouble flag has been updated
 
   float *restrict in;
-  if (!dt_iop_alloc_image_buffers(piece->module, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
+  if (!dt_iop_alloc_image_buffers(piece->module, roi_in, roi_out, 4 | DT_IMGSZ_INPUT | DT_IMGSZ_SCRATCH, &in, 0))
     return;
 
   // adjust to zoom size:
@@ -1616,7 +1617,7 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                       .norm = norm2 };
   denoiser(in,ovoid,roi_in,roi_out,&params);
 
-  dt_free_align(in);
+  dt_scratch_free(in);
   nlmeans_backtransform(d,ovoid,roi_in,scale,compensate_p,wb,aa,bb,p);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
@@ -72,7 +72,7 @@ REQUIRED(const char *, name, void);
 DEFAULT(const char *, aliases, void);
 /** get the default group this module belongs to. */
 DEFAULT(int, default_group, void);
-/** get the iop module flags. */
+/** get the iop module flags, see IOP_FLAGS_* in develop/imageop.h. */
 DEFAULT(int, flags, void);
 /** get the deprecated message if needed, to be translated. */
 DEFAULT(const char *, deprecated_msg, void);
@@ -125,7 +125,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int ch = 4;
 
   float *restrict img_tmp = NULL;
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, ch, &img_tmp, 0))
+  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, ch | DT_IMGSZ_SCRATCH, &img_tmp, 0))
   {
     dt_iop_copy_image_roi(ovoid, ivoid, ch, roi_in, roi_out, TRUE);
     dt_control_log(_("module overexposed failed in buffer allocation"));
@@ -337,7 +337,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 
 process_finish:
-  dt_free_align(img_tmp);
+  dt_scratch_free(img_tmp);
 }
 
 #ifdef HAVE_OPENCL
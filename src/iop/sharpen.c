@@ -297,7 +297,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   float *restrict tmp;	// one row per thread
   size_t padded_size;
   if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out,
-                                  1 | DT_IMGSZ_WIDTH | DT_IMGSZ_PERTHREAD, &tmp, &padded_size,
+                                  1 | DT_IMGSZ_WIDTH | DT_IMGSZ_PERTHREAD | DT_IMGSZ_SCRATCH, &tmp, &padded_size,
                                   0))
   {
     dt_iop_copy_image_roi(ovoid, ivoid, 4, roi_in, roi_out, TRUE);
@@ -391,7 +391,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 
   dt_free_align(mat);
-  dt_free_align(tmp);
+  dt_scratch_free(tmp);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
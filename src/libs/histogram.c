@@ -52,6 +52,12 @@
 // visible consequence.
 #define VECTORSCOPE_HUES 48
 #define VECTORSCOPE_BASE_LOG 30
+// time (in seconds) the scopes may take to keep up with the preview while dragging sliders, and how sparsely
+// the image may get sampled at most to achieve that
+#define SCOPES_TIME_BUDGET 0.010
+#define SCOPES_MAX_STEP 8
+// time (in ms) without a new preview after which sparsely sampled scopes are computed in full
+#define SCOPES_SETTLE_TIME 250
 
 DT_MODULE(1)
 
@@ -144,6 +150,15 @@ typedef struct dt_lib_histogram_t
   gboolean red, green, blue;
   float *rgb2ryb_ypp;
   float *ryb2rgb_ypp;
+  // sampling of the last scopes update
+  double scopes_sample_cost;          // seconds per sampled pixel
+  int scopes_step;                    // every scopes_step-th pixel of every scopes_step-th row was sampled
+  // the last image if it was sampled sparsely, to compute the scopes in full once processing settles
+  float *scopes_pending;
+  dt_histogram_roi_t scopes_pending_roi;
+  const dt_iop_order_iccprofile_info_t *scopes_pending_profile;
+  double scopes_pending_time;
+  guint scopes_settle_timeout;
 } dt_lib_histogram_t;
 
 const char *name(dt_lib_module_t *self)
@@ -173,126 +188,6 @@ int position()
 }
 
 
-static void _lib_histogram_process_histogram(dt_lib_histogram_t *const d, const float *const input,
-                                             const dt_histogram_roi_t *const roi)
-{
-  dt_dev_histogram_collection_params_t histogram_params = { 0 };
-  const dt_iop_colorspace_type_t cst = iop_cs_rgb;
-  dt_dev_histogram_stats_t histogram_stats = { .bins_count = HISTOGRAM_BINS, .ch = 4, .pixels = 0 };
-  uint32_t histogram_max[4] = { 0 };
-
-  d->histogram_max = 0;
-  memset(d->histogram, 0, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
-
-  histogram_params.roi = roi;
-  histogram_params.bins_count = HISTOGRAM_BINS;
-  histogram_params.mul = histogram_params.bins_count - 1;
-
-  // FIXME: for point sample, calculate whole graph and the point sample values, draw these on top of the graph
-  // FIXME: set up "custom" histogram worker which can do colorspace conversion on fly -- in cases that we need to do that -- may need to add from colorspace to dt_dev_histogram_collection_params_t
-  dt_histogram_helper(&histogram_params, &histogram_stats, cst, iop_cs_NONE, input, &d->histogram, FALSE, NULL);
-  dt_histogram_max_helper(&histogram_stats, cst, iop_cs_NONE, &d->histogram, histogram_max);
-  d->histogram_max = MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
-}
-
-static void _lib_histogram_process_waveform(dt_lib_histogram_t *const d, const float *const input,
-                                            const dt_histogram_roi_t *const roi)
-{
-  // FIXME: for point sample, calculate whole graph and the point sample values, draw these on top of a dimmer graph
-  const int sample_width = MAX(1, roi->width - roi->crop_width - roi->crop_x);
-  const int sample_height = MAX(1, roi->height - roi->crop_height - roi->crop_y);
-
-  // Use integral sized bins for columns, as otherwise they will be
-  // unequal and have banding. Rely on draw to smoothly do horizontal
-  // scaling. For a horizontal waveform of a 3:2 image, "landscape"
-  // orientation, bin_width will generally be 4, for "portrait" it
-  // will generally be 3. Note that waveform_bins varies, depending on
-  // preview image width and # of bins.
-  const dt_lib_histogram_orient_t orient = d->scope_orient;
-  const int to_bin = orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? sample_width : sample_height;
-  const size_t samples_per_bin = ceilf(to_bin / (float)d->waveform_max_bins);
-  const size_t num_bins = ceilf(to_bin / (float)samples_per_bin);
-  d->waveform_bins = num_bins;
-  const size_t num_tones = d->waveform_tones;
-
-  // Note that, with current constants, the input buffer is from the
-  // preview pixelpipe and should be <= 1440x900x4. The output buffer
-  // will be <= 360x160x3. Hence process works with a relatively small
-  // quantity of data.
-  size_t bin_pad;
-  uint32_t *const restrict partial_binned = dt_calloc_perthread(3U * num_bins * num_tones, sizeof(uint32_t), &bin_pad);
-
-#if defined(_OPENMP)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(input, partial_binned, roi, num_tones, num_bins, bin_pad, samples_per_bin, sample_height, sample_width, orient) \
-  schedule(static)
-#endif
-  for(size_t y=0; y<sample_height; y++)
-  {
-    const float *const restrict px = DT_IS_ALIGNED((const float *const restrict)input +
-                                                   4U * ((y + roi->crop_y) * roi->width));
-    uint32_t *const restrict binned = dt_get_perthread(partial_binned, bin_pad);
-    for(size_t x=0; x<sample_width; x++)
-    {
-      const size_t bin = (orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? x : y) / samples_per_bin;
-      size_t tone[4] DT_ALIGNED_PIXEL;
-      for_each_channel(ch, aligned(px,tone:16))
-      {
-        // 1.0 is at 8/9 of the height!
-        const float v = (8.0f / 9.0f) * px[4U * (x + roi->crop_x) + ch];
-        // Using ceilf brings everything <= 0 to bottom tone,
-        // everything > 1.0f/(num_tones-1) to top tone.
-        tone[ch] = ceilf(CLAMPS(v, 0.0f, 1.0f) * (num_tones-1));
-      }
-      for(size_t ch = 0; ch < 3; ch++)
-        binned[num_tones * (ch * num_bins + bin) + tone[ch]]++;
-    }
-  }
-
-  // shortcut to change from linear to display gamma -- borrow hybrid log-gamma LUT
-  const dt_iop_order_iccprofile_info_t *const profile =
-    dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_HLG_REC2020, "", DT_INTENT_PERCEPTUAL);
-  // lut for all three channels should be the same
-  const float *const restrict lut = DT_IS_ALIGNED((const float *const restrict)profile->lut_out[0]);
-  const float lutmax = profile->lutsize - 1;
-  const size_t wf_img_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8,
-                                                             orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? num_bins : num_tones);
-
-  // Every bin_width x height portion of the image is being described
-  // in a 1 pixel x waveform_tones portion of the histogram.
-  // NOTE: if constant is decreased, will brighten output
-  // FIXME: instead of using an area-beased scale, figure out max bin count and scale to that?
-  const float brightness = num_tones / 40.0f;
-  const float scale = brightness / ((orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? sample_height : sample_width) * samples_per_bin);
-  size_t nthreads = dt_get_num_threads();
-
-#if defined(_OPENMP)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(d, partial_binned, bin_pad, wf_img_stride, num_bins, num_tones, orient, lut, lutmax, scale, nthreads) \
-  schedule(static) collapse(3)
-#endif
-  for(size_t ch = 0; ch < 3; ch++)
-    for(size_t bin = 0; bin < num_bins; bin++)
-      for(size_t tone = 0; tone < num_tones; tone++)
-      {
-        uint8_t *const restrict wf_img = DT_IS_ALIGNED((uint8_t *const restrict)d->waveform_img[ch]);
-        uint32_t acc = 0;
-        for(size_t n = 0; n < nthreads; n++)
-        {
-          uint32_t *const restrict binned = dt_get_bythread(partial_binned, bin_pad, n);
-          acc += binned[num_tones * (ch * num_bins + bin) + tone];
-        }
-        const float linear = MIN(1.f, scale * acc);
-        const uint8_t display = lut[(int)(linear * lutmax)] * 255.f;
-        if(orient == DT_LIB_HISTOGRAM_ORIENT_HORI)
-          wf_img[tone * wf_img_stride + bin] = display;
-        else
-          wf_img[bin * wf_img_stride + tone] = display;
-      }
-
-  dt_free_align(partial_binned);
-}
-
 // Inspired by "Paint Inspired Color Mixing and Compositing for Visualization" - Gossett
 // http://vis.computer.org/vis2004/DVD/infovis/papers/gossett.pdf
 // As the Gossett model is not reversible, we keep his cube hues
@@ -571,92 +466,89 @@ static  void _get_chromaticity(const dt_aligned_pixel_t RGB, dt_aligned_pixel_t
   }
 }
 
-static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const float *const input,
-                                               dt_histogram_roi_t *const roi,
-                                               const dt_iop_order_iccprofile_info_t *vs_prof)
+static inline void _lib_histogram_bin_pixel(const float *const restrict px, uint32_t *const restrict hist,
+                                            uint32_t *const restrict wf_binned, const size_t wf_bin,
+                                            const size_t num_bins, const size_t num_tones)
 {
-  const int diam_px = d->vectorscope_diameter_px;
-  const dt_lib_histogram_vectorscope_type_t vs_type = d->vectorscope_type;
-  const dt_lib_histogram_scale_t vs_scale = d->vectorscope_scale;
-
-  if(!vs_prof || isnan(vs_prof->matrix_in[0][0]))
+  int bin[4] DT_ALIGNED_PIXEL;
+  int tone[4] DT_ALIGNED_PIXEL;
+  for_each_channel(ch, aligned(px,bin,tone:16))
   {
-    fprintf(stderr, "[histogram] unsupported vectorscope profile %i %s, it will be replaced with linear rec2020\n", vs_prof->type, vs_prof->filename);
-    vs_prof = dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_LIN_REC2020, "", DT_INTENT_RELATIVE_COLORIMETRIC);
+    const float v = px[ch];
+    bin[ch] = CLAMPS(v, 0.0f, 1.0f) * (HISTOGRAM_BINS - 1);
+    // 1.0 is at 8/9 of the height of the waveform!
+    // Using ceilf brings everything <= 0 to bottom tone,
+    // everything > 1.0f/(num_tones-1) to top tone.
+    tone[ch] = ceilf(CLAMPS((8.0f / 9.0f) * v, 0.0f, 1.0f) * (num_tones - 1));
   }
-
-  _lib_histogram_vectorscope_bkgd(d, vs_prof);
-  // FIXME: particularly for u*v*, center on hue ring bounds rather than plot center, to be able to show a larger plot?
-  const float max_radius = d->vectorscope_radius;
-  const float max_diam = max_radius * 2.f;
-
-  int sample_width = MAX(1, roi->width - roi->crop_width - roi->crop_x);
-  int sample_height = MAX(1, roi->height - roi->crop_height - roi->crop_y);
-  if(sample_width == 1 && sample_height == 1)
+  for(size_t ch = 0; ch < 3; ch++)
   {
-    // point sample still calculates graph based on whole image
-    sample_width = roi->width;
-    sample_height = roi->height;
-    roi->crop_x = roi->crop_y = 0;
+    hist[4 * bin[ch] + ch]++;
+    wf_binned[num_tones * (ch * num_bins + wf_bin) + tone[ch]]++;
   }
+}
+
+// sample every step-th pixel of every step-th row if processing the whole region would exceed the time budget
+static int _lib_histogram_sample_step(const dt_lib_histogram_t *const d, const gboolean full, const size_t pixels)
+{
+  if(full) return 1;
+  const double estimate = d->scopes_sample_cost * pixels;
+  if(estimate <= SCOPES_TIME_BUDGET) return 1;
+  return MIN(SCOPES_MAX_STEP, (int)ceil(sqrt(estimate / SCOPES_TIME_BUDGET)));
+}
+
+static void _lib_histogram_finish_waveform(dt_lib_histogram_t *const d, const uint32_t *const partial_binned,
+                                           const size_t bin_pad, const size_t num_bins, const float scale)
+{
+  const dt_lib_histogram_orient_t orient = d->scope_orient;
+  const size_t num_tones = d->waveform_tones;
+
+  // shortcut to change from linear to display gamma -- borrow hybrid log-gamma LUT
+  const dt_iop_order_iccprofile_info_t *const profile =
+    dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_HLG_REC2020, "", DT_INTENT_PERCEPTUAL);
+  // lut for all three channels should be the same
+  const float *const restrict lut = DT_IS_ALIGNED((const float *const restrict)profile->lut_out[0]);
+  const float lutmax = profile->lutsize - 1;
+  const size_t wf_img_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8,
+                                                             orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? num_bins : num_tones);
+  const size_t hist_size = 4U * HISTOGRAM_BINS;
+  size_t nthreads = dt_get_num_threads();
 
-  const float *rgb2ryb_ypp = d->rgb2ryb_ypp;
-  // RGB -> chromaticity (processor-heavy), count into bins by chromaticity
-  // FIXME: if we do convert to histogram RGB, should it be an absolute colorimetric conversion (would mean knowing the histogram profile whitepoint and un-adapting its matrices) and then we have a meaningful whitepoint and could plot spectral locus -- or the reverse, adapt the spectral locus to the histogram profile PCS (always D50)?
-  // FIXME: pre-allocate? -- use the same buffer as for waveform?
-  dt_atomic_int *const restrict binned = __builtin_assume_aligned(dt_alloc_align(64, sizeof(int) * diam_px * diam_px), 64);
-  memset(binned, 0, sizeof(int) * diam_px * diam_px);
-  // FIXME: move verbosed interleaved comments into a method note at the start, as the code itself is succinct and clear
-  // FIXME: even with getting rid of the extra profile conversion hop there's no noticeable speedup -- maybe this loop is memory bound -- if can get rid of one of the output buffers and still no speedup, consider doing more work in this loop, such as atomic binning
-  // FIXME: make 2x2 averaging be conditional on preprocessor define
-  // FIXME: average neighboring pixels on x but not y -- may be enough of an optimization
-  const int sample_max_x = sample_width - (sample_width % 2);
-  const int sample_max_y = sample_height - (sample_height % 2);
-  // FIXME: if decimate/downsample, should blur before this
-  // FIXME: instead of scaling, if chromaticity really depends only on XY, then make a lookup on startup of for each grid cell on graph output the minimum XY to populate that cell, then either brute-force scan that LUT, or start from position of last pixel and scan, or do an optimized search (1/2, 1/2, 1/2, etc.) -- would also find point sample pixel this way
 #if defined(_OPENMP)
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(input, binned, sample_max_x, sample_max_y, roi, rgb2ryb_ypp, diam_px, max_radius, max_diam, vs_prof, vs_type, vs_scale) \
-  schedule(static) collapse(2)
+  dt_omp_firstprivate(d, partial_binned, bin_pad, wf_img_stride, num_bins, num_tones, orient, lut, lutmax, scale, nthreads, hist_size) \
+  schedule(static) collapse(3)
 #endif
-  for(size_t y=0; y<sample_max_y; y+=2)
-    for(size_t x=0; x<sample_max_x; x+=2)
-    {
-      // FIXME: There are unnecessary color math hops. Right now the data
-      // comes into dt_lib_histogram_process() in a known profile
-      // (usually from pixelpipe). Then (usually) it gets converted to
-      // the histogram profile. Here it gets converted to XYZ D50 before
-      // making its way to L*u*v* or JzAzBz:
-      //   RGB (pixelpipe) -> XYZ(PCS, D50) -> RGB (histogram) -> XYZ (PCS, D50) -> chromaticity
-      // Given that the histogram profile is "well behaved" and the
-      // conversion to histogram profile is relative colorimetric, could
-      // instead:
-      //   RGB (pixelpipe) -> XYZ(PCS, D50) -> chromaticity
-      // A catch is that pixelpipe RGB may be a CLUT profile, hence would
-      // need to have an LCMS path unless histogram moves to before colorout.
-      dt_aligned_pixel_t RGB = {0.f}, chromaticity;
-      // FIXME: for speed, downsample 2x2 -> 1x1 here, which still should produce enough chromaticity data -- Question: AVERAGE(RGBx4) -> chromaticity, or AVERAGE((RGB -> chromaticity)x4)?
-      // FIXME: could compromise and downsample to 2x1 -- may also be a bit faster than skipping rows
-      const float *const restrict px = DT_IS_ALIGNED((const float *const restrict)input +
-                                                     4U * ((y + roi->crop_y) * roi->width + x + roi->crop_x));
-      for(size_t xx=0; xx<2; xx++)
-        for(size_t yy=0; yy<2; yy++)
-          for_each_channel(ch, aligned(px,RGB:16))
-            RGB[ch] += px[4U * (yy * roi->width + xx) + ch] * 0.25f;
-
-      _get_chromaticity(RGB, chromaticity, vs_type, vs_prof, rgb2ryb_ypp);
-      // FIXME: we ignore the L or Jz components -- do they optimize out of the above code, or would in particular a XYZ_2_AzBz but helpful?
-      if(vs_scale == DT_LIB_HISTOGRAM_SCALE_LOGARITHMIC)
-        log_scale(&chromaticity[1], &chromaticity[2], max_radius);
+  for(size_t ch = 0; ch < 3; ch++)
+    for(size_t bin = 0; bin < num_bins; bin++)
+      for(size_t tone = 0; tone < num_tones; tone++)
+      {
+        uint8_t *const restrict wf_img = DT_IS_ALIGNED((uint8_t *const restrict)d->waveform_img[ch]);
+        uint32_t acc = 0;
+        for(size_t n = 0; n < nthreads; n++)
+        {
+          const uint32_t *const restrict binned = dt_get_bythread(partial_binned, bin_pad, n) + hist_size;
+          acc += binned[num_tones * (ch * num_bins + bin) + tone];
+        }
+        const float linear = MIN(1.f, scale * acc);
+        const uint8_t display = lut[(int)(linear * lutmax)] * 255.f;
+        if(orient == DT_LIB_HISTOGRAM_ORIENT_HORI)
+          wf_img[tone * wf_img_stride + bin] = display;
+        else
+          wf_img[bin * wf_img_stride + tone] = display;
+      }
 
-      // FIXME: make cx,cy which are float, check 0 <= cx < 1, then multiply by diam_px
-      const int out_x = (diam_px-1) * (chromaticity[1] / max_diam + 0.5f);
-      const int out_y = (diam_px-1) * (chromaticity[2] / max_diam + 0.5f);
+  d->waveform_bins = num_bins;
+}
 
-      // clip any out-of-scale values, so there aren't light edges
-      if(out_x >= 0 && out_x <= diam_px-1 && out_y >= 0 && out_y <= diam_px-1)
-        dt_atomic_add_int(binned + out_y * diam_px + out_x, 1);
-    }
+static void _lib_histogram_finish_vectorscope(dt_lib_histogram_t *d, const dt_atomic_int *const binned,
+                                              const dt_iop_order_iccprofile_info_t *vs_prof, const float scale)
+{
+  const int diam_px = d->vectorscope_diameter_px;
+  const dt_lib_histogram_vectorscope_type_t vs_type = d->vectorscope_type;
+  const dt_lib_histogram_scale_t vs_scale = d->vectorscope_scale;
+  const float max_radius = d->vectorscope_radius;
+  const float *rgb2ryb_ypp = d->rgb2ryb_ypp;
 
   dt_aligned_pixel_t RGB = {0.f}, chromaticity;
   const dt_lib_colorpicker_statistic_t statistic = darktable.lib->proxy.colorpicker.statistic;
@@ -718,10 +610,6 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   const int out_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8, diam_px);
   uint8_t *const graph = d->vectorscope_graph;
 
-  // FIXME: should count the max bin size, and vary the scale such that it is always 1?
-  const float gain = 1.f / 30.f;
-  const float scale = gain * (diam_px * diam_px) / (sample_width * sample_height);
-
   // loop appears to be too small to benefit w/OpenMP
   // FIXME: is this still true?
   for(size_t out_y = 0; out_y < diam_px; out_y++)
@@ -731,8 +619,219 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
       const float intensity = lut[(int)(MIN(1.f, scale * count) * lutmax)];
       graph[out_y * out_stride + out_x] = intensity * 255.0f;
     }
+}
+
+// Computes the scopes -- histogram, waveform/rgb parade and, if it is
+// shown, vectorscope -- in a single pass over the image, so that
+// switching between histogram and waveform doesn't need to reprocess
+// anything. Each worker thread bins histogram and waveform into its
+// own buffers. The vectorscope is much more expensive per pixel, so
+// it is only computed while visible, and being sparse, it is binned
+// with atomics into a shared buffer.
+//
+// To keep the scopes real-time while dragging sliders, the cost per
+// sample of the previous run is used to estimate the time of this
+// one. If that exceeds SCOPES_TIME_BUDGET, only every step-th pixel
+// of every step-th row is sampled and the counts are scaled up
+// accordingly, unless full is set.
+static void _lib_histogram_process_scopes(dt_lib_histogram_t *const d, const float *const input,
+                                          const dt_histogram_roi_t *const roi,
+                                          const dt_iop_order_iccprofile_info_t *vs_prof, const gboolean full)
+{
+  const gboolean vectorscope = d->scope_type == DT_LIB_HISTOGRAM_SCOPE_VECTORSCOPE;
+  if(vectorscope)
+  {
+    if(!vs_prof || isnan(vs_prof->matrix_in[0][0]))
+    {
+      fprintf(stderr, "[histogram] unsupported vectorscope profile %i %s, it will be replaced with linear rec2020\n", vs_prof->type, vs_prof->filename);
+      vs_prof = dt_ioppr_add_profile_info_to_list(darktable.develop, DT_COLORSPACE_LIN_REC2020, "", DT_INTENT_RELATIVE_COLORIMETRIC);
+    }
+    _lib_histogram_vectorscope_bkgd(d, vs_prof);
+  }
+
+  // histogram and waveform cover the colorpicker area, if any
+  // FIXME: for point sample, calculate whole graph and the point sample values, draw these on top of the graph
+  const int hist_x = roi->crop_x, hist_y = roi->crop_y;
+  const int hist_width = MAX(1, roi->width - roi->crop_width - roi->crop_x);
+  const int hist_height = MAX(1, roi->height - roi->crop_height - roi->crop_y);
+  // point sample still calculates the vectorscope based on whole image, the histogram and waveform just bin
+  // that pixel. without a vectorscope, the image isn't sampled at all then.
+  const gboolean point = hist_width == 1 && hist_height == 1;
+  const gboolean sample_image = !point || vectorscope;
+  const int sample_x = point ? 0 : hist_x, sample_y = point ? 0 : hist_y;
+  const int sample_width = point ? roi->width : hist_width;
+  const int sample_height = !sample_image ? 0 : point ? roi->height : hist_height;
+
+  const int step = sample_image ? _lib_histogram_sample_step(d, full, (size_t)sample_width * sample_height) : 1;
+  const int hist_step = point ? 1 : step;
+  d->scopes_step = step;
+
+  // Use integral sized bins for columns, as otherwise they will be
+  // unequal and have banding. Rely on draw to smoothly do horizontal
+  // scaling. For a horizontal waveform of a 3:2 image, "landscape"
+  // orientation, bin_width will generally be 4, for "portrait" it
+  // will generally be 3. Note that waveform_bins varies, depending on
+  // preview image width and # of bins. When sampling, bins span a
+  // multiple of the step so that each holds the same # of samples.
+  const dt_lib_histogram_orient_t orient = d->scope_orient;
+  const int to_bin = orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? hist_width : hist_height;
+  const size_t samples_per_bin = hist_step * (size_t)ceilf(ceilf(to_bin / (float)d->waveform_max_bins) / hist_step);
+  const size_t num_bins = ceilf(to_bin / (float)samples_per_bin);
+  const size_t num_tones = d->waveform_tones;
+
+  // Note that, with current constants, the input buffer is from the
+  // preview pixelpipe and should be <= 1440x900x4. The output buffers
+  // will be <= 360x160x3 for the waveform and 384x384 for the
+  // vectorscope. Hence process works with a relatively small quantity
+  // of data.
+  const size_t hist_size = 4U * HISTOGRAM_BINS;
+  size_t bin_pad;
+  uint32_t *const restrict partial_binned = dt_calloc_perthread(hist_size + 3U * num_bins * num_tones,
+                                                                sizeof(uint32_t), &bin_pad);
+
+  const int diam_px = d->vectorscope_diameter_px;
+  const dt_lib_histogram_vectorscope_type_t vs_type = d->vectorscope_type;
+  const dt_lib_histogram_scale_t vs_scale = d->vectorscope_scale;
+  // FIXME: particularly for u*v*, center on hue ring bounds rather than plot center, to be able to show a larger plot?
+  const float max_radius = d->vectorscope_radius;
+  const float max_diam = max_radius * 2.f;
+  const float *rgb2ryb_ypp = d->rgb2ryb_ypp;
+  dt_atomic_int *const restrict vs_binned
+    = vectorscope ? __builtin_assume_aligned(dt_alloc_align(64, sizeof(int) * diam_px * diam_px), 64) : NULL;
+
+  if(!partial_binned || (vectorscope && !vs_binned))
+  {
+    dt_free_align(partial_binned);
+    dt_free_align(vs_binned);
+    return;
+  }
+  if(vectorscope) memset(vs_binned, 0, sizeof(int) * diam_px * diam_px);
+
+  const double start = dt_get_wtime();
+
+#if defined(_OPENMP)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(input, partial_binned, bin_pad, hist_size, roi, point, step, sample_x, sample_y, sample_width, sample_height, \
+                      orient, samples_per_bin, num_bins, num_tones, vs_binned, rgb2ryb_ypp, diam_px, max_radius, max_diam, \
+                      vs_prof, vs_type, vs_scale, vectorscope) \
+  schedule(static)
+#endif
+  for(int j = 0; j < sample_height; j += step)
+  {
+    const float *const restrict row = DT_IS_ALIGNED((const float *const restrict)input +
+                                                    4U * ((size_t)(j + sample_y) * roi->width + sample_x));
+    uint32_t *const restrict hist = dt_get_perthread(partial_binned, bin_pad);
+
+    if(!point)
+      for(int i = 0; i < sample_width; i += step)
+        _lib_histogram_bin_pixel(row + 4U * i, hist, hist + hist_size,
+                                 (orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? i : j) / samples_per_bin,
+                                 num_bins, num_tones);
+
+    // the vectorscope averages 2x2 blocks, every other sampled row starts one
+    if(!vectorscope || j % (2 * step) || j + 1 >= sample_height) continue;
+
+    // RGB -> chromaticity (processor-heavy), count into bins by chromaticity
+    // FIXME: There are unnecessary color math hops. Right now the data
+    // comes into dt_lib_histogram_process() in a known profile
+    // (usually from pixelpipe). Then (usually) it gets converted to
+    // the histogram profile. Here it gets converted to XYZ D50 before
+    // making its way to L*u*v* or JzAzBz:
+    //   RGB (pixelpipe) -> XYZ(PCS, D50) -> RGB (histogram) -> XYZ (PCS, D50) -> chromaticity
+    // Given that the histogram profile is "well behaved" and the
+    // conversion to histogram profile is relative colorimetric, could
+    // instead:
+    //   RGB (pixelpipe) -> XYZ(PCS, D50) -> chromaticity
+    // A catch is that pixelpipe RGB may be a CLUT profile, hence would
+    // need to have an LCMS path unless histogram moves to before colorout.
+    for(int i = 0; i + 1 < sample_width; i += 2 * step)
+    {
+      const float *const restrict px = row + 4U * i;
+      dt_aligned_pixel_t RGB = {0.f}, chromaticity;
+      for(size_t xx=0; xx<2; xx++)
+        for(size_t yy=0; yy<2; yy++)
+          for_each_channel(ch, aligned(px,RGB:16))
+            RGB[ch] += px[4U * (yy * roi->width + xx) + ch] * 0.25f;
+
+      _get_chromaticity(RGB, chromaticity, vs_type, vs_prof, rgb2ryb_ypp);
+      if(vs_scale == DT_LIB_HISTOGRAM_SCALE_LOGARITHMIC)
+        log_scale(&chromaticity[1], &chromaticity[2], max_radius);
+
+      const int out_x = (diam_px-1) * (chromaticity[1] / max_diam + 0.5f);
+      const int out_y = (diam_px-1) * (chromaticity[2] / max_diam + 0.5f);
+
+      // clip any out-of-scale values, so there aren't light edges
+      if(out_x >= 0 && out_x <= diam_px-1 && out_y >= 0 && out_y <= diam_px-1)
+        dt_atomic_add_int(vs_binned + out_y * diam_px + out_x, 1);
+    }
+  }
+
+  if(point)
+    _lib_histogram_bin_pixel(input + 4U * ((size_t)hist_y * roi->width + hist_x),
+                             dt_get_bythread(partial_binned, bin_pad, 0),
+                             dt_get_bythread(partial_binned, bin_pad, 0) + hist_size, 0, num_bins, num_tones);
 
-  dt_free_align(binned);
+  // the cost of a sample depends on which scopes are binned for it, a single point doesn't tell
+  const size_t samples = (size_t)((sample_width + step - 1) / step) * ((sample_height + step - 1) / step);
+  if(samples) d->scopes_sample_cost = (dt_get_wtime() - start) / samples;
+
+  // histogram: reduce the per-thread bins
+  const size_t nthreads = dt_get_num_threads();
+  for(size_t k = 0; k < hist_size; k++)
+  {
+    uint32_t acc = 0;
+    for(size_t n = 0; n < nthreads; n++)
+      acc += dt_get_bythread(partial_binned, bin_pad, n)[k];
+    d->histogram[k] = acc;
+  }
+  // don't count <= 0 pixels
+  d->histogram_max = 0;
+  for(size_t k = 4; k < hist_size; k += 4)
+    d->histogram_max = MAX(d->histogram_max, MAX(MAX(d->histogram[k], d->histogram[k + 1]), d->histogram[k + 2]));
+
+  // Every bin_width x height portion of the image is being described
+  // in a 1 pixel x waveform_tones portion of the histogram.
+  // NOTE: if constant is decreased, will brighten output
+  // FIXME: instead of using an area-beased scale, figure out max bin count and scale to that?
+  const float brightness = num_tones / 40.0f;
+  const float wf_scale = brightness * hist_step * hist_step
+                         / ((orient == DT_LIB_HISTOGRAM_ORIENT_HORI ? hist_height : hist_width) * samples_per_bin);
+  _lib_histogram_finish_waveform(d, partial_binned, bin_pad, num_bins, wf_scale);
+
+  if(vectorscope)
+  {
+    // FIXME: should count the max bin size, and vary the scale such that it is always 1?
+    const float gain = 1.f / 30.f;
+    const float vs_scale_factor = gain * step * step * (diam_px * diam_px) / (sample_width * sample_height);
+    _lib_histogram_finish_vectorscope(d, vs_binned, vs_prof, vs_scale_factor);
+  }
+
+  dt_free_align(partial_binned);
+  dt_free_align(vs_binned);
+}
+
+// computes the scopes of the last sparsely sampled image in full, once no new one came for a while
+static gboolean _lib_histogram_settle_callback(gpointer user_data)
+{
+  dt_lib_module_t *self = (dt_lib_module_t *)user_data;
+  dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
+
+  dt_pthread_mutex_lock(&d->lock);
+  if(d->scopes_pending && dt_get_wtime() - d->scopes_pending_time < SCOPES_SETTLE_TIME / 1000.0)
+  {
+    dt_pthread_mutex_unlock(&d->lock);
+    return G_SOURCE_CONTINUE;
+  }
+  if(d->scopes_pending)
+    _lib_histogram_process_scopes(d, d->scopes_pending, &d->scopes_pending_roi, d->scopes_pending_profile, TRUE);
+  const gboolean computed = d->scopes_pending != NULL;
+  dt_free_align(d->scopes_pending);
+  d->scopes_pending = NULL;
+  d->scopes_settle_timeout = 0;
+  dt_pthread_mutex_unlock(&d->lock);
+
+  if(computed) dt_control_queue_redraw_widget(d->scope_draw);
+  return G_SOURCE_REMOVE;
 }
 
 static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *const input,
@@ -752,6 +851,8 @@ static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *
     memset(d->histogram, 0, sizeof(uint32_t) * 4 * HISTOGRAM_BINS);
     d->waveform_bins = 0;
     d->vectorscope_radius = 0.f;
+    dt_free_align(d->scopes_pending);
+    d->scopes_pending = NULL;
     dt_pthread_mutex_unlock(&d->lock);
     return;
   }
@@ -801,26 +902,24 @@ static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *
   dt_ioppr_transform_image_colorspace_rgb(input, img_display, width, height,
                                           profile_info_from, profile_info_to, "final histogram");
   dt_pthread_mutex_lock(&d->lock);
-  switch(d->scope_type)
+  _lib_histogram_process_scopes(d, img_display, &roi, profile_info_to, FALSE);
+  // keep a sparsely sampled image until processing settles, then compute its scopes in full
+  dt_free_align(d->scopes_pending);
+  d->scopes_pending = NULL;
+  if(d->scopes_step > 1)
   {
-    case DT_LIB_HISTOGRAM_SCOPE_HISTOGRAM:
-      _lib_histogram_process_histogram(d, img_display, &roi);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_WAVEFORM:
-    case DT_LIB_HISTOGRAM_SCOPE_PARADE:
-      _lib_histogram_process_waveform(d, img_display, &roi);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_VECTORSCOPE:
-      _lib_histogram_process_vectorscope(d, img_display, &roi, profile_info_to);
-      break;
-    case DT_LIB_HISTOGRAM_SCOPE_N:
-      dt_unreachable_codepath();
-      break;
+    d->scopes_pending = img_display;
+    d->scopes_pending_roi = roi;
+    d->scopes_pending_profile = profile_info_to;
+    d->scopes_pending_time = dt_get_wtime();
+    img_display = NULL;
+    if(!d->scopes_settle_timeout)
+      d->scopes_settle_timeout = g_timeout_add(SCOPES_SETTLE_TIME, _lib_histogram_settle_callback, self);
   }
   dt_pthread_mutex_unlock(&d->lock);
   dt_free_align(img_display);
 
-  dt_show_times_f(&start, "[histogram]", "final %s", dt_lib_histogram_scope_type_names[d->scope_type]);
+  dt_show_times_f(&start, "[histogram]", "final scopes, sampling every %d pixel(s)", d->scopes_step);
 }
 
 
@@ -1558,14 +1657,14 @@ static void _scope_type_clicked(GtkWidget *button, dt_lib_histogram_t *d)
   dt_conf_set_string("plugins/darkroom/histogram/mode", dt_lib_histogram_scope_type_names[d->scope_type]);
   _scope_type_update(d);
 
-  if(d->scope_type == DT_LIB_HISTOGRAM_SCOPE_PARADE)
+  if(d->scope_type != DT_LIB_HISTOGRAM_SCOPE_VECTORSCOPE)
   {
-    // waveform and RGB parade both work on the same underlying data
+    // histogram and waveform are always computed together, the data for the new one is already there
     dt_control_queue_redraw_widget(d->scope_draw);
   }
   else
   {
-    // generate data for changed scope and trigger widget redraw
+    // the vectorscope is only computed while shown, generate its data and trigger widget redraw
     const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
     if(cv->view(cv) == DT_VIEW_DARKROOM)
       dt_dev_process_preview(darktable.develop);
@@ -2099,6 +2198,8 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
 
+  if(d->scopes_settle_timeout) g_source_remove(d->scopes_settle_timeout);
+  dt_free_align(d->scopes_pending);
   free(d->histogram);
   for(int ch=0; ch<3; ch++)
     dt_free_align(d->waveform_img[ch]);
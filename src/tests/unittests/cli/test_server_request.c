@@ -0,0 +1,262 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for reading the requests of the darktable-cli server mode in cli/server_request.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "cli/server_request.c"
+
+/*
+ * DEFINITIONS
+ */
+
+// a reader on a connection the client has already sent data over and closed for writing, so that reading
+// past its end never waits for the read timeout
+static dt_cli_reader_t *_reader_new(const char *data, const size_t size)
+{
+  int fds[2];
+  assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  size_t done = 0;
+  while(done < size)
+  {
+    const ssize_t n = write(fds[1], data + done, size - done);
+    assert_true(n > 0);
+    done += n;
+  }
+  close(fds[1]);
+
+  dt_cli_reader_t *r = calloc(1, sizeof(dt_cli_reader_t));
+  r->fd = fds[0];
+  return r;
+}
+
+static void _reader_free(dt_cli_reader_t *r)
+{
+  close(r->fd);
+  free(r);
+}
+
+// read a single request from data
+static int _read_one(const char *data, dt_cli_request_t *req, const char **error)
+{
+  dt_cli_reader_t *r = _reader_new(data, strlen(data));
+  const int res = dt_cli_read_request(r, req, error);
+  _reader_free(r);
+  return res;
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_has_header(void **state)
+{
+  const struct
+  {
+    const char *data;
+    gboolean complete;
+  } cases[] = {
+    { "", FALSE },
+    { "input a.raw\n", FALSE },
+    { "input a.raw\n\n", TRUE },
+    { "input a.raw\r\n", FALSE },
+    { "input a.raw\r\n\r", FALSE },
+    { "input a.raw\r\n\r\n", TRUE },
+    { "\n\r\n", FALSE },
+    { "\n\ninput a.raw\n", FALSE },
+    { "\r\n\r\ninput a.raw\nwidth 100\n\n", TRUE },
+  };
+
+  for(size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++)
+  {
+    gchar *escaped = g_strescape(cases[k].data, NULL);
+    TR_STEP("verify that a complete header is recognized in \"%s\"", escaped);
+    g_free(escaped);
+    dt_cli_reader_t *r = _reader_new(cases[k].data, strlen(cases[k].data));
+    if(*cases[k].data) assert_true(dt_cli_reader_append(r));
+    assert_int_equal(dt_cli_reader_has_header(r), cases[k].complete);
+    _reader_free(r);
+  }
+}
+
+static void test_crlf(void **state)
+{
+  dt_cli_request_t req;
+  const char *error;
+
+  TR_STEP("verify that lines may end in CRLF");
+  assert_int_equal(_read_one("input a.raw\r\nformat png\r\nwidth 100\r\nhq false\r\n\r\n", &req, &error), 0);
+  assert_null(error);
+  assert_string_equal(req.input, "a.raw");
+  assert_string_equal(req.format, "png");
+  assert_int_equal(req.width, 100);
+  assert_int_equal(req.high_quality, FALSE);
+  dt_cli_request_cleanup(&req);
+}
+
+static void test_overlong_line(void **state)
+{
+  dt_cli_request_t req;
+  const char *error;
+
+  TR_STEP("verify that a line just below the limit is accepted");
+  GString *data = g_string_new("input ");
+  while(data->len < DT_CLI_SERVER_MAX_LINE - 1) g_string_append_c(data, 'x');
+  g_string_append(data, "\n\n");
+  assert_int_equal(_read_one(data->str, &req, &error), 0);
+  assert_int_equal(strlen(req.input), DT_CLI_SERVER_MAX_LINE - 1 - strlen("input "));
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that longer lines are rejected, also as the first line of a request");
+  g_string_insert_c(data, 6, 'x');
+  assert_int_equal(_read_one(data->str, &req, &error), -1);
+  assert_string_equal(error, "line too long");
+  dt_cli_request_cleanup(&req);
+  g_string_prepend(data, "format png\n");
+  assert_int_equal(_read_one(data->str, &req, &error), -1);
+  assert_string_equal(error, "line too long");
+  dt_cli_request_cleanup(&req);
+  g_string_free(data, TRUE);
+}
+
+static void test_xmp_size(void **state)
+{
+  dt_cli_request_t req;
+  const char *error;
+
+  const char *invalid[] = { "0", "-1", "abc", "", "16777217" };
+  for(size_t k = 0; k < sizeof(invalid) / sizeof(invalid[0]); k++)
+  {
+    TR_STEP("verify that xmp-size \"%s\" is rejected", invalid[k]);
+    gchar *data = g_strdup_printf("input a.raw\nxmp-size %s\n\n", invalid[k]);
+    assert_int_equal(_read_one(data, &req, &error), -1);
+    assert_string_equal(error, "invalid xmp-size");
+    assert_int_equal(req.xmp_size, 0);
+    dt_cli_request_cleanup(&req);
+    g_free(data);
+  }
+
+  TR_STEP("verify that the largest xmp-size is accepted");
+  assert_int_equal(_read_one("input a.raw\nxmp-size 16777216\n\n", &req, &error), 0);
+  assert_int_equal(req.xmp_size, DT_CLI_SERVER_MAX_XMP);
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that xmp and xmp-size are exclusive");
+  assert_int_equal(_read_one("input a.raw\nxmp a.xmp\nxmp-size 10\n\n", &req, &error), -1);
+  assert_string_equal(error, "xmp and xmp-size are exclusive");
+  dt_cli_request_cleanup(&req);
+}
+
+static void test_invalid_keys(void **state)
+{
+  dt_cli_request_t req;
+  const char *error;
+
+  TR_STEP("verify that unknown keys are rejected");
+  assert_int_equal(_read_one("input a.raw\nbogus 1\n\n", &req, &error), -1);
+  assert_string_equal(error, "unknown key");
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that the first error is reported");
+  assert_int_equal(_read_one("input a.raw\nhq maybe\nbogus 1\n\n", &req, &error), -1);
+  assert_string_equal(error, "invalid value for hq");
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that known keys with bad values are rejected");
+  assert_int_equal(_read_one("input a.raw\nicc-type nonsense\n\n", &req, &error), -1);
+  assert_string_equal(error, "unknown icc-type");
+  dt_cli_request_cleanup(&req);
+  assert_int_equal(_read_one("input a.raw\nicc-intent perceptual\n\n", &req, &error), 0);
+  assert_int_equal(req.icc_intent, DT_INTENT_PERCEPTUAL);
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that a request needs an input");
+  assert_int_equal(_read_one("format png\n\n", &req, &error), -1);
+  assert_string_equal(error, "no input given");
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that a header cut short is an error, and no header at all is the end");
+  assert_int_equal(_read_one("input a.raw\n", &req, &error), -1);
+  dt_cli_request_cleanup(&req);
+  assert_int_equal(_read_one("\n\n", &req, &error), 1);
+  dt_cli_request_cleanup(&req);
+}
+
+static void test_pipelined(void **state)
+{
+  const char data[] = "input a.raw\nxmp-size 5\n\n<xmp>\ninput b.raw\nformat tif\n\n";
+  dt_cli_reader_t *r = _reader_new(data, strlen(data));
+  dt_cli_request_t req;
+  const char *error;
+
+  TR_STEP("verify that the first request is read, up to its inline xmp");
+  assert_true(dt_cli_reader_append(r));
+  assert_true(dt_cli_reader_has_header(r));
+  assert_int_equal(dt_cli_read_request(r, &req, &error), 0);
+  assert_string_equal(req.input, "a.raw");
+  assert_int_equal(req.xmp_size, 5);
+  char xmp[5];
+  assert_true(dt_cli_read_bytes(r, xmp, sizeof(xmp)));
+  assert_memory_equal(xmp, "<xmp>", sizeof(xmp));
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that the second request is already buffered and read in full");
+  assert_true(dt_cli_reader_has_header(r));
+  assert_int_equal(dt_cli_read_request(r, &req, &error), 0);
+  assert_string_equal(req.input, "b.raw");
+  assert_string_equal(req.format, "tif");
+  dt_cli_request_cleanup(&req);
+
+  TR_STEP("verify that the end of the stream is reported after them");
+  assert_false(dt_cli_reader_has_header(r));
+  assert_int_equal(dt_cli_read_request(r, &req, &error), 1);
+  dt_cli_request_cleanup(&req);
+
+  _reader_free(r);
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_has_header),
+    cmocka_unit_test(test_crlf),
+    cmocka_unit_test(test_overlong_line),
+    cmocka_unit_test(test_xmp_size),
+    cmocka_unit_test(test_invalid_keys),
+    cmocka_unit_test(test_pipelined)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,195 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the subsampled guided filter of common/guided_filter.c, checking that it stays close
+ * to the full resolution filter
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/darktable.h"
+#include "common/guided_filter.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 512
+#define HEIGHT 384
+#define NPIXELS ((size_t)WIDTH * HEIGHT)
+
+// the filter output is within [0, 1], the subsampled filter must stay close to the full resolution one
+#define MEAN_E 0.01
+#define MAX_E 0.1
+// on the hard edges of a drawn mask, single pixels can be further off with the smallest subsampled windows
+#define MASK_MAX_E 0.2
+
+// deterministic color guide with smooth gradients and hard edges, and an input which partly follows the
+// guide and partly has edges of its own, the hard case for subsampling
+static void _fill(float *const guide, float *const in)
+{
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const size_t k = (size_t)y * WIDTH + x;
+      const float edge = ((x / 97 + y / 61) & 1) ? 0.6f : 0.2f;
+      for(int c = 0; c < 3; c++)
+        guide[4 * k + c] = edge + 0.15f * sinf(0.01f * x * (c + 1) + 0.02f * y) + 0.02f * cosf(0.7f * x * y);
+      guide[4 * k + 3] = 0.0f;
+      in[k] = 0.5f * guide[4 * k + 1] + 0.3f * ((x / 37 + y / 29) & 1);
+    }
+}
+
+static void _compare(const float *const fast, const float *const exact, const double max_e)
+{
+  double mean_err = 0.0, max_err = 0.0;
+  for(size_t k = 0; k < NPIXELS; k++)
+  {
+    const double err = fabs(fast[k] - exact[k]);
+    mean_err += err;
+    max_err = fmax(max_err, err);
+  }
+  mean_err /= NPIXELS;
+  TR_NOTE("mean error %.5f, max error %.4f", mean_err, max_err);
+  assert_true(mean_err < MEAN_E);
+  assert_true(max_err < max_e);
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_fast_guided_filter_accuracy(void **state)
+{
+  const int windows[] = { 16, 32, 64 };
+  const int subsamplings[] = { 2, 4, 8 };
+  const float eps = sqrtf(0.025f);
+  float *guide = dt_alloc_align_float(4 * NPIXELS);
+  float *in = dt_alloc_align_float(NPIXELS);
+  float *exact = dt_alloc_align_float(NPIXELS);
+  float *fast = dt_alloc_align_float(NPIXELS);
+  _fill(guide, in);
+
+  for(size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+  {
+    guided_filter(guide, in, exact, WIDTH, HEIGHT, 4, windows[w], eps, 1.f, -FLT_MAX, FLT_MAX);
+    for(size_t s = 0; s < sizeof(subsamplings) / sizeof(subsamplings[0]); s++)
+    {
+      // beyond a quarter of the window radius, subsampling is not expected to be accurate
+      if(subsamplings[s] > windows[w] / 4) continue;
+
+      TR_STEP("verify that subsampling by %d stays close to the full filter for window %d", subsamplings[s],
+              windows[w]);
+      fast_guided_filter(guide, in, fast, WIDTH, HEIGHT, 4, windows[w], eps, 1.f, -FLT_MAX, FLT_MAX,
+                         subsamplings[s]);
+      _compare(fast, exact, MAX_E);
+    }
+  }
+
+  dt_free_align(guide);
+  dt_free_align(in);
+  dt_free_align(exact);
+  dt_free_align(fast);
+}
+
+static void test_fast_guided_filter_feathering(void **state)
+{
+  float *guide = dt_alloc_align_float(4 * NPIXELS);
+  float *mask = dt_alloc_align_float(NPIXELS);
+  float *exact = dt_alloc_align_float(NPIXELS);
+  float *fast = dt_alloc_align_float(NPIXELS);
+  _fill(guide, mask);
+  // a hard edged mask, as drawn
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const float dx = x - WIDTH / 2, dy = y - HEIGHT / 2;
+      mask[(size_t)y * WIDTH + x] = dx * dx + dy * dy < 0.1f * WIDTH * WIDTH ? 1.0f : 0.0f;
+    }
+
+  // the parameters of the blend mask feathering, with windows up to twice the largest radius
+  const int windows[] = { 16, 100, 500 };
+  for(size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+  {
+    TR_STEP("verify that feathering a mask with window %d stays close to the full filter", windows[w]);
+    guided_filter(guide, mask, exact, WIDTH, HEIGHT, 4, windows[w], 1.f, 100.f, 0.f, 1.f);
+    fast_guided_filter(guide, mask, fast, WIDTH, HEIGHT, 4, windows[w], 1.f, 100.f, 0.f, 1.f,
+                       guided_filter_subsampling(windows[w]));
+    _compare(fast, exact, MASK_MAX_E);
+  }
+
+  dt_free_align(guide);
+  dt_free_align(mask);
+  dt_free_align(exact);
+  dt_free_align(fast);
+}
+
+static void test_fast_guided_filter_fallback(void **state)
+{
+  const float eps = sqrtf(0.025f);
+  float *guide = dt_alloc_align_float(4 * NPIXELS);
+  float *in = dt_alloc_align_float(NPIXELS);
+  float *exact = dt_alloc_align_float(NPIXELS);
+  float *fast = dt_alloc_align_float(NPIXELS);
+  _fill(guide, in);
+
+  TR_STEP("verify that small windows are not subsampled");
+  assert_int_equal(guided_filter_subsampling(9), 1);
+
+  TR_STEP("verify that no subsampling gives the full resolution filter");
+  guided_filter(guide, in, exact, WIDTH, HEIGHT, 4, 9, eps, 1.f, -FLT_MAX, FLT_MAX);
+  fast_guided_filter(guide, in, fast, WIDTH, HEIGHT, 4, 9, eps, 1.f, -FLT_MAX, FLT_MAX,
+                     guided_filter_subsampling(9));
+  assert_memory_equal(fast, exact, NPIXELS * sizeof(float));
+
+  dt_free_align(guide);
+  dt_free_align(in);
+  dt_free_align(exact);
+  dt_free_align(fast);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fast_guided_filter_accuracy),
+    cmocka_unit_test(test_fast_guided_filter_feathering),
+    cmocka_unit_test(test_fast_guided_filter_fallback)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,201 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the laplace solver of common/heal.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/heal.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// the solvers stop at 0.1/255 per update, allow for a few of these
+#define E 1e-3f
+// the reference is iterated until the laplace equation holds to this in every cell, about as close as float
+// precision gets
+#define REF_RESIDUAL 1e-6f
+#define REF_MAX_ITER 20000
+
+typedef struct heal_problem_t
+{
+  int width, height;
+  float *pixels; // difference image, with the extra empty pixel the solver wants
+  float *mask;
+} heal_problem_t;
+
+// smooth, deterministic difference image with a round shape to heal in the middle
+static heal_problem_t heal_problem_alloc(const int radius)
+{
+  heal_problem_t hp;
+  hp.width = hp.height = 2 * radius + 16;
+  hp.pixels = dt_alloc_align_float((size_t)4 * hp.width * (hp.height + 1));
+  hp.mask = dt_alloc_align_float((size_t)hp.width * hp.height);
+  for(int y = 0; y < hp.height; y++)
+    for(int x = 0; x < hp.width; x++)
+    {
+      float *p = hp.pixels + 4 * ((size_t)y * hp.width + x);
+      for(int c = 0; c < 4; c++)
+        p[c] = 0.2f * sinf(0.05f * x + c) * cosf(0.03f * y) + 0.1f * cosf(0.07f * x - c);
+      const int dx = x - hp.width / 2, dy = y - hp.height / 2;
+      hp.mask[(size_t)y * hp.width + x] = dx * dx + dy * dy < radius * radius ? 1.0f : 0.0f;
+    }
+  return hp;
+}
+
+static heal_problem_t heal_problem_copy(const heal_problem_t *const hp)
+{
+  heal_problem_t copy = *hp;
+  copy.pixels = dt_alloc_align_float((size_t)4 * hp->width * (hp->height + 1));
+  memcpy(copy.pixels, hp->pixels, sizeof(float) * 4 * hp->width * (hp->height + 1));
+  copy.mask = NULL;
+  return copy;
+}
+
+static void heal_problem_free(heal_problem_t *hp)
+{
+  dt_free_align(hp->pixels);
+  dt_free_align(hp->mask);
+}
+
+// largest residual of the laplace equation over the healed cells
+static float heal_residual(const float *const pixels, const int nmask, const float *const Adiag,
+                           const int *const Aidx)
+{
+  float residual = 0.0f;
+  for(int i = 0; i < nmask; i++)
+    for(int c = 0; c < 3; c++)
+    {
+      float r = Adiag[i] * pixels[Aidx[5 * i] + c];
+      for(int n = 1; n < 5; n++) r -= pixels[Aidx[5 * i + n] + c];
+      residual = fmaxf(residual, fabsf(r));
+    }
+  return residual;
+}
+
+// the SOR loop stops once its updates get small, which on large shapes can happen well before it has
+// converged. the reference runs the same iterations until the residual says it has.
+static void heal_reference(heal_problem_t *hp)
+{
+  float *Adiag = dt_alloc_align_float((size_t)hp->width * hp->height);
+  int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * hp->width * hp->height);
+  int nmask2 = 0;
+  const int nmask = dt_heal_build_system(hp->mask, hp->width, hp->height, Adiag, Aidx, &nmask2);
+  const float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
+
+  memset(hp->pixels + (size_t)4 * hp->width * hp->height, 0, sizeof(float) * 4);
+  int iter = 0;
+  for(; iter < REF_MAX_ITER && heal_residual(hp->pixels, nmask, Adiag, Aidx) > REF_RESIDUAL; iter += 50)
+    for(int k = 0; k < 50; k++)
+    {
+      dt_heal_laplace_iteration(hp->pixels, Adiag, Aidx, w, 0, nmask2);
+      dt_heal_laplace_iteration(hp->pixels, Adiag, Aidx, w, nmask2, nmask);
+    }
+  TR_NOTE("reference took %d iterations", iter);
+  assert_true(iter < REF_MAX_ITER);
+
+  dt_free_align(Adiag);
+  dt_free_align(Aidx);
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_laplace_multigrid(void **state)
+{
+  // the reference gets slow beyond this
+  const int radii[] = { 24, 48, 96 };
+
+  for(int r = 0; r < sizeof(radii) / sizeof(radii[0]); r++)
+  {
+    TR_STEP("verify that multigrid and plain SOR heal a disk of radius %d like the converged solution", radii[r]);
+    heal_problem_t ref = heal_problem_alloc(radii[r]);
+    heal_problem_t sor = heal_problem_copy(&ref);
+    heal_problem_t mg = heal_problem_copy(&ref);
+
+    const double start = dt_get_wtime();
+    dt_heal_laplace_loop(sor.pixels, sor.width, sor.height, ref.mask, FALSE);
+    const double mid = dt_get_wtime();
+    dt_heal_laplace_loop(mg.pixels, mg.width, mg.height, ref.mask, TRUE);
+    const double end = dt_get_wtime();
+
+    TR_NOTE("radius %3d: SOR %.3f s, multigrid %.3f s", radii[r], mid - start, end - mid);
+
+    heal_reference(&ref);
+
+    for(size_t k = 0; k < (size_t)4 * ref.width * ref.height; k++)
+      if(k % 4 != 3)
+      {
+        assert_float_equal(sor.pixels[k], ref.pixels[k], E);
+        assert_float_equal(mg.pixels[k], ref.pixels[k], E);
+      }
+
+    heal_problem_free(&mg);
+    heal_problem_free(&sor);
+    heal_problem_free(&ref);
+  }
+}
+
+static void test_laplace_boundary(void **state)
+{
+  TR_STEP("verify that pixels outside of the shape are left alone");
+  heal_problem_t hp = heal_problem_alloc(96);
+  heal_problem_t orig = heal_problem_copy(&hp);
+
+  dt_heal_laplace_loop(hp.pixels, hp.width, hp.height, hp.mask, TRUE);
+
+  for(size_t k = 0; k < (size_t)hp.width * hp.height; k++)
+    if(!hp.mask[k])
+      for(int c = 0; c < 4; c++)
+        assert_float_equal(hp.pixels[4 * k + c], orig.pixels[4 * k + c], 0.0f);
+
+  heal_problem_free(&orig);
+  heal_problem_free(&hp);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_laplace_multigrid),
+    cmocka_unit_test(test_laplace_boundary)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,294 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for finding the embedded jpeg previews of tiff based raws in common/imageio.c, mostly
+ * with broken files
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/imageio.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define TIFF_SIZE 1024
+// where the test files put their preview
+#define JPEG_OFFSET 512
+
+// the start of a baseline jpeg, which is all the parser looks at
+static const uint8_t jpeg[] = { 0xff, 0xd8, 0xff, 0xc0, 0x00, 0x02, 0xff, 0xd9 };
+
+typedef struct tiff_entry_t
+{
+  uint16_t tag, type;
+  uint32_t count, value;
+} tiff_entry_t;
+
+typedef struct tiff_file_t
+{
+  uint8_t data[TIFF_SIZE];
+  gboolean big_endian;
+} tiff_file_t;
+
+static void tiff_put16(tiff_file_t *f, const size_t offset, const uint32_t v)
+{
+  f->data[offset + (f->big_endian ? 1 : 0)] = v & 0xff;
+  f->data[offset + (f->big_endian ? 0 : 1)] = (v >> 8) & 0xff;
+}
+
+static void tiff_put32(tiff_file_t *f, const size_t offset, const uint32_t v)
+{
+  for(int k = 0; k < 4; k++) f->data[offset + (f->big_endian ? 3 - k : k)] = (v >> (8 * k)) & 0xff;
+}
+
+// a header pointing to the first ifd, and a jpeg preview at JPEG_OFFSET
+static void tiff_init(tiff_file_t *f, const gboolean big_endian, const uint32_t first_ifd)
+{
+  memset(f, 0, sizeof(tiff_file_t));
+  f->big_endian = big_endian;
+  f->data[0] = f->data[1] = big_endian ? 'M' : 'I';
+  tiff_put16(f, 2, 42);
+  tiff_put32(f, 4, first_ifd);
+  memcpy(f->data + JPEG_OFFSET, jpeg, sizeof(jpeg));
+}
+
+static void tiff_ifd(tiff_file_t *f, const size_t offset, const tiff_entry_t *entries, const int num_entries,
+                     const uint32_t next)
+{
+  tiff_put16(f, offset, num_entries);
+  for(int k = 0; k < num_entries; k++)
+  {
+    const size_t entry = offset + 2 + 12 * k;
+    tiff_put16(f, entry, entries[k].tag);
+    tiff_put16(f, entry + 2, entries[k].type);
+    tiff_put32(f, entry + 4, entries[k].count);
+    if(entries[k].type == 3)
+      tiff_put16(f, entry + 8, entries[k].value);
+    else
+      tiff_put32(f, entry + 8, entries[k].value);
+  }
+  tiff_put32(f, offset + 2 + 12 * num_entries, next);
+}
+
+// an ifd pointing to the preview
+static void tiff_preview_ifd(tiff_file_t *f, const size_t offset, const uint32_t next)
+{
+  const tiff_entry_t entries[] = { { 0x201, 4, 1, JPEG_OFFSET }, { 0x202, 4, 1, sizeof(jpeg) } };
+  tiff_ifd(f, offset, entries, 2, next);
+}
+
+static gboolean find(const tiff_file_t *f, const size_t size, size_t *offset, size_t *length)
+{
+  *offset = *length = 0;
+  return _find_tiff_preview(f->data, size, offset, length);
+}
+
+static void assert_preview(const tiff_file_t *f)
+{
+  size_t offset, length;
+  assert_true(find(f, TIFF_SIZE, &offset, &length));
+  assert_int_equal(offset, JPEG_OFFSET);
+  assert_int_equal(length, sizeof(jpeg));
+}
+
+static void assert_no_preview(const tiff_file_t *f, const size_t size)
+{
+  size_t offset, length;
+  assert_false(find(f, size, &offset, &length));
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_preview(void **state)
+{
+  tiff_file_t f;
+  for(int big_endian = 0; big_endian < 2; big_endian++)
+  {
+    TR_STEP("verify that the preview of a %s endian file is found", big_endian ? "big" : "little");
+    tiff_init(&f, big_endian, 8);
+    tiff_preview_ifd(&f, 8, 0);
+    assert_preview(&f);
+  }
+
+  TR_STEP("verify that a preview in a sub ifd is found");
+  tiff_init(&f, FALSE, 8);
+  const tiff_entry_t sub[] = { { 0x14a, 4, 1, 64 } };
+  tiff_ifd(&f, 8, sub, 1, 0);
+  tiff_preview_ifd(&f, 64, 0);
+  assert_preview(&f);
+
+  TR_STEP("verify that a single jpeg compressed strip is taken, unless it holds raw data");
+  tiff_init(&f, FALSE, 8);
+  tiff_entry_t strip[] = { { 0x103, 3, 1, 7 }, { 0x106, 3, 1, 6 }, { 0x111, 4, 1, JPEG_OFFSET },
+                           { 0x117, 4, 1, sizeof(jpeg) } };
+  tiff_ifd(&f, 8, strip, 4, 0);
+  assert_preview(&f);
+  strip[1].value = 32803;
+  tiff_ifd(&f, 8, strip, 4, 0);
+  assert_no_preview(&f, TIFF_SIZE);
+}
+
+static void test_truncated_header(void **state)
+{
+  tiff_file_t f;
+  tiff_init(&f, FALSE, 8);
+  tiff_preview_ifd(&f, 8, 0);
+
+  TR_STEP("verify that files cut within the header have no preview");
+  for(size_t size = 0; size < 8; size++) assert_no_preview(&f, size);
+
+  TR_STEP("verify that files cut within the first ifd have no preview");
+  for(size_t size = 8; size < 8 + 2 + 2 * 12 + 4; size++) assert_no_preview(&f, size);
+
+  TR_STEP("verify that files cut within the preview have no preview");
+  assert_no_preview(&f, JPEG_OFFSET + sizeof(jpeg) - 1);
+
+  TR_STEP("verify that other byte orders and magic numbers are rejected");
+  f.data[1] = 'M';
+  assert_no_preview(&f, TIFF_SIZE);
+  tiff_init(&f, FALSE, 8);
+  tiff_preview_ifd(&f, 8, 0);
+  tiff_put16(&f, 2, 43);
+  assert_no_preview(&f, TIFF_SIZE);
+}
+
+static void test_ifd_past_eof(void **state)
+{
+  tiff_file_t f;
+  const uint32_t offsets[] = { TIFF_SIZE - 1, TIFF_SIZE, TIFF_SIZE + 100, 0x7fffffff, 0xfffffffe, 0xffffffff };
+
+  for(size_t k = 0; k < sizeof(offsets) / sizeof(offsets[0]); k++)
+  {
+    TR_STEP("verify that a first ifd at 0x%x is skipped", offsets[k]);
+    tiff_init(&f, FALSE, offsets[k]);
+    assert_no_preview(&f, TIFF_SIZE);
+
+    TR_STEP("verify that next and sub ifds at 0x%x are skipped", offsets[k]);
+    tiff_init(&f, FALSE, 8);
+    tiff_preview_ifd(&f, 8, offsets[k]);
+    assert_preview(&f);
+    const tiff_entry_t sub[] = { { 0x14a, 4, 1, offsets[k] } };
+    tiff_ifd(&f, 8, sub, 1, 64);
+    tiff_preview_ifd(&f, 64, 0);
+    assert_preview(&f);
+  }
+
+  TR_STEP("verify that an ifd with more entries than the file holds is skipped");
+  tiff_init(&f, FALSE, 8);
+  tiff_preview_ifd(&f, 8, 0);
+  tiff_put16(&f, 8, 0xffff);
+  assert_no_preview(&f, TIFF_SIZE);
+}
+
+static void test_ifd_loop(void **state)
+{
+  tiff_file_t f;
+
+  TR_STEP("verify that an ifd pointing to itself ends the search");
+  tiff_init(&f, FALSE, 8);
+  tiff_preview_ifd(&f, 8, 8);
+  assert_preview(&f);
+
+  TR_STEP("verify that a loop over two ifds ends the search");
+  tiff_init(&f, FALSE, 8);
+  tiff_ifd(&f, 8, NULL, 0, 64);
+  tiff_preview_ifd(&f, 64, 8);
+  assert_preview(&f);
+
+  TR_STEP("verify that sub ifds pointing back to their parent end the search");
+  tiff_init(&f, FALSE, 8);
+  const tiff_entry_t sub[] = { { 0x14a, 4, 1, 8 } };
+  tiff_ifd(&f, 8, sub, 1, 0);
+  assert_no_preview(&f, TIFF_SIZE);
+  const tiff_entry_t subs[] = { { 0x14a, 4, 4, 128 }, { 0x201, 4, 1, JPEG_OFFSET }, { 0x202, 4, 1, sizeof(jpeg) } };
+  tiff_ifd(&f, 8, subs, 3, 8);
+  for(int k = 0; k < 4; k++) tiff_put32(&f, 128 + 4 * k, 8);
+  assert_preview(&f);
+}
+
+static void test_oversized_strips(void **state)
+{
+  tiff_file_t f;
+  const uint32_t values[] = { TIFF_SIZE, 0x7fffffff, 0xfffffff0, 0xffffffff };
+
+  for(size_t k = 0; k < sizeof(values) / sizeof(values[0]); k++)
+  {
+    TR_STEP("verify that previews and strips of length 0x%x are skipped", values[k]);
+    tiff_init(&f, FALSE, 8);
+    const tiff_entry_t preview[] = { { 0x201, 4, 1, JPEG_OFFSET }, { 0x202, 4, 1, values[k] } };
+    tiff_ifd(&f, 8, preview, 2, 0);
+    assert_no_preview(&f, TIFF_SIZE);
+    const tiff_entry_t strip[] = { { 0x103, 3, 1, 7 }, { 0x111, 4, 1, JPEG_OFFSET }, { 0x117, 4, 1, values[k] } };
+    tiff_ifd(&f, 8, strip, 3, 0);
+    assert_no_preview(&f, TIFF_SIZE);
+
+    TR_STEP("verify that previews and strips at offset 0x%x are skipped", values[k]);
+    const tiff_entry_t preview_at[] = { { 0x201, 4, 1, values[k] }, { 0x202, 4, 1, 0x20 } };
+    tiff_ifd(&f, 8, preview_at, 2, 0);
+    assert_no_preview(&f, TIFF_SIZE);
+    const tiff_entry_t strip_at[] = { { 0x103, 3, 1, 7 }, { 0x111, 4, 1, values[k] }, { 0x117, 4, 1, 0x20 } };
+    tiff_ifd(&f, 8, strip_at, 3, 0);
+    assert_no_preview(&f, TIFF_SIZE);
+
+    TR_STEP("verify that %u strips or sub ifds don't take the parser out of the file", values[k]);
+    const tiff_entry_t strips[] = { { 0x103, 3, 1, 7 }, { 0x111, 4, values[k], JPEG_OFFSET },
+                                    { 0x117, 4, values[k], sizeof(jpeg) } };
+    tiff_ifd(&f, 8, strips, 3, 0);
+    assert_no_preview(&f, TIFF_SIZE);
+    const tiff_entry_t subs[] = { { 0x14a, 4, values[k], 64 }, { 0x201, 4, 1, JPEG_OFFSET },
+                                  { 0x202, 4, 1, sizeof(jpeg) } };
+    tiff_ifd(&f, 8, subs, 3, 0);
+    assert_preview(&f);
+  }
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_preview),
+    cmocka_unit_test(test_truncated_header),
+    cmocka_unit_test(test_ifd_past_eof),
+    cmocka_unit_test(test_ifd_loop),
+    cmocka_unit_test(test_oversized_strips)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
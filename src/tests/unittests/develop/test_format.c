@@ -0,0 +1,115 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the buffer layout conversions of develop/format.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/darktable.h"
+#include "develop/format.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 333
+#define HEIGHT 77
+
+static const dt_iop_buffer_dsc_t rgba = { .channels = 4, .datatype = TYPE_FLOAT, .layout = LAYOUT_INTERLEAVED };
+static const dt_iop_buffer_dsc_t rgb = { .channels = 3, .datatype = TYPE_FLOAT, .layout = LAYOUT_INTERLEAVED };
+static const dt_iop_buffer_dsc_t planar = { .channels = 3, .datatype = TYPE_FLOAT, .layout = LAYOUT_PLANAR };
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_legacy(void **state)
+{
+  TR_STEP("verify that only 1 and 4 interleaved channels are the legacy layout");
+  const dt_iop_buffer_dsc_t mono = { .channels = 1, .datatype = TYPE_FLOAT, .layout = LAYOUT_INTERLEAVED };
+  assert_true(dt_iop_buffer_dsc_is_legacy(&rgba));
+  assert_true(dt_iop_buffer_dsc_is_legacy(&mono));
+  assert_false(dt_iop_buffer_dsc_is_legacy(&rgb));
+  assert_false(dt_iop_buffer_dsc_is_legacy(&planar));
+}
+
+static void test_convert_layout(void **state)
+{
+  const size_t npixels = (size_t)WIDTH * HEIGHT;
+  float *in = dt_alloc_align_float(4 * npixels);
+  float *packed = dt_alloc_align_float(3 * npixels);
+  float *planes = dt_alloc_align_float(3 * npixels);
+  float *out = dt_alloc_align_float(4 * npixels);
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 4; c++) in[4 * k + c] = c == 3 ? 0.0f : k + 0.25f * c;
+
+  TR_STEP("verify 4 channels to 3 channels");
+  assert_int_equal(dt_iop_buffer_convert_layout(packed, &rgb, in, &rgba, WIDTH, HEIGHT), 0);
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++) assert_float_equal(packed[3 * k + c], in[4 * k + c], 0.0f);
+
+  TR_STEP("verify 3 channels to 3 planes");
+  assert_int_equal(dt_iop_buffer_convert_layout(planes, &planar, packed, &rgb, WIDTH, HEIGHT), 0);
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++) assert_float_equal(planes[c * npixels + k], in[4 * k + c], 0.0f);
+
+  TR_STEP("verify 3 planes back to 4 channels");
+  assert_int_equal(dt_iop_buffer_convert_layout(out, &rgba, planes, &planar, WIDTH, HEIGHT), 0);
+  for(size_t k = 0; k < 4 * npixels; k++) assert_float_equal(out[k], in[k], 0.0f);
+
+  TR_STEP("verify that other buffers are refused");
+  const dt_iop_buffer_dsc_t mono = { .channels = 1, .datatype = TYPE_FLOAT, .layout = LAYOUT_INTERLEAVED };
+  const dt_iop_buffer_dsc_t raw = { .channels = 4, .datatype = TYPE_UINT16, .layout = LAYOUT_INTERLEAVED };
+  assert_int_equal(dt_iop_buffer_convert_layout(out, &rgba, in, &mono, WIDTH, HEIGHT), 1);
+  assert_int_equal(dt_iop_buffer_convert_layout(out, &rgba, in, &raw, WIDTH, HEIGHT), 1);
+
+  dt_free_align(in);
+  dt_free_align(packed);
+  dt_free_align(planes);
+  dt_free_align(out);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_legacy),
+    cmocka_unit_test(test_convert_layout)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
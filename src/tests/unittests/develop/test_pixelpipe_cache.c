@@ -0,0 +1,343 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the half float packing of evicted pixelpipe cache lines
+ * in develop/pixelpipe_cache.c, checking the precision and the color error it introduces,
+ * that packed lines reported as available are really handed out again, and that only color lines
+ * are packed
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "common/darktable.h"
+#include "common/colorspaces_inline_conversions.h"
+#include "develop/format.h"
+#include "develop/pixelpipe_cache.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 1024
+#define HEIGHT 256
+
+// half floats have 11 significant bits, rounding to nearest gives half an ulp
+#define MAX_REL_E 0x1p-11
+// a delta E 76 of 1 is about the just noticeable difference. the error grows with L, the maximum is
+// reached at the brightest highlights, far above diffuse white.
+#define MEAN_DELTA_E 0.02
+#define MAX_DELTA_E 0.2
+
+// floats per cache line in the cache tests
+#define LINE_FLOATS (4 * 64 * 64)
+#define LINE_SIZE (LINE_FLOATS * sizeof(float))
+
+static float _delta_e(const dt_aligned_pixel_t a, const dt_aligned_pixel_t b)
+{
+  dt_aligned_pixel_t XYZ, Lab_a, Lab_b;
+  dt_Rec709_to_XYZ_D50(a, XYZ);
+  dt_XYZ_to_Lab(XYZ, Lab_a);
+  dt_Rec709_to_XYZ_D50(b, XYZ);
+  dt_XYZ_to_Lab(XYZ, Lab_b);
+  const float dL = Lab_a[0] - Lab_b[0], da = Lab_a[1] - Lab_b[1], db = Lab_a[2] - Lab_b[2];
+  return sqrtf(dL * dL + da * da + db * db);
+}
+
+// get the line for hash with format in_dsc, filling it with a ramp depending on the hash if it wasn't cached.
+// returns what dt_dev_pixelpipe_cache_get() returned.
+static int _cache_fill_dsc(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
+                           const dt_iop_buffer_dsc_t *in_dsc)
+{
+  dt_iop_buffer_dsc_t _dsc = *in_dsc;
+  dt_iop_buffer_dsc_t *dsc = &_dsc;
+  void *data = NULL;
+  const int miss = dt_dev_pixelpipe_cache_get(cache, hash, hash, size, &data, &dsc);
+  assert_non_null(data);
+  if(miss)
+    for(size_t k = 0; k < size / sizeof(float); k++) ((float *)data)[k] = 0.25f * hash + 0.001f * k;
+  return miss;
+}
+
+// same for a 4 channel rgb line
+static int _cache_fill(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size)
+{
+  const dt_iop_buffer_dsc_t dsc = { .channels = 4, .datatype = TYPE_FLOAT, .cst = iop_cs_rgb };
+  return _cache_fill_dsc(cache, hash, size, &dsc);
+}
+
+// get the line for hash and check that it holds what _cache_fill() put there
+static void _cache_check(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  dt_iop_buffer_dsc_t _dsc = { 0 };
+  dt_iop_buffer_dsc_t *dsc = &_dsc;
+  void *data = NULL;
+  assert_int_equal(dt_dev_pixelpipe_cache_get(cache, hash, hash, LINE_SIZE, &data, &dsc), 0);
+  assert_non_null(data);
+  assert_int_equal(dsc->channels, 4);
+  assert_int_equal(dsc->datatype, TYPE_FLOAT);
+  for(size_t k = 0; k < LINE_FLOATS; k++)
+  {
+    const float expected = 0.25f * hash + 0.001f * k;
+    assert_float_equal(((float *)data)[k], expected, fabsf(expected) * MAX_REL_E);
+  }
+}
+
+// fill two lines and use each of them twice, so that they are worth packing when evicted
+static void _cache_fill_reused(dt_dev_pixelpipe_cache_t *cache, const uint64_t a, const uint64_t b)
+{
+  assert_int_equal(_cache_fill(cache, a, LINE_SIZE), 1);
+  assert_int_equal(_cache_fill(cache, a, LINE_SIZE), 0);
+  assert_int_equal(_cache_fill(cache, b, LINE_SIZE), 1);
+  assert_int_equal(_cache_fill(cache, b, LINE_SIZE), 0);
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_pack_precision(void **state)
+{
+  // normal half floats range from 2^-14 to 65504, and an odd count exercises the scalar tail
+  const size_t n = 100003;
+  float *in = dt_alloc_align_float(n);
+  float *out = dt_alloc_align_float(n);
+  uint16_t *packed = dt_alloc_align(64, n * sizeof(uint16_t));
+  for(size_t k = 0; k < n; k++)
+    in[k] = ((k & 1) ? -1.0f : 1.0f) * exp2f(-14.0f + 29.9f * k / n);
+
+  TR_STEP("verify that normal values keep 11 significant bits");
+  dt_dev_pixelpipe_cache_pack(packed, in, n);
+  dt_dev_pixelpipe_cache_unpack(out, packed, n);
+  double max_err = 0.0;
+  for(size_t k = 0; k < n; k++) max_err = fmax(max_err, fabs(out[k] - in[k]) / fabs(in[k]));
+  TR_NOTE("max relative error %g", max_err);
+  assert_true(max_err <= MAX_REL_E);
+
+  TR_STEP("verify that exact values, zero and out of range values survive");
+  const float special[] = { 0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 1e6f, -1e6f, 1e-9f };
+  const float expected[] = { 0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 65504.0f, -65504.0f, 0.0f };
+  const size_t ns = sizeof(special) / sizeof(special[0]);
+  dt_dev_pixelpipe_cache_pack(packed, special, ns);
+  dt_dev_pixelpipe_cache_unpack(out, packed, ns);
+  for(size_t k = 0; k < ns; k++) assert_float_equal(out[k], expected[k], 0.0f);
+
+  dt_free_align(in);
+  dt_free_align(out);
+  dt_free_align(packed);
+}
+
+static void test_pack_delta_e(void **state)
+{
+  // scene referred ramps from deep shadows to highlights well above 1, with varying saturation
+  const size_t n = (size_t)4 * WIDTH * HEIGHT;
+  float *in = dt_alloc_align_float(n);
+  float *out = dt_alloc_align_float(n);
+  uint16_t *packed = dt_alloc_align(64, n * sizeof(uint16_t));
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const size_t k = 4 * ((size_t)y * WIDTH + x);
+      const float v = exp2f(-12.0f + 16.0f * x / WIDTH);
+      const float hue = 6.2832f * y / HEIGHT;
+      for(int c = 0; c < 3; c++) in[k + c] = v * (0.55f + 0.45f * cosf(hue + 2.0944f * c));
+      in[k + 3] = 0.0f;
+    }
+
+  TR_STEP("verify that packing introduces no visible color error");
+  const double start = dt_get_wtime();
+  dt_dev_pixelpipe_cache_pack(packed, in, n);
+  const double mid = dt_get_wtime();
+  dt_dev_pixelpipe_cache_unpack(out, packed, n);
+  const double end = dt_get_wtime();
+
+  double mean_de = 0.0, max_de = 0.0;
+  for(size_t k = 0; k < n; k += 4)
+  {
+    const double de = _delta_e(in + k, out + k);
+    mean_de += de;
+    max_de = fmax(max_de, de);
+  }
+  mean_de /= (size_t)WIDTH * HEIGHT;
+
+  TR_NOTE("pack %.4f s, unpack %.4f s, mean delta E %.5f, max delta E %.5f", mid - start, end - mid, mean_de,
+          max_de);
+  assert_true(mean_de < MEAN_DELTA_E);
+  assert_true(max_de < MAX_DELTA_E);
+
+  dt_free_align(in);
+  dt_free_align(out);
+  dt_free_align(packed);
+}
+
+static void test_cache_restore_packed(void **state)
+{
+  dt_dev_pixelpipe_cache_t cache;
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&cache, 2, 0), 1);
+  dt_dev_pixelpipe_cache_set_packed_budget(&cache, 4 * LINE_SIZE);
+
+  TR_STEP("verify that an evicted line which has been reused is still available");
+  _cache_fill_reused(&cache, 1, 2);
+  assert_int_equal(_cache_fill(&cache, 3, LINE_SIZE), 1); // evicts 1
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 1), 1);
+
+  TR_STEP("verify that it is handed out again with its contents and format");
+  _cache_check(&cache, 1);
+  assert_int_equal(cache.unpacked, 1);
+
+  TR_STEP("verify that a line used only once is dropped when evicted");
+  assert_int_equal(_cache_fill(&cache, 4, LINE_SIZE), 1); // evicts 3
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 3), 0);
+
+  TR_STEP("verify that nothing is packed after a flush");
+  dt_dev_pixelpipe_cache_flush(&cache);
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 1), 0);
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 2), 0);
+
+  dt_dev_pixelpipe_cache_cleanup(&cache);
+}
+
+static void test_cache_full_budget(void **state)
+{
+  dt_dev_pixelpipe_cache_t cache;
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&cache, 2, 0), 1);
+  // room for exactly one packed line
+  dt_dev_pixelpipe_cache_set_packed_budget(&cache, LINE_SIZE / 2);
+
+  _cache_fill_reused(&cache, 1, 2);
+  assert_int_equal(_cache_fill(&cache, 3, LINE_SIZE), 1); // evicts 1, fills the budget
+  assert_int_equal(_cache_fill(&cache, 3, LINE_SIZE), 0);
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 1), 1);
+
+  TR_STEP("verify that restoring a packed line doesn't make room for the victim by dropping it");
+  // the victim is 2, which would need the budget taken by 1
+  _cache_check(&cache, 1);
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 2), 0);
+
+  TR_STEP("verify that the victim gets packed once there is room again");
+  assert_int_equal(_cache_fill(&cache, 1, LINE_SIZE), 0);
+  assert_int_equal(_cache_fill(&cache, 4, LINE_SIZE), 1); // evicts 3, packed now that 1 is unpacked
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 3), 1);
+  _cache_check(&cache, 3);
+
+  dt_dev_pixelpipe_cache_cleanup(&cache);
+}
+
+static void test_cache_color_only(void **state)
+{
+  dt_dev_pixelpipe_cache_t cache;
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&cache, 2, 0), 1);
+  dt_dev_pixelpipe_cache_set_packed_budget(&cache, 4 * LINE_SIZE);
+
+  const dt_iop_buffer_dsc_t mosaic = { .channels = 1, .datatype = TYPE_FLOAT, .filters = 0x94949494u,
+                                       .cst = iop_cs_RAW };
+  const dt_iop_buffer_dsc_t raw = { .channels = 4, .datatype = TYPE_FLOAT, .cst = iop_cs_RAW };
+  const dt_iop_buffer_dsc_t mask = { .channels = 1, .datatype = TYPE_FLOAT, .cst = iop_cs_rgb };
+  const dt_iop_buffer_dsc_t *dsc[] = { &mosaic, &raw, &mask };
+
+  for(int k = 0; k < 3; k++)
+  {
+    TR_STEP("verify that a reused line which isn't 4 channel color data is dropped when evicted (%d)", k);
+    const uint64_t a = 10 * (k + 1), b = a + 1, c = a + 2;
+    assert_int_equal(_cache_fill_dsc(&cache, a, LINE_SIZE, dsc[k]), 1);
+    assert_int_equal(_cache_fill_dsc(&cache, a, LINE_SIZE, dsc[k]), 0);
+    assert_int_equal(_cache_fill_dsc(&cache, b, LINE_SIZE, dsc[k]), 1);
+    assert_int_equal(_cache_fill_dsc(&cache, b, LINE_SIZE, dsc[k]), 0);
+    assert_int_equal(_cache_fill(&cache, c, LINE_SIZE), 1); // evicts a
+    assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, a), 0);
+  }
+
+  dt_dev_pixelpipe_cache_cleanup(&cache);
+}
+
+static void test_cache_packed_miss(void **state)
+{
+  dt_dev_pixelpipe_cache_t cache;
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&cache, 2, 0), 1);
+  dt_dev_pixelpipe_cache_set_packed_budget(&cache, 4 * LINE_SIZE);
+
+  _cache_fill_reused(&cache, 1, 2);
+  assert_int_equal(_cache_fill(&cache, 3, LINE_SIZE), 1); // evicts 1
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&cache, 1), 1);
+
+  TR_STEP("verify that a packed line of another size is reported as a miss");
+  assert_int_equal(_cache_fill(&cache, 1, 2 * LINE_SIZE), 1);
+  assert_int_equal(cache.unpacked, 0);
+
+  dt_dev_pixelpipe_cache_cleanup(&cache);
+}
+
+static void test_cache_shared_budget(void **state)
+{
+  dt_dev_pixelpipe_cache_t a, b;
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&a, 2, 0), 1);
+  assert_int_equal(dt_dev_pixelpipe_cache_init(&b, 2, 0), 1);
+  // room for exactly one packed line, for both caches together
+  dt_dev_pixelpipe_cache_set_packed_budget(&a, LINE_SIZE / 2);
+  dt_dev_pixelpipe_cache_set_packed_budget(&b, LINE_SIZE / 2);
+
+  TR_STEP("verify that a line packed by one cache takes the budget of the other");
+  _cache_fill_reused(&a, 1, 2);
+  assert_int_equal(_cache_fill(&a, 3, LINE_SIZE), 1); // evicts 1
+  _cache_fill_reused(&b, 11, 12);
+  assert_int_equal(_cache_fill(&b, 13, LINE_SIZE), 1); // evicts 11, no room left
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&a, 1), 1);
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&b, 11), 0);
+
+  TR_STEP("verify that the budget is given back when a cache goes away");
+  dt_dev_pixelpipe_cache_cleanup(&a);
+  assert_int_equal(_cache_fill(&b, 13, LINE_SIZE), 0);
+  assert_int_equal(_cache_fill(&b, 14, LINE_SIZE), 1); // evicts 12
+  assert_int_equal(dt_dev_pixelpipe_cache_available(&b, 12), 1);
+
+  dt_dev_pixelpipe_cache_cleanup(&b);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_pack_precision),
+    cmocka_unit_test(test_pack_delta_e),
+    cmocka_unit_test(test_cache_restore_packed),
+    cmocka_unit_test(test_cache_full_budget),
+    cmocka_unit_test(test_cache_color_only),
+    cmocka_unit_test(test_cache_packed_miss),
+    cmocka_unit_test(test_cache_shared_budget)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
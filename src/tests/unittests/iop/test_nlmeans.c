@@ -0,0 +1,178 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/nlmeans.c, checking that the SSE2 kernel of common/nlmeans_core.c,
+ * which works on four columns at a time, stays close to the scalar one
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/nlmeans.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// wider than a slice of the kernels and not a multiple of four, so the remainder columns are covered
+#define WIDTH 203
+#define HEIGHT 157
+#define NPIXELS ((size_t)WIDTH * HEIGHT)
+
+// L goes up to 100. the kernels add up the same weights in a different order, so they differ by float rounding
+#define E 5e-4f
+
+// deterministic Lab image with hard edges, gradients and noise
+static float *_noisy_image(void)
+{
+  float *img = dt_alloc_align_float(4 * NPIXELS);
+  uint32_t state = 1;
+  for(int y = 0; y < HEIGHT; y++)
+    for(int x = 0; x < WIDTH; x++)
+    {
+      float *px = img + 4 * ((size_t)y * WIDTH + x);
+      const float L = x < WIDTH / 2 ? 50.0f + 25.0f * sinf(0.21f * x) * cosf(0.13f * y)
+                                    + 20.0f * ((x / 37 + y / 23) & 1)
+                                    : 20.0f + 0.3f * y;
+      for(int c = 0; c < 3; c++)
+      {
+        state = state * 1664525u + 1013904223u;
+        const float noise = (state >> 8) / (float)(1 << 24) - 0.5f;
+        px[c] = (c == 0 ? L : 0.2f * L - 10.0f * c) + 2.0f * noise;
+      }
+      px[3] = 0.0f;
+    }
+  return img;
+}
+
+static void _compare(const float *const scalar, const float *const sse2)
+{
+  float max_err = 0.0f;
+  for(size_t k = 0; k < 4 * NPIXELS; k++)
+    if(k % 4 != 3) max_err = fmaxf(max_err, fabsf(scalar[k] - sse2[k]));
+  TR_NOTE("max difference %.2e", max_err);
+  assert_true(max_err < E);
+}
+
+static int setup(void **state)
+{
+  darktable.num_openmp_threads = dt_get_num_threads();
+  return 0;
+}
+
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_module(void **state)
+{
+#if defined(__SSE2__)
+  float *in = _noisy_image();
+  float *scalar = dt_alloc_align_float(4 * NPIXELS);
+  float *sse2 = dt_alloc_align_float(4 * NPIXELS);
+  const dt_iop_roi_t roi = { .width = WIDTH, .height = HEIGHT, .scale = 1.0f };
+  const dt_dev_pixelpipe_type_t types[] = { DT_DEV_PIXELPIPE_FULL, DT_DEV_PIXELPIPE_PREVIEW };
+
+  for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+    for(int radius = 1; radius <= 4; radius++)
+    {
+      TR_STEP("verify that the module gives the same result with both kernels for patch size %d%s", radius,
+              types[t] == DT_DEV_PIXELPIPE_PREVIEW ? ", decimated" : "");
+      dt_iop_nlmeans_params_t p = { .radius = radius, .strength = 50.0f, .luma = 0.5f, .chroma = 1.0f };
+      dt_dev_pixelpipe_t pipe = { .type = types[t] };
+      dt_dev_pixelpipe_iop_t piece = { .data = &p, .pipe = &pipe, .colors = 4, .iscale = 1.0f };
+      process(NULL, &piece, in, scalar, &roi, &roi);
+      process_sse2(NULL, &piece, in, sse2, &roi, &roi);
+      _compare(scalar, sse2);
+    }
+
+  dt_free_align(sse2);
+  dt_free_align(scalar);
+  dt_free_align(in);
+#else
+  skip();
+#endif
+}
+
+static void test_center_weight(void **state)
+{
+#if defined(__SSE2__)
+  float *in = _noisy_image();
+  float *scalar = dt_alloc_align_float(4 * NPIXELS);
+  float *sse2 = dt_alloc_align_float(4 * NPIXELS);
+  const dt_iop_roi_t roi = { .width = WIDTH, .height = HEIGHT, .scale = 1.0f };
+  const dt_aligned_pixel_t norm2 = { 1.0f, 1.0f, 1.0f, 1.0f };
+  const float scatterings[] = { 0.0f, 0.5f };
+
+  for(size_t s = 0; s < sizeof(scatterings) / sizeof(scatterings[0]); s++)
+    for(int radius = 1; radius <= 4; radius++)
+    {
+      TR_STEP("verify that both kernels weight the central pixel alike for patch size %d, scattering %.1f",
+              radius, scatterings[s]);
+      // the parameters denoiseprofile passes
+      const dt_nlmeans_param_t params = { .scattering = scatterings[s],
+                                          .scale = 1.0f,
+                                          .luma = 1.0f,
+                                          .chroma = 1.0f,
+                                          .center_weight = 0.1f,
+                                          .sharpness = 0.045f / ((2 * radius + 1) * (2 * radius + 1)),
+                                          .patch_radius = radius,
+                                          .search_radius = 7,
+                                          .decimate = 0,
+                                          .norm = norm2 };
+      nlmeans_denoise(in, scalar, &roi, &roi, &params);
+      nlmeans_denoise_sse2(in, sse2, &roi, &roi, &params);
+      _compare(scalar, sse2);
+    }
+
+  dt_free_align(sse2);
+  dt_free_align(scalar);
+  dt_free_align(in);
+#else
+  skip();
+#endif
+}
+
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_module),
+    cmocka_unit_test(test_center_weight)
+  };
+
+  return cmocka_run_group_tests(tests, setup, NULL);
+}
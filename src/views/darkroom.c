@@ -842,6 +842,28 @@ int try_enter(dt_view_t *self)
   return 0;
 }
 
+// load the images before and after the current one in the collection in the background, so that stepping
+// to them doesn't have to wait for the raw to be decoded
+static void _prefetch_neighbors(const int32_t imgid)
+{
+  // whatever was prefetched for the previous image is not needed any more
+  dt_image_prefetch_cancel();
+
+  sqlite3_stmt *stmt;
+  // the next image first, that's where culling usually goes
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid FROM memory.collected_images"
+                              " WHERE rowid IN (SELECT rowid + 1 FROM memory.collected_images WHERE imgid = ?1"
+                              "                 UNION SELECT rowid - 1 FROM memory.collected_images WHERE imgid = ?1)"
+                              " ORDER BY rowid DESC",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG,
+                       dt_image_prefetch_job_create(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+}
+
 static void dt_dev_change_image(dt_develop_t *dev, const int32_t imgid)
 {
   // stop crazy users from sleeping on key-repeat spacebar:
@@ -1148,6 +1170,8 @@ static void dt_dev_change_image(dt_develop_t *dev, const int32_t imgid)
 
   /* last set the group to update visibility of iop modules for new pipe */
   dt_dev_modulegroups_set(dev, dt_conf_get_int("plugins/darkroom/groups"));
+
+  _prefetch_neighbors(imgid);
 }
 
 static void _view_darkroom_filmstrip_activate_callback(gpointer instance, int32_t imgid, gpointer user_data)
@@ -2999,6 +3023,7 @@ void enter(dt_view_t *self)
 
   dt_dev_load_image(darktable.develop, dev->image_storage.id);
 
+  _prefetch_neighbors(dev->image_storage.id);
 
   /*
    * add IOP modules to plugin list
@@ -3105,6 +3130,8 @@ void enter(dt_view_t *self)
 
 void leave(dt_view_t *self)
 {
+  dt_image_prefetch_cancel();
+
   dt_iop_color_picker_cleanup();
   if(darktable.lib->proxy.colorpicker.picker_proxy)
     dt_iop_color_picker_reset(darktable.lib->proxy.colorpicker.picker_proxy->module, FALSE);